@@ -0,0 +1,411 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Live2DComponent.h"
+
+#include "Live2DMocModel.h"
+#include "Live2DSceneProxy.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Materials/Material.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+ULive2DComponent::ULive2DComponent()
+	: Super()
+	, LocalBounds(ForceInit)
+{
+	PrimaryComponentTick.bCanEverTick = false;
+	CastShadow = false;
+	bUseAsOccluder = false;
+	SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+}
+
+void ULive2DComponent::SetModel(ULive2DMocModel* InModel)
+{
+	if (Model == InModel)
+	{
+		return;
+	}
+
+	UnbindFromModel();
+	Model = InModel;
+
+	if (IsRegistered())
+	{
+		BindToModel();
+	}
+}
+
+FPrimitiveSceneProxy* ULive2DComponent::CreateSceneProxy()
+{
+	if (!Model)
+	{
+		return nullptr;
+	}
+
+	if (!DynamicDataPool.IsValid())
+	{
+		DynamicDataPool = MakeShared<FLive2DComponentDynamicDataPool, ESPMode::ThreadSafe>();
+	}
+
+	return new FLive2DSceneProxy(this, DynamicDataPool.ToSharedRef());
+}
+
+FBoxSphereBounds ULive2DComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	if (!LocalBounds.IsValid)
+	{
+		return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f);
+	}
+
+	return FBoxSphereBounds(LocalBounds).TransformBy(LocalToWorld);
+}
+
+void ULive2DComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
+{
+	Super::GetUsedMaterials(OutMaterials, bGetDebugMaterials);
+
+	for (const auto& MaterialInstance: TextureMaterialInstances)
+	{
+		OutMaterials.AddUnique(MaterialInstance.Value);
+	}
+	for (const auto& MaterialInstance: MaskedMaterialInstances)
+	{
+		OutMaterials.AddUnique(MaterialInstance.Value);
+	}
+}
+
+int32 ULive2DComponent::GetNumMaterials() const
+{
+	return TextureMaterialInstances.Num() + MaskedMaterialInstances.Num();
+}
+
+UMaterialInterface* ULive2DComponent::GetMaterial(int32 ElementIndex) const
+{
+	int32 MaterialIndex = ElementIndex;
+	for (const auto& MaterialInstance: TextureMaterialInstances)
+	{
+		if (MaterialIndex-- == 0)
+		{
+			return MaterialInstance.Value;
+		}
+	}
+	for (const auto& MaterialInstance: MaskedMaterialInstances)
+	{
+		if (MaterialIndex-- == 0)
+		{
+			return MaterialInstance.Value;
+		}
+	}
+
+	return Material ? Material : UMaterial::GetDefaultMaterial(MD_Surface);
+}
+
+#if WITH_EDITOR
+void ULive2DComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	const FName PropertyName = PropertyChangedEvent.GetPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, Model))
+	{
+		UnbindFromModel();
+		BindToModel();
+	}
+	else if (PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, Material)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, MaskedMaterial)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, AdditiveMaterial)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, MultiplyMaterial)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, MaskedAdditiveMaterial)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, MaskedMultiplyMaterial)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, TextureParameterName)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DComponent, MaskParameterName))
+	{
+		CreateMaterialInstances();
+		MarkRenderStateDirty();
+	}
+	else
+	{
+		UpdateLocalBounds();
+		UpdateBounds();
+		MarkRenderStateDirty();
+	}
+}
+#endif
+
+void ULive2DComponent::OnRegister()
+{
+	Super::OnRegister();
+
+	BindToModel();
+}
+
+void ULive2DComponent::OnUnregister()
+{
+	UnbindFromModel();
+
+	Super::OnUnregister();
+}
+
+void ULive2DComponent::CreateRenderState_Concurrent(FRegisterComponentContext* Context)
+{
+	Super::CreateRenderState_Concurrent(Context);
+
+	// The new scene proxy has nothing to draw yet
+	SendDynamicData(true);
+}
+
+void ULive2DComponent::SendRenderDynamicData_Concurrent()
+{
+	Super::SendRenderDynamicData_Concurrent();
+
+	SendDynamicData(false);
+}
+
+void ULive2DComponent::SendDynamicData(const bool bIsFullUpdate)
+{
+	if (!SceneProxy || !DynamicDataPool.IsValid())
+	{
+		return;
+	}
+
+	FLive2DComponentDynamicData* DynamicData = DynamicDataPool->Acquire();
+	FillDynamicData(*DynamicData, bIsFullUpdate);
+	FLive2DSceneProxy* Live2DSceneProxy = static_cast<FLive2DSceneProxy*>(SceneProxy);
+
+	ENQUEUE_RENDER_COMMAND(Live2DComponentSendDynamicData)([Live2DSceneProxy, DynamicData](FRHICommandListImmediate& RHICmdList)
+	{
+		Live2DSceneProxy->SetDynamicData_RenderThread(DynamicData);
+	});
+}
+
+void ULive2DComponent::BindToModel()
+{
+	if (!Model)
+	{
+		return;
+	}
+
+	DrawablesUpdatedHandle = Model->OnDrawablesUpdated.AddUObject(this, &ULive2DComponent::OnDrawablesUpdated);
+
+	CreateMaterialInstances();
+	UpdateLocalBounds();
+	UpdateBounds();
+	MarkRenderStateDirty();
+}
+
+void ULive2DComponent::UnbindFromModel()
+{
+	if (Model && DrawablesUpdatedHandle.IsValid())
+	{
+		Model->OnDrawablesUpdated.Remove(DrawablesUpdatedHandle);
+	}
+	DrawablesUpdatedHandle.Reset();
+}
+
+void ULive2DComponent::OnDrawablesUpdated()
+{
+	// Masks aren't resolved in the mesh pass, they are drawn into the model's masking render targets and sampled by the masked material
+	if (MaskedMaterialInstances.Num() > 0)
+	{
+		Model->UpdateMaskingRenderTargets();
+	}
+
+	UpdateLocalBounds();
+	UpdateBounds();
+	MarkRenderTransformDirty();
+	MarkRenderDynamicDataDirty();
+}
+
+void ULive2DComponent::CreateMaterialInstances()
+{
+	TextureMaterialInstances.Reset();
+	MaskedMaterialInstances.Reset();
+
+	if (!Model)
+	{
+		return;
+	}
+
+	CreateTextureMaterialInstances();
+
+	for (int32 DrawableIndex = 0; DrawableIndex < Model->UnSortedDrawables.Num(); DrawableIndex++)
+	{
+		const FLive2DModelDrawable& Drawable = Model->UnSortedDrawables[DrawableIndex];
+		if (!Drawable.IsMasked() || !Model->Textures.IsValidIndex(Drawable.TextureIndex))
+		{
+			continue;
+		}
+
+		MaskedMaterialInstances.Add(DrawableIndex, CreateMaskedMaterialInstance(Drawable, Model->GetMaskingRenderTarget(Drawable)));
+	}
+}
+
+void ULive2DComponent::CreateTextureMaterialInstances()
+{
+	// Only the texture and blend mode combinations the drawables use get an instance
+	for (const FLive2DModelDrawable& Drawable: Model->UnSortedDrawables)
+	{
+		const int32 MaterialKey = GetTextureMaterialKey(Drawable);
+		if (Drawable.IsMasked() || !Model->Textures.IsValidIndex(Drawable.TextureIndex) || TextureMaterialInstances.Contains(MaterialKey))
+		{
+			continue;
+		}
+
+		UMaterialInstanceDynamic* MaterialInstance = UMaterialInstanceDynamic::Create(GetBaseMaterial(Drawable.BlendMode, false), this);
+		MaterialInstance->SetTextureParameterValue(TextureParameterName, Model->Textures[Drawable.TextureIndex]);
+		TextureMaterialInstances.Add(MaterialKey, MaterialInstance);
+	}
+}
+
+UMaterialInstanceDynamic* ULive2DComponent::CreateMaskedMaterialInstance(const FLive2DModelDrawable& Drawable, UTextureRenderTarget2D* MaskRenderTarget)
+{
+	UMaterialInstanceDynamic* MaterialInstance = UMaterialInstanceDynamic::Create(GetBaseMaterial(Drawable.BlendMode, true), this);
+	MaterialInstance->SetTextureParameterValue(TextureParameterName, Model->Textures[Drawable.TextureIndex]);
+	MaterialInstance->SetTextureParameterValue(MaskParameterName, MaskRenderTarget);
+	return MaterialInstance;
+}
+
+void ULive2DComponent::UpdateLocalBounds()
+{
+	LocalBounds.Init();
+
+	if (!Model)
+	{
+		return;
+	}
+
+	const float Scale = GetVertexScale();
+
+	for (int32 Layer = 0; Layer < Model->Drawables.Num(); Layer++)
+	{
+		const FLive2DModelDrawable* Drawable = Model->Drawables[Layer];
+		if (Drawable->bIsCulled)
+		{
+			continue;
+		}
+
+		for (const FVector2f& VertexPosition: Drawable->VertexPositions)
+		{
+			LocalBounds += FVector(GetLocalVertexPosition(VertexPosition, Layer, Scale));
+		}
+	}
+}
+
+void ULive2DComponent::FillDynamicData(FLive2DComponentDynamicData& DynamicData, const bool bIsFullUpdate)
+{
+	DynamicData.ModelCount = 1;
+	FLive2DComponentModelData& ModelData = DynamicData.AddUpdatedModel(0);
+
+	if (!Model)
+	{
+		return;
+	}
+
+	const FLive2DModelCanvasInfo CanvasInfo = Model->GetModelCanvasInfo();
+	const float Scale = CanvasInfo.PixelsPerUnit * UnitsPerPixel;
+
+	for (int32 Layer = 0; Layer < Model->Drawables.Num(); Layer++)
+	{
+		const FLive2DModelDrawable& Drawable = *Model->Drawables[Layer];
+		UMaterialInterface* DrawableMaterial = GetDrawableMaterial(Drawable);
+
+		if (Drawable.bIsCulled || !DrawableMaterial)
+		{
+			continue;
+		}
+
+		FLive2DComponentMeshSection& Section = ModelData.AddSection();
+		Section.MaterialProxy = DrawableMaterial->GetRenderProxy();
+		Section.Layer = Layer;
+		Section.Vertices.SetNum(Drawable.VertexPositions.Num());
+
+		const FColor VertexColor = FLinearColor(1.f, 1.f, 1.f, Drawable.Opacity).ToFColor(false);
+
+		for (int32 VertexIndex = 0; VertexIndex < Drawable.VertexPositions.Num(); VertexIndex++)
+		{
+			const FVector2f& ModelVertex = Drawable.VertexPositions[VertexIndex];
+			FDynamicMeshVertex& Vertex = Section.Vertices[VertexIndex];
+
+			Vertex.Position = GetLocalVertexPosition(ModelVertex, Layer, Scale);
+			Vertex.SetTangents(FVector3f(0.f, -1.f, 0.f), FVector3f(0.f, 0.f, -1.f), FVector3f(1.f, 0.f, 0.f));
+			Vertex.Color = VertexColor;
+			Vertex.TextureCoordinate[0] = Drawable.CanvasVertexUVs[VertexIndex];
+
+			// Position in the masking render target, which shares the model canvas space
+			const FVector2D CanvasPosition = FVector2D(ModelVertex) * CanvasInfo.PixelsPerUnit + CanvasInfo.PivotOrigin;
+			Vertex.TextureCoordinate[1] = FVector2f(CanvasPosition.X / CanvasInfo.Size.X, 1.f - CanvasPosition.Y / CanvasInfo.Size.Y);
+		}
+
+		Section.Indices.SetNum(Drawable.VertexIndices.Num());
+		for (int32 Index = 0; Index < Drawable.VertexIndices.Num(); Index++)
+		{
+			Section.Indices[Index] = Drawable.VertexIndices[Index];
+		}
+	}
+}
+
+float ULive2DComponent::GetVertexScale() const
+{
+	return Model ? Model->GetModelCanvasInfo().PixelsPerUnit * UnitsPerPixel : UnitsPerPixel;
+}
+
+FVector3f ULive2DComponent::GetLocalVertexPosition(const FVector2f& ModelVertex, const int32 Layer, const float Scale) const
+{
+	// Model X maps to -Y so the model reads left to right when looking at it from +X
+	return FVector3f(Layer * LayerSeparation, -ModelVertex.X * Scale, ModelVertex.Y * Scale);
+}
+
+UMaterialInterface* ULive2DComponent::GetDrawableMaterial(const FLive2DModelDrawable& Drawable) const
+{
+	if (Drawable.IsMasked())
+	{
+		const int32 DrawableIndex = &Drawable - Model->UnSortedDrawables.GetData();
+		if (UMaterialInstanceDynamic* const* MaterialInstance = MaskedMaterialInstances.Find(DrawableIndex))
+		{
+			return *MaterialInstance;
+		}
+		return nullptr;
+	}
+
+	return GetTextureMaterialInstance(Drawable);
+}
+
+UMaterialInterface* ULive2DComponent::GetTextureMaterialInstance(const FLive2DModelDrawable& Drawable) const
+{
+	return TextureMaterialInstances.FindRef(GetTextureMaterialKey(Drawable));
+}
+
+UMaterialInterface* ULive2DComponent::GetBaseMaterial(const ELive2dModelBlendMode BlendMode, const bool bIsMasked) const
+{
+	UMaterialInterface* BlendModeMaterial = nullptr;
+	switch (BlendMode)
+	{
+	case ELive2dModelBlendMode::ADDITIVE_BLENDING:
+		BlendModeMaterial = bIsMasked ? MaskedAdditiveMaterial : AdditiveMaterial;
+		break;
+	case ELive2dModelBlendMode::MULTIPLICATIVE_BLENDING:
+		BlendModeMaterial = bIsMasked ? MaskedMultiplyMaterial : MultiplyMaterial;
+		break;
+	default:
+		break;
+	}
+
+	// Unset blend mode materials fall back to the normal material of the same kind, so masked drawables stay masked
+	if (BlendModeMaterial)
+	{
+		return BlendModeMaterial;
+	}
+	if (bIsMasked && MaskedMaterial)
+	{
+		return MaskedMaterial;
+	}
+	return Material ? Material : UMaterial::GetDefaultMaterial(MD_Surface);
+}
+
+int32 ULive2DComponent::GetTextureMaterialKey(const FLive2DModelDrawable& Drawable)
+{
+	const ELive2dModelBlendMode BlendMode = Drawable.BlendMode == ELive2dModelBlendMode::INVALID_BLEND_MODE ? ELive2dModelBlendMode::NORMAL_BLENDING : Drawable.BlendMode;
+	constexpr int32 BlendModeCount = static_cast<int32>(ELive2dModelBlendMode::NORMAL_BLENDING) + 1;
+	return Drawable.TextureIndex * BlendModeCount + static_cast<int32>(BlendMode);
+}
@@ -0,0 +1,441 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Live2DInstancedComponent.h"
+
+#include "Live2DLogCategory.h"
+#include "Live2DMocModel.h"
+#include "Live2DSceneProxy.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+int32 ULive2DInstancedComponent::AddInstance(ULive2DMocModel* InstanceModel, const FTransform& InstanceTransform)
+{
+	if (!IsCompatibleModel(InstanceModel))
+	{
+		UE_LOG(LogLive2D, Warning, TEXT("ULive2DInstancedComponent::AddInstance: Instance model doesn't match the drawables of the component model!"));
+		return INDEX_NONE;
+	}
+
+	const int32 InstanceIndex = Instances.AddDefaulted();
+	Instances[InstanceIndex].Model = InstanceModel;
+	Instances[InstanceIndex].Transform = InstanceTransform;
+
+	if (IsRegistered())
+	{
+		BindInstance(InstanceIndex);
+		CreateInstanceMaterialInstances(Instances[InstanceIndex]);
+		UpdateLocalBounds();
+		UpdateBounds();
+		MarkRenderStateDirty();
+	}
+
+	return InstanceIndex;
+}
+
+bool ULive2DInstancedComponent::RemoveInstance(const int32 InstanceIndex)
+{
+	if (!Instances.IsValidIndex(InstanceIndex))
+	{
+		return false;
+	}
+
+	if (IsRegistered())
+	{
+		UnbindInstance(InstanceIndex);
+		InstanceDrawablesUpdatedHandles.RemoveAt(InstanceIndex);
+		InstanceLocalBounds.RemoveAt(InstanceIndex);
+	}
+
+	const ULive2DMocModel* InstanceModel = Instances[InstanceIndex].Model;
+	Instances.RemoveAt(InstanceIndex);
+
+	const bool bIsModelStillInstanced = Instances.ContainsByPredicate([InstanceModel](const FLive2DModelInstance& Instance)
+	{
+		return Instance.Model == InstanceModel;
+	});
+
+	if (InstanceModel && !bIsModelStillInstanced)
+	{
+		for (const auto& MaskingRenderTarget: InstanceModel->MaskingRenderTargets)
+		{
+			InstanceMaskedMaterialInstances.Remove(MaskingRenderTarget.Value);
+		}
+	}
+
+	if (IsRegistered())
+	{
+		UpdateLocalBounds();
+		UpdateBounds();
+		MarkRenderStateDirty();
+	}
+
+	return true;
+}
+
+bool ULive2DInstancedComponent::UpdateInstanceTransform(const int32 InstanceIndex, const FTransform& InstanceTransform)
+{
+	if (!Instances.IsValidIndex(InstanceIndex))
+	{
+		return false;
+	}
+
+	Instances[InstanceIndex].Transform = InstanceTransform;
+
+	if (InstanceLocalBounds.IsValidIndex(InstanceIndex))
+	{
+		InstanceLocalBounds[InstanceIndex] = CalcInstanceLocalBounds(Instances[InstanceIndex], GetVertexScale());
+		MarkInstanceNeedsUpdate(InstanceIndex);
+		UpdateLocalBounds();
+		UpdateBounds();
+		MarkRenderTransformDirty();
+		MarkRenderDynamicDataDirty();
+	}
+
+	return true;
+}
+
+void ULive2DInstancedComponent::ClearInstances()
+{
+	UnbindFromModel();
+	Instances.Reset();
+	InstanceMaskedMaterialInstances.Reset();
+
+	if (IsRegistered())
+	{
+		UpdateLocalBounds();
+		UpdateBounds();
+		MarkRenderStateDirty();
+	}
+}
+
+void ULive2DInstancedComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
+{
+	Super::GetUsedMaterials(OutMaterials, bGetDebugMaterials);
+
+	for (const auto& MaterialInstance: InstanceMaskedMaterialInstances)
+	{
+		OutMaterials.AddUnique(MaterialInstance.Value);
+	}
+}
+
+int32 ULive2DInstancedComponent::GetNumMaterials() const
+{
+	return Super::GetNumMaterials() + InstanceMaskedMaterialInstances.Num();
+}
+
+UMaterialInterface* ULive2DInstancedComponent::GetMaterial(int32 ElementIndex) const
+{
+	int32 MaskedIndex = ElementIndex - Super::GetNumMaterials();
+	if (MaskedIndex >= 0)
+	{
+		for (const auto& MaterialInstance: InstanceMaskedMaterialInstances)
+		{
+			if (MaskedIndex-- == 0)
+			{
+				return MaterialInstance.Value;
+			}
+		}
+	}
+
+	return Super::GetMaterial(ElementIndex);
+}
+
+#if WITH_EDITOR
+void ULive2DInstancedComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	// Cached instance bounds, shared UVs and material instances all depend on the edited values, the model change is already handled by the parent
+	if (PropertyChangedEvent.GetPropertyName() != GET_MEMBER_NAME_CHECKED(ULive2DInstancedComponent, Model))
+	{
+		UnbindFromModel();
+		BindToModel();
+	}
+}
+#endif
+
+void ULive2DInstancedComponent::BindToModel()
+{
+	if (!Model)
+	{
+		return;
+	}
+
+	CacheSharedVertexData();
+	CreateMaterialInstances();
+
+	for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+	{
+		BindInstance(InstanceIndex);
+	}
+
+	UpdateLocalBounds();
+	UpdateBounds();
+	MarkRenderStateDirty();
+}
+
+void ULive2DInstancedComponent::UnbindFromModel()
+{
+	for (int32 InstanceIndex = 0; InstanceIndex < InstanceDrawablesUpdatedHandles.Num(); InstanceIndex++)
+	{
+		UnbindInstance(InstanceIndex);
+	}
+
+	InstanceDrawablesUpdatedHandles.Reset();
+	InstanceLocalBounds.Reset();
+}
+
+void ULive2DInstancedComponent::CreateMaterialInstances()
+{
+	TextureMaterialInstances.Reset();
+	MaskedMaterialInstances.Reset();
+	InstanceMaskedMaterialInstances.Reset();
+
+	if (!Model)
+	{
+		return;
+	}
+
+	CreateTextureMaterialInstances();
+
+	for (const FLive2DModelInstance& Instance: Instances)
+	{
+		CreateInstanceMaterialInstances(Instance);
+	}
+}
+
+void ULive2DInstancedComponent::UpdateLocalBounds()
+{
+	LocalBounds.Init();
+
+	for (const FBox& InstanceBounds: InstanceLocalBounds)
+	{
+		LocalBounds += InstanceBounds;
+	}
+}
+
+void ULive2DInstancedComponent::FillDynamicData(FLive2DComponentDynamicData& DynamicData, const bool bIsFullUpdate)
+{
+	DynamicData.ModelCount = Instances.Num();
+	InstanceNeedsUpdate.SetNum(Instances.Num());
+
+	if (!Model || SharedVertexUVs.Num() != Model->UnSortedDrawables.Num())
+	{
+		return;
+	}
+
+	const FLive2DModelCanvasInfo CanvasInfo = Model->GetModelCanvasInfo();
+	const float Scale = CanvasInfo.PixelsPerUnit * UnitsPerPixel;
+
+	// Only the instances that were posed or moved since the last update are rebuilt, the proxy keeps the others
+	for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+	{
+		if (!bIsFullUpdate && !InstanceNeedsUpdate[InstanceIndex])
+		{
+			continue;
+		}
+		InstanceNeedsUpdate[InstanceIndex] = false;
+
+		FillInstanceModelData(InstanceIndex, DynamicData.AddUpdatedModel(InstanceIndex), CanvasInfo, Scale);
+	}
+}
+
+void ULive2DInstancedComponent::FillInstanceModelData(const int32 InstanceIndex, FLive2DComponentModelData& ModelData, const FLive2DModelCanvasInfo& CanvasInfo, const float Scale) const
+{
+	const FLive2DModelInstance& Instance = Instances[InstanceIndex];
+
+	ModelData.LocalCenter = InstanceLocalBounds.IsValidIndex(InstanceIndex) && InstanceLocalBounds[InstanceIndex].IsValid ? InstanceLocalBounds[InstanceIndex].GetCenter() : Instance.Transform.GetLocation();
+
+	if (!IsCompatibleModel(Instance.Model))
+	{
+		return;
+	}
+
+	// The vertices are built in component space, so the proxy can merge the same layer of all instances into one batch
+	const FMatrix44f InstanceToComponent(Instance.Transform.ToMatrixWithScale());
+	const FVector3f TangentX = InstanceToComponent.TransformVector(FVector3f(0.f, -1.f, 0.f)).GetSafeNormal();
+	const FVector3f TangentY = InstanceToComponent.TransformVector(FVector3f(0.f, 0.f, -1.f)).GetSafeNormal();
+	const FVector3f TangentZ = InstanceToComponent.TransformVector(FVector3f(1.f, 0.f, 0.f)).GetSafeNormal();
+
+	for (const FLive2DModelDrawable* Drawable: Instance.Model->Drawables)
+	{
+		UMaterialInterface* DrawableMaterial = Drawable->bIsCulled ? nullptr : GetInstanceDrawableMaterial(Instance, *Drawable);
+		if (!DrawableMaterial)
+		{
+			continue;
+		}
+
+		FLive2DComponentMeshSection& Section = ModelData.AddSection();
+		Section.MaterialProxy = DrawableMaterial->GetRenderProxy();
+		Section.Layer = Drawable->RenderOrder;
+
+		const int32 DrawableIndex = Drawable - Instance.Model->UnSortedDrawables.GetData();
+		const FLive2DModelDrawable& SharedDrawable = Model->UnSortedDrawables[DrawableIndex];
+		const TArray<FVector2f>& VertexUVs = SharedVertexUVs[DrawableIndex];
+		const FColor VertexColor = FLinearColor(1.f, 1.f, 1.f, Drawable->Opacity).ToFColor(false);
+
+		const int32 VertexCount = FMath::Min(Drawable->VertexPositions.Num(), VertexUVs.Num());
+		Section.Vertices.SetNum(VertexCount);
+
+		for (int32 VertexIndex = 0; VertexIndex < VertexCount; VertexIndex++)
+		{
+			const FVector2f& ModelVertex = Drawable->VertexPositions[VertexIndex];
+			FDynamicMeshVertex& Vertex = Section.Vertices[VertexIndex];
+
+			Vertex.Position = InstanceToComponent.TransformPosition(GetLocalVertexPosition(ModelVertex, Drawable->RenderOrder, Scale));
+			Vertex.SetTangents(TangentX, TangentY, TangentZ);
+			Vertex.Color = VertexColor;
+			Vertex.TextureCoordinate[0] = VertexUVs[VertexIndex];
+
+			// Position in the instance's masking render target
+			const FVector2D CanvasPosition = FVector2D(ModelVertex) * CanvasInfo.PixelsPerUnit + CanvasInfo.PivotOrigin;
+			Vertex.TextureCoordinate[1] = FVector2f(CanvasPosition.X / CanvasInfo.Size.X, 1.f - CanvasPosition.Y / CanvasInfo.Size.Y);
+		}
+
+		Section.Indices.Reserve(SharedDrawable.VertexIndices.Num());
+		for (const int32 VertexIndex: SharedDrawable.VertexIndices)
+		{
+			Section.Indices.Add(VertexIndex);
+		}
+	}
+}
+
+void ULive2DInstancedComponent::MarkInstanceNeedsUpdate(const int32 InstanceIndex)
+{
+	InstanceNeedsUpdate.SetNum(Instances.Num());
+	InstanceNeedsUpdate[InstanceIndex] = true;
+}
+
+bool ULive2DInstancedComponent::IsCompatibleModel(const ULive2DMocModel* InstanceModel) const
+{
+	return Model && InstanceModel && InstanceModel->UnSortedDrawables.Num() == Model->UnSortedDrawables.Num();
+}
+
+void ULive2DInstancedComponent::BindInstance(const int32 InstanceIndex)
+{
+	InstanceDrawablesUpdatedHandles.SetNum(Instances.Num());
+	InstanceLocalBounds.SetNum(Instances.Num());
+
+	FLive2DModelInstance& Instance = Instances[InstanceIndex];
+	InstanceLocalBounds[InstanceIndex] = FBox(ForceInit);
+
+	if (!IsCompatibleModel(Instance.Model))
+	{
+		return;
+	}
+
+	InstanceDrawablesUpdatedHandles[InstanceIndex] = Instance.Model->OnDrawablesUpdated.AddUObject(this, &ULive2DInstancedComponent::OnInstanceDrawablesUpdated, Instance.Model);
+	InstanceLocalBounds[InstanceIndex] = CalcInstanceLocalBounds(Instance, GetVertexScale());
+}
+
+void ULive2DInstancedComponent::UnbindInstance(const int32 InstanceIndex)
+{
+	if (!InstanceDrawablesUpdatedHandles.IsValidIndex(InstanceIndex))
+	{
+		return;
+	}
+
+	FDelegateHandle& Handle = InstanceDrawablesUpdatedHandles[InstanceIndex];
+	if (Handle.IsValid() && Instances.IsValidIndex(InstanceIndex) && Instances[InstanceIndex].Model)
+	{
+		Instances[InstanceIndex].Model->OnDrawablesUpdated.Remove(Handle);
+	}
+	Handle.Reset();
+}
+
+void ULive2DInstancedComponent::OnInstanceDrawablesUpdated(ULive2DMocModel* InstanceModel)
+{
+	const float Scale = GetVertexScale();
+
+	for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+	{
+		if (Instances[InstanceIndex].Model == InstanceModel && InstanceLocalBounds.IsValidIndex(InstanceIndex))
+		{
+			InstanceLocalBounds[InstanceIndex] = CalcInstanceLocalBounds(Instances[InstanceIndex], Scale);
+			MarkInstanceNeedsUpdate(InstanceIndex);
+		}
+	}
+
+	if (InstanceMaskedMaterialInstances.Num() > 0)
+	{
+		InstanceModel->UpdateMaskingRenderTargets();
+	}
+
+	// Several instances update in the same frame, the dynamic data is only sent once at the end of it
+	UpdateLocalBounds();
+	UpdateBounds();
+	MarkRenderTransformDirty();
+	MarkRenderDynamicDataDirty();
+}
+
+void ULive2DInstancedComponent::CreateInstanceMaterialInstances(const FLive2DModelInstance& Instance)
+{
+	if (!IsCompatibleModel(Instance.Model))
+	{
+		return;
+	}
+
+	for (const FLive2DModelDrawable& Drawable: Instance.Model->UnSortedDrawables)
+	{
+		if (!Drawable.IsMasked() || !Model->Textures.IsValidIndex(Drawable.TextureIndex))
+		{
+			continue;
+		}
+
+		UTextureRenderTarget2D* MaskRenderTarget = Instance.Model->GetMaskingRenderTarget(Drawable);
+		if (MaskRenderTarget && !InstanceMaskedMaterialInstances.Contains(MaskRenderTarget))
+		{
+			InstanceMaskedMaterialInstances.Add(MaskRenderTarget, CreateMaskedMaterialInstance(Drawable, MaskRenderTarget));
+		}
+	}
+}
+
+FBox ULive2DInstancedComponent::CalcInstanceLocalBounds(const FLive2DModelInstance& Instance, const float Scale) const
+{
+	FBox ModelBounds(ForceInit);
+
+	for (const FLive2DModelDrawable& Drawable: Instance.Model->UnSortedDrawables)
+	{
+		if (Drawable.bIsCulled)
+		{
+			continue;
+		}
+
+		for (const FVector2f& VertexPosition: Drawable.VertexPositions)
+		{
+			ModelBounds += FVector(GetLocalVertexPosition(VertexPosition, Drawable.RenderOrder, Scale));
+		}
+	}
+
+	return ModelBounds.IsValid ? ModelBounds.TransformBy(Instance.Transform) : ModelBounds;
+}
+
+void ULive2DInstancedComponent::CacheSharedVertexData()
+{
+	SharedVertexUVs.SetNum(Model->UnSortedDrawables.Num());
+
+	for (int32 DrawableIndex = 0; DrawableIndex < Model->UnSortedDrawables.Num(); DrawableIndex++)
+	{
+		const TConstArrayView<FVector2f> VertexUVs = Model->UnSortedDrawables[DrawableIndex].VertexUVs;
+		TArray<FVector2f>& SharedUVs = SharedVertexUVs[DrawableIndex];
+
+		SharedUVs.SetNum(VertexUVs.Num());
+		for (int32 VertexIndex = 0; VertexIndex < VertexUVs.Num(); VertexIndex++)
+		{
+			SharedUVs[VertexIndex] = FVector2f(VertexUVs[VertexIndex].X, 1.f - VertexUVs[VertexIndex].Y);
+		}
+	}
+}
+
+UMaterialInterface* ULive2DInstancedComponent::GetInstanceDrawableMaterial(const FLive2DModelInstance& Instance, const FLive2DModelDrawable& Drawable) const
+{
+	if (Drawable.IsMasked())
+	{
+		UTextureRenderTarget2D* MaskRenderTarget = Instance.Model->GetMaskingRenderTarget(Drawable);
+		UMaterialInstanceDynamic* const* MaterialInstance = MaskRenderTarget ? InstanceMaskedMaterialInstances.Find(MaskRenderTarget) : nullptr;
+		return MaterialInstance ? *MaterialInstance : nullptr;
+	}
+
+	return GetTextureMaterialInstance(Drawable);
+}
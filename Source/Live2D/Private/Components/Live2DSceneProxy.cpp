@@ -0,0 +1,226 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Live2DSceneProxy.h"
+
+#include "MaterialShared.h"
+#include "SceneManagement.h"
+#include "Components/MeshComponent.h"
+#include "Misc/MemStack.h"
+
+FLive2DComponentMeshSection& FLive2DComponentModelData::AddSection()
+{
+	if (SectionCount == Sections.Num())
+	{
+		Sections.AddDefaulted();
+	}
+
+	FLive2DComponentMeshSection& Section = Sections[SectionCount++];
+	Section.Vertices.Reset();
+	Section.Indices.Reset();
+	Section.MaterialProxy = nullptr;
+	Section.Layer = 0;
+	return Section;
+}
+
+void FLive2DComponentDynamicData::Reset()
+{
+	ModelCount = 0;
+	UpdatedModelCount = 0;
+}
+
+FLive2DComponentModelData& FLive2DComponentDynamicData::AddUpdatedModel(const int32 ModelIndex)
+{
+	if (UpdatedModelCount == UpdatedModels.Num())
+	{
+		UpdatedModels.AddDefaulted();
+	}
+
+	FLive2DComponentModelData& ModelData = UpdatedModels[UpdatedModelCount++];
+	ModelData.SectionCount = 0;
+	ModelData.ModelIndex = ModelIndex;
+	ModelData.LocalCenter = FVector::ZeroVector;
+	return ModelData;
+}
+
+FLive2DComponentDynamicDataPool::~FLive2DComponentDynamicDataPool()
+{
+	FLive2DComponentDynamicData* DynamicData;
+	while (FreeDynamicData.Dequeue(DynamicData))
+	{
+		delete DynamicData;
+	}
+}
+
+FLive2DComponentDynamicData* FLive2DComponentDynamicDataPool::Acquire()
+{
+	FLive2DComponentDynamicData* DynamicData;
+	if (!FreeDynamicData.Dequeue(DynamicData))
+	{
+		DynamicData = new FLive2DComponentDynamicData;
+	}
+
+	DynamicData->Reset();
+	return DynamicData;
+}
+
+void FLive2DComponentDynamicDataPool::Release(FLive2DComponentDynamicData* DynamicData)
+{
+	if (DynamicData)
+	{
+		FreeDynamicData.Enqueue(DynamicData);
+	}
+}
+
+FLive2DSceneProxy::FLive2DSceneProxy(UMeshComponent* Component, const TSharedRef<FLive2DComponentDynamicDataPool, ESPMode::ThreadSafe>& InDynamicDataPool)
+	: FPrimitiveSceneProxy(Component)
+	, MaterialRelevance(Component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
+	, DynamicDataPool(InDynamicDataPool)
+{
+}
+
+SIZE_T FLive2DSceneProxy::GetTypeHash() const
+{
+	static size_t UniquePointer;
+	return reinterpret_cast<size_t>(&UniquePointer);
+}
+
+void FLive2DSceneProxy::SetDynamicData_RenderThread(FLive2DComponentDynamicData* NewDynamicData)
+{
+	check(IsInRenderingThread());
+
+	Models.SetNum(NewDynamicData->ModelCount);
+	for (int32 UpdateIndex = 0; UpdateIndex < NewDynamicData->UpdatedModelCount; UpdateIndex++)
+	{
+		FLive2DComponentModelData& UpdatedModel = NewDynamicData->UpdatedModels[UpdateIndex];
+		if (Models.IsValidIndex(UpdatedModel.ModelIndex))
+		{
+			// The replaced model goes back to the pool in its place, so a later update refills its arrays
+			Swap(Models[UpdatedModel.ModelIndex], UpdatedModel);
+		}
+	}
+
+	DynamicDataPool->Release(NewDynamicData);
+}
+
+void FLive2DSceneProxy::GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const
+{
+	if (Models.Num() == 0)
+	{
+		return;
+	}
+
+	// Scene rendering scratch, freed at the end of the frame
+	TArray<int32, TMemStackAllocator<>> ModelOrder;
+	TArray<double, TMemStackAllocator<>> ModelDistances;
+	TArray<int32, TMemStackAllocator<>> NextSections;
+	TArray<const FLive2DComponentMeshSection*, TMemStackAllocator<>> BatchSections;
+	ModelOrder.SetNumUninitialized(Models.Num());
+	ModelDistances.SetNumUninitialized(Models.Num());
+	NextSections.SetNumUninitialized(Models.Num());
+
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		if (!(VisibilityMap & (1 << ViewIndex)))
+		{
+			continue;
+		}
+
+		// Within each layer the models are drawn back to front
+		const FVector ViewOrigin = Views[ViewIndex]->ViewMatrices.GetViewOrigin();
+		for (int32 ModelIndex = 0; ModelIndex < Models.Num(); ModelIndex++)
+		{
+			ModelOrder[ModelIndex] = ModelIndex;
+			ModelDistances[ModelIndex] = FVector::DistSquared(GetLocalToWorld().TransformPosition(Models[ModelIndex].LocalCenter), ViewOrigin);
+		}
+		ModelOrder.Sort([&ModelDistances](const int32 l, const int32 r)
+		{
+			return ModelDistances[l] > ModelDistances[r];
+		});
+
+		// Translucent batches of one primitive are sorted by their id, which keeps the layers in render order
+		int32 MeshIdInPrimitive = 0;
+		auto FlushBatch = [&]()
+		{
+			if (BatchSections.Num() == 0)
+			{
+				return;
+			}
+
+			FDynamicMeshBuilder MeshBuilder(Views[ViewIndex]->GetFeatureLevel(), 2);
+			for (const FLive2DComponentMeshSection* Section: BatchSections)
+			{
+				const int32 BaseVertexIndex = MeshBuilder.AddVertices(Section->Vertices);
+				for (int32 Index = 0; Index + 2 < Section->Indices.Num(); Index += 3)
+				{
+					MeshBuilder.AddTriangle(BaseVertexIndex + Section->Indices[Index], BaseVertexIndex + Section->Indices[Index + 1], BaseVertexIndex + Section->Indices[Index + 2]);
+				}
+			}
+
+			FMeshBatch Mesh;
+			MeshBuilder.GetMeshElement(GetLocalToWorld(), BatchSections[0]->MaterialProxy, SDPG_World, true, false, ViewIndex, Collector, Mesh);
+			Mesh.MeshIdInPrimitive = FMath::Min(MeshIdInPrimitive++, (int32)MAX_uint16);
+			Collector.AddMesh(ViewIndex, Mesh);
+			BatchSections.Reset();
+		};
+
+		// Walks the layers in ascending order, consecutive sections sharing a material go into the same batch
+		FMemory::Memzero(NextSections.GetData(), NextSections.Num() * sizeof(int32));
+		while (true)
+		{
+			int32 Layer = MAX_int32;
+			for (int32 ModelIndex = 0; ModelIndex < Models.Num(); ModelIndex++)
+			{
+				if (NextSections[ModelIndex] < Models[ModelIndex].SectionCount)
+				{
+					Layer = FMath::Min(Layer, Models[ModelIndex].Sections[NextSections[ModelIndex]].Layer);
+				}
+			}
+			if (Layer == MAX_int32)
+			{
+				break;
+			}
+
+			for (const int32 ModelIndex: ModelOrder)
+			{
+				const FLive2DComponentModelData& ModelData = Models[ModelIndex];
+				int32& SectionIndex = NextSections[ModelIndex];
+				for (; SectionIndex < ModelData.SectionCount && ModelData.Sections[SectionIndex].Layer == Layer; SectionIndex++)
+				{
+					const FLive2DComponentMeshSection& Section = ModelData.Sections[SectionIndex];
+					if (BatchSections.Num() > 0 && BatchSections[0]->MaterialProxy != Section.MaterialProxy)
+					{
+						FlushBatch();
+					}
+					BatchSections.Add(&Section);
+				}
+			}
+		}
+		FlushBatch();
+	}
+}
+
+FPrimitiveViewRelevance FLive2DSceneProxy::GetViewRelevance(const FSceneView* View) const
+{
+	FPrimitiveViewRelevance Result;
+	Result.bDrawRelevance = IsShown(View);
+	Result.bShadowRelevance = IsShadowCast(View);
+	Result.bDynamicRelevance = true;
+	Result.bRenderInMainPass = ShouldRenderInMainPass();
+	Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
+	Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+	Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
+	MaterialRelevance.SetPrimitiveViewRelevance(Result);
+	Result.bVelocityRelevance = DrawsVelocity() && Result.bOpaque && Result.bRenderInMainPass;
+	return Result;
+}
+
+bool FLive2DSceneProxy::CanBeOccluded() const
+{
+	return !MaterialRelevance.bDisableDepthTest;
+}
+
+uint32 FLive2DSceneProxy::GetMemoryFootprint() const
+{
+	return sizeof(*this) + GetAllocatedSize();
+}
\ No newline at end of file
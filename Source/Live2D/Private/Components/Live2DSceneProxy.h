@@ -0,0 +1,93 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DynamicMeshBuilder.h"
+#include "PrimitiveSceneProxy.h"
+#include "Containers/Queue.h"
+
+class UMeshComponent;
+
+/** Geometry of one drawable in component space */
+struct FLive2DComponentMeshSection
+{
+	TArray<FDynamicMeshVertex> Vertices;
+	TArray<uint32> Indices;
+	FMaterialRenderProxy* MaterialProxy = nullptr;
+
+	/** Render order of the drawable, the proxy draws all models layer by layer */
+	int32 Layer = 0;
+};
+
+/** Sections of one posed model, in ascending layer order */
+struct FLive2DComponentModelData
+{
+	/** Only the first SectionCount sections are drawn, the ones after it keep their arrays for the next update */
+	TArray<FLive2DComponentMeshSection> Sections;
+	int32 SectionCount = 0;
+
+	/** The component model, or the instance */
+	int32 ModelIndex = 0;
+
+	/** Component space center of the model, within a layer the models are drawn back to front by it */
+	FVector LocalCenter = FVector::ZeroVector;
+
+	FLive2DComponentMeshSection& AddSection();
+};
+
+/** Models that changed since the last update, the proxy keeps drawing the others as they were */
+struct FLive2DComponentDynamicData
+{
+	/** Number of models the proxy draws */
+	int32 ModelCount = 0;
+
+	/** Only the first UpdatedModelCount models are used, the ones after it keep their arrays for the next update */
+	TArray<FLive2DComponentModelData> UpdatedModels;
+	int32 UpdatedModelCount = 0;
+
+	void Reset();
+	FLive2DComponentModelData& AddUpdatedModel(const int32 ModelIndex);
+};
+
+/** Hands the dynamic data the render thread is done with back to the game thread, so updates refill the same arrays instead of allocating new ones */
+class FLive2DComponentDynamicDataPool
+{
+public:
+	~FLive2DComponentDynamicDataPool();
+
+	/** Game thread, returns recycled dynamic data or new one */
+	FLive2DComponentDynamicData* Acquire();
+
+	/** Render thread */
+	void Release(FLive2DComponentDynamicData* DynamicData);
+
+private:
+	TQueue<FLive2DComponentDynamicData*, EQueueMode::Spsc> FreeDynamicData;
+};
+
+/**
+ * Scene proxy shared by the Live2D components, draws the models sent from the game thread as dynamic meshes.
+ * The sections of all models are drawn layer by layer, and consecutive sections sharing a material are merged into one batch.
+ * So many models of the same moc cost a batch per layer and material rather than per model, only masked drawables sample a mask of their own model
+ */
+class FLive2DSceneProxy final : public FPrimitiveSceneProxy
+{
+public:
+	FLive2DSceneProxy(UMeshComponent* Component, const TSharedRef<FLive2DComponentDynamicDataPool, ESPMode::ThreadSafe>& InDynamicDataPool);
+
+	void SetDynamicData_RenderThread(FLive2DComponentDynamicData* NewDynamicData);
+
+	//~ Begin FPrimitiveSceneProxy Interface
+	virtual SIZE_T GetTypeHash() const override;
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override;
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override;
+	virtual bool CanBeOccluded() const override;
+	virtual uint32 GetMemoryFootprint() const override;
+	//~ End FPrimitiveSceneProxy Interface
+
+private:
+	FMaterialRelevance MaterialRelevance;
+	TArray<FLive2DComponentModelData> Models;
+	TSharedRef<FLive2DComponentDynamicDataPool, ESPMode::ThreadSafe> DynamicDataPool;
+};
@@ -9,8 +9,233 @@
 #include "HAL/PlatformFilemanager.h"
 #include "Live2DCubismCore.h"
 #include "Engine/Canvas.h"
+#include "Engine/Engine.h"
 #include "Kismet/KismetRenderingLibrary.h"
 #include "Live2DModelPhysics.h"
+#include "Live2DPhysicsScheduler.h"
+#include "Async/ParallelFor.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/MemStack.h"
+#include "RenderUtils.h"
+
+static TAutoConsoleVariable<float> CVarLive2DRenderTargetScale(
+	TEXT("Live2D.RenderTargetScale"),
+	1.f,
+	TEXT("Resolution of the Live2D model render targets relative to the size the models are displayed at."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarLive2DStaticLayersMaxLayers(
+	TEXT("Live2D.StaticLayers.MaxLayers"),
+	4,
+	TEXT("Maximum number of cached layers per model holding ranges of drawables that stopped changing, 0 disables static layers."),
+	ECVF_Scalability);
+
+static TAutoConsoleVariable<int32> CVarLive2DStaticLayersSettleUpdates(
+	TEXT("Live2D.StaticLayers.SettleUpdates"),
+	30,
+	TEXT("Number of updates a drawable has to stay unchanged before it is considered static."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DStaticLayersMinDrawables(
+	TEXT("Live2D.StaticLayers.MinDrawables"),
+	4,
+	TEXT("Minimum number of visible drawables in a range of static drawables for it to be cached in a layer."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPoseCacheMaxMemoryKB(
+	TEXT("Live2D.PoseCache.MaxMemoryKB"),
+	1024,
+	TEXT("Memory per model for cached drawable outputs of recently seen poses, the least recently used poses are evicted above it."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DPoseCacheQuantization(
+	TEXT("Live2D.PoseCache.Quantization"),
+	0.001f,
+	TEXT("Step parameter values and part opacities are rounded to before looking up a cached pose."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DCulling(
+	TEXT("Live2D.Culling"),
+	1,
+	TEXT("Skips the vertex update and drawing of drawables too transparent to show and of masks whose clients are all culled."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DCullingMinOpacity(
+	TEXT("Live2D.Culling.MinOpacity"),
+	0.002f,
+	TEXT("Opacity below which a drawable is culled. The default rounds to zero in an 8 bit render target."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DParallelAssembly(
+	TEXT("Live2D.ParallelAssembly"),
+	1,
+	TEXT("Assembles the triangles of the drawables of a model on the task graph before they are submitted in render order."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DParallelAssemblyMinDrawables(
+	TEXT("Live2D.ParallelAssembly.MinDrawables"),
+	16,
+	TEXT("Minimum number of drawables in a draw for its triangles to be assembled in parallel."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DDirtyRects(
+	TEXT("Live2D.DirtyRects"),
+	1,
+	TEXT("Only redraws the part of a model render target covered by drawables that changed since the last update."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DDirtyRectsMaxAreaFraction(
+	TEXT("Live2D.DirtyRects.MaxAreaFraction"),
+	0.5f,
+	TEXT("Fraction of the render target area above which a dirty rect is redrawn as a whole render target instead of clipped."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DRenderTargetShrinkThreshold(
+	TEXT("Live2D.RenderTargetShrinkThreshold"),
+	0.25f,
+	TEXT("Fraction the desired render target size has to fall below the allocated size before a model render target is shrunk.\n")
+	TEXT("Render targets grow as soon as they are too small."),
+	ECVF_Default);
+
+static_assert(sizeof(csmVector2) == sizeof(FVector2f), "Vertex data of the model core is viewed as FVector2f");
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pose Cache Hits"), STAT_Live2DPoseCacheHits, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pose Cache Misses"), STAT_Live2DPoseCacheMisses, STATGROUP_Live2D);
+DECLARE_MEMORY_STAT(TEXT("Pose Cache Memory"), STAT_Live2DPoseCacheMemory, STATGROUP_Live2D);
+DECLARE_MEMORY_STAT(TEXT("Scratch High Water Of Frame"), STAT_Live2DScratchHighWater, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Culled Drawables"), STAT_Live2DCulledDrawables, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Culled Masks"), STAT_Live2DCulledMasks, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Culled Triangles"), STAT_Live2DCulledTriangles, STATGROUP_Live2D);
+
+namespace
+{
+	/** Change flags of a drawable compared against the outputs it is about to receive */
+	csmFlags CalcDrawableChangedFlags(const FLive2DModelDrawable& Drawable, const bool bPositionsChanged, const float Opacity, const int32 DrawOrder, const int32 RenderOrder, const bool bIsVisible)
+	{
+		csmFlags ChangedFlags = 0;
+		ChangedFlags |= bPositionsChanged ? csmVertexPositionsDidChange : 0;
+		ChangedFlags |= Drawable.Opacity != Opacity ? csmOpacityDidChange : 0;
+		ChangedFlags |= Drawable.DrawOrder != DrawOrder ? csmDrawOrderDidChange : 0;
+		ChangedFlags |= Drawable.RenderOrder != RenderOrder ? csmRenderOrderDidChange : 0;
+		ChangedFlags |= Drawable.IsVisible() != bIsVisible ? csmVisibilityDidChange : 0;
+		return ChangedFlags;
+	}
+
+#if STATS
+	/** Sum of the scratch high water marks of the models that updated this frame, published and reset when the frame ends */
+	SIZE_T FrameScratchHighWater = 0;
+
+	void AddFrameScratchHighWater(const SIZE_T Size)
+	{
+		static const FDelegateHandle EndFrameHandle = FCoreDelegates::OnEndFrame.AddLambda([]()
+		{
+			SET_MEMORY_STAT(STAT_Live2DScratchHighWater, FrameScratchHighWater);
+			FrameScratchHighWater = 0;
+		});
+		FrameScratchHighWater += Size;
+	}
+#endif
+
+	struct FClipVertex
+	{
+		FVector2D Position;
+		FVector2D UV;
+		FLinearColor Color;
+	};
+
+	FClipVertex LerpClipVertex(const FClipVertex& A, const FClipVertex& B, const double Alpha)
+	{
+		return { FMath::Lerp(A.Position, B.Position, Alpha), FMath::Lerp(A.UV, B.UV, Alpha), FMath::Lerp(A.Color, B.Color, static_cast<float>(Alpha)) };
+	}
+
+	/** Out = In * Scale + Offset for a run of float2 vertices, two vertices per vector register */
+	void TransformVertices(const FVector2f* RESTRICT In, FVector2f* RESTRICT Out, const int32 Count, const FVector2f& Scale, const FVector2f& Offset)
+	{
+		const VectorRegister4Float VectorScale = MakeVectorRegisterFloat(Scale.X, Scale.Y, Scale.X, Scale.Y);
+		const VectorRegister4Float VectorOffset = MakeVectorRegisterFloat(Offset.X, Offset.Y, Offset.X, Offset.Y);
+
+		int32 VertexIndex = 0;
+		for (; VertexIndex + 2 <= Count; VertexIndex += 2)
+		{
+			VectorStore(VectorMultiplyAdd(VectorLoad(&In[VertexIndex].X), VectorScale, VectorOffset), &Out[VertexIndex].X);
+		}
+		for (; VertexIndex < Count; VertexIndex++)
+		{
+			Out[VertexIndex] = In[VertexIndex] * Scale + Offset;
+		}
+	}
+
+	/** Clips a triangle to a rect with Sutherland-Hodgman, the canvas has no scissor rect so partial redraws are clipped here */
+	void ClipTriangleToRect(const FCanvasUVTri& Triangle, const FBox2D& ClipRect, TArray<FCanvasUVTri>& OutTriangles)
+	{
+		FBox2D TriangleBounds(ForceInit);
+		TriangleBounds += Triangle.V0_Pos;
+		TriangleBounds += Triangle.V1_Pos;
+		TriangleBounds += Triangle.V2_Pos;
+
+		if (!ClipRect.Intersect(TriangleBounds))
+		{
+			return;
+		}
+		if (ClipRect.IsInside(TriangleBounds))
+		{
+			OutTriangles.Add(Triangle);
+			return;
+		}
+
+		TArray<FClipVertex, TInlineAllocator<8>> Polygon = {
+			{ Triangle.V0_Pos, Triangle.V0_UV, Triangle.V0_Color },
+			{ Triangle.V1_Pos, Triangle.V1_UV, Triangle.V1_Color },
+			{ Triangle.V2_Pos, Triangle.V2_UV, Triangle.V2_Color }
+		};
+		TArray<FClipVertex, TInlineAllocator<8>> ClippedPolygon;
+
+		for (int32 Edge = 0; Edge < 4; Edge++)
+		{
+			const int32 Axis = Edge % 2;
+			const bool bIsMinEdge = Edge < 2;
+			const double Bound = bIsMinEdge ? ClipRect.Min[Axis] : ClipRect.Max[Axis];
+
+			ClippedPolygon.Reset();
+			for (int32 VertexIndex = 0; VertexIndex < Polygon.Num(); VertexIndex++)
+			{
+				const FClipVertex& Current = Polygon[VertexIndex];
+				const FClipVertex& Next = Polygon[(VertexIndex + 1) % Polygon.Num()];
+				const double CurrentDistance = bIsMinEdge ? Current.Position[Axis] - Bound : Bound - Current.Position[Axis];
+				const double NextDistance = bIsMinEdge ? Next.Position[Axis] - Bound : Bound - Next.Position[Axis];
+
+				if (CurrentDistance >= 0.0)
+				{
+					ClippedPolygon.Add(Current);
+				}
+				if ((CurrentDistance >= 0.0) != (NextDistance >= 0.0))
+				{
+					ClippedPolygon.Add(LerpClipVertex(Current, Next, CurrentDistance / (CurrentDistance - NextDistance)));
+				}
+			}
+
+			Swap(Polygon, ClippedPolygon);
+			if (Polygon.Num() < 3)
+			{
+				return;
+			}
+		}
+
+		for (int32 VertexIndex = 1; VertexIndex + 1 < Polygon.Num(); VertexIndex++)
+		{
+			FCanvasUVTri& ClippedTriangle = OutTriangles.AddDefaulted_GetRef();
+			ClippedTriangle.V0_Pos = Polygon[0].Position;
+			ClippedTriangle.V0_UV = Polygon[0].UV;
+			ClippedTriangle.V0_Color = Polygon[0].Color;
+			ClippedTriangle.V1_Pos = Polygon[VertexIndex].Position;
+			ClippedTriangle.V1_UV = Polygon[VertexIndex].UV;
+			ClippedTriangle.V1_Color = Polygon[VertexIndex].Color;
+			ClippedTriangle.V2_Pos = Polygon[VertexIndex + 1].Position;
+			ClippedTriangle.V2_UV = Polygon[VertexIndex + 1].UV;
+			ClippedTriangle.V2_Color = Polygon[VertexIndex + 1].Color;
+		}
+	}
+}
 
 ULive2DMocModel::ULive2DMocModel()
 	: Super()
@@ -89,6 +314,7 @@ bool ULive2DMocModel::Init(const FString& FileName, const TArray<FModel3GroupDat
 
 void ULive2DMocModel::BeginDestroy()
 {
+	ResetPoseCache();
 	FMemory::Free(Model);
 	FMemory::Free(Moc);
 	
@@ -115,6 +341,25 @@ void ULive2DMocModel::Serialize(FArchive& Ar)
 	}
 }
 
+#if WITH_EDITOR
+void ULive2DMocModel::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	const FName PropertyName = PropertyChangedEvent.GetPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DMocModel, Textures) || PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DMocModel, bUsePremultipliedAlpha))
+	{
+		// Cached batched element parameters reference the textures and blend setup directly
+		ResetBatchedElementParameters();
+		InvalidateStaticLayers();
+	}
+	else if (PropertyName == GET_MEMBER_NAME_CHECKED(ULive2DMocModel, RenderTargetScale))
+	{
+		UpdateRenderTargetSize();
+	}
+}
+#endif
+
 float ULive2DMocModel::GetModelWidth() const
 {
 	return GetModelSize().X;
@@ -126,6 +371,79 @@ float ULive2DMocModel::GetModelHeight() const
 	return GetModelSize().Y;
 }
 
+FLive2DModelCanvasInfo ULive2DMocModel::GetModelCanvasInfo() const
+{
+	return GetModelCanvasInfoInternal();
+}
+
+void ULive2DMocModel::SetDisplaySize(const FVector2D& InDisplaySize)
+{
+	DisplaySize = InDisplaySize;
+	UpdateRenderTargetSize();
+}
+
+FVector2D ULive2DMocModel::GetDisplaySize() const
+{
+	return DisplaySize.X > 0.f && DisplaySize.Y > 0.f ? DisplaySize : GetModelSize();
+}
+
+float ULive2DMocModel::GetRenderTargetScale() const
+{
+	return RenderTargetScale > 0.f ? RenderTargetScale : FMath::Max(CVarLive2DRenderTargetScale.GetValueOnGameThread(), 0.01f);
+}
+
+FIntPoint ULive2DMocModel::CalcDesiredRenderTargetSize() const
+{
+	const FVector2D ModelSize = GetModelSize();
+	if (ModelSize.X <= 0.f || ModelSize.Y <= 0.f)
+	{
+		return FIntPoint(1, 1);
+	}
+
+	// The canvas keeps its aspect ratio and covers the display size, but never exceeds its native resolution before scaling
+	const FVector2D Display = GetDisplaySize();
+	const float DisplayScale = FMath::Min(1.f, FMath::Max(Display.X / ModelSize.X, Display.Y / ModelSize.Y));
+	const FVector2D Size = ModelSize * DisplayScale * GetRenderTargetScale();
+
+	const int32 MaxDimension = GetMax2DTextureDimension();
+	return FIntPoint(FMath::Clamp(FMath::CeilToInt(Size.X), 1, MaxDimension), FMath::Clamp(FMath::CeilToInt(Size.Y), 1, MaxDimension));
+}
+
+bool ULive2DMocModel::UpdateRenderTargetSize()
+{
+	AppliedRenderTargetScale = GetRenderTargetScale();
+
+	const FIntPoint DesiredSize = CalcDesiredRenderTargetSize();
+	const float ShrinkThreshold = FMath::Clamp(CVarLive2DRenderTargetShrinkThreshold.GetValueOnGameThread(), 0.f, 1.f);
+
+	// Grows immediately, shrinks only once clearly too large, so a display size hovering around a value doesn't reallocate every frame
+	const bool bIsTooSmall = DesiredSize.X > RenderTargetSize.X || DesiredSize.Y > RenderTargetSize.Y;
+	const bool bIsTooLarge = DesiredSize.X < RenderTargetSize.X * (1.f - ShrinkThreshold) && DesiredSize.Y < RenderTargetSize.Y * (1.f - ShrinkThreshold);
+
+	RenderTargetBrush.ImageSize = GetDisplaySize();
+
+	if (!bIsTooSmall && !bIsTooLarge)
+	{
+		return false;
+	}
+
+	RenderTargetSize = DesiredSize;
+	InvalidateStaticLayers();
+
+	for (const auto& MaskingRenderTarget: MaskingRenderTargets)
+	{
+		MaskingRenderTarget.Value->ResizeTarget(RenderTargetSize.X, RenderTargetSize.Y);
+	}
+
+	if (RenderTarget2D)
+	{
+		RenderTarget2D->ResizeTarget(RenderTargetSize.X, RenderTargetSize.Y);
+		UpdateRenderTarget();
+		return true;
+	}
+	return false;
+}
+
 FVector2D ULive2DMocModel::GetModelSize() const
 {
 	auto CanvasInfo = GetModelCanvasInfoInternal();
@@ -140,6 +458,39 @@ ULive2DModelPhysics* ULive2DMocModel::GetPhysicsSystem()
 
 void ULive2DMocModel::UpdateDrawables()
 {
+	const bool bIsPoseCacheEnabled = bUsePoseCache && CVarLive2DPoseCacheMaxMemoryKB.GetValueOnGameThread() > 0;
+	if (!bIsPoseCacheEnabled && (PoseCacheEntries.Num() > 0 || CurrentPose.Num() > 0))
+	{
+		ResetPoseCache();
+	}
+
+	uint32 PoseKey = 0;
+	if (bIsPoseCacheEnabled)
+	{
+		PoseKey = CalcPoseKey(ScratchPose);
+
+		// The drawables already show this pose, nothing to update or redraw
+		if (ScratchPose == CurrentPose)
+		{
+			return;
+		}
+
+		const int32* PoseCacheEntryIndex = PoseCacheEntryIndices.Find(PoseKey);
+		if (PoseCacheEntryIndex && PoseCacheEntries[*PoseCacheEntryIndex].QuantizedPose == ScratchPose)
+		{
+			INC_DWORD_STAT(STAT_Live2DPoseCacheHits);
+			UnlinkPoseCacheEntry(*PoseCacheEntryIndex);
+			LinkPoseCacheEntry(*PoseCacheEntryIndex);
+			ApplyDrawableOutputs(PoseCacheEntries[*PoseCacheEntryIndex].Outputs);
+			Swap(CurrentPose, ScratchPose);
+			bDrawablesDivergedFromCore = true;
+			FinishUpdateDrawables();
+			return;
+		}
+
+		INC_DWORD_STAT(STAT_Live2DPoseCacheMisses);
+	}
+
 	csmResetDrawableDynamicFlags(Model);
 	csmUpdateModel(Model);
 	
@@ -155,18 +506,30 @@ void ULive2DMocModel::UpdateDrawables()
 	const int* RenderOrders = csmGetDrawableRenderOrders(Model);
 	const csmFlags* DynamicFlags = csmGetDrawableDynamicFlags(Model);
 
+	CullDrawables(Opacities, [DynamicFlags](const int32 ModelDrawableIndex)
+	{
+		return (DynamicFlags[ModelDrawableIndex] & csmIsVisible) == csmIsVisible;
+	});
+
 	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < DrawableCount; ModelDrawableIndex++)
 	{
-		FString DrawableId = Ids[ModelDrawableIndex];
 		FLive2DModelDrawable& Drawable = UnSortedDrawables[ModelDrawableIndex];
 
-		const int32 VertexCount = VertexCounts[ModelDrawableIndex];
-		Drawable.VertexPositions.SetNum(VertexCount);
+		// Vertex counts never change, the view into the arena always matches the core
+		const FVector2f* CorePositions = reinterpret_cast<const FVector2f*>(VertexPositions[ModelDrawableIndex]);
+		const SIZE_T PositionsSize = Drawable.VertexPositions.Num() * sizeof(FVector2f);
+		const bool bPositionsChanged = ScratchVerticesNeeded[ModelDrawableIndex] && FMemory::Memcmp(Drawable.VertexPositions.GetData(), CorePositions, PositionsSize) != 0;
+		if (bPositionsChanged)
+		{
+			FMemory::Memcpy(Drawable.VertexPositions.GetData(), CorePositions, PositionsSize);
+		}
 
-		for (int VertexIndex = 0; VertexIndex < VertexCount; VertexIndex++)
+		csmFlags DynamicFlag = DynamicFlags[ModelDrawableIndex];
+		if (bDrawablesDivergedFromCore)
 		{
-			Drawable.VertexPositions[VertexIndex].X = VertexPositions[ModelDrawableIndex][VertexIndex].X;
-			Drawable.VertexPositions[VertexIndex].Y = VertexPositions[ModelDrawableIndex][VertexIndex].Y;
+			// The core flags describe the change since the last core update, not since the pose that came from the cache
+			const bool bIsVisible = (DynamicFlag & csmIsVisible) == csmIsVisible;
+			DynamicFlag = (DynamicFlag & csmIsVisible) | CalcDrawableChangedFlags(Drawable, bPositionsChanged, Opacities[ModelDrawableIndex], DrawOrders[ModelDrawableIndex], RenderOrders[ModelDrawableIndex], bIsVisible);
 		}
 		
 		// Access to other Drawable elements
@@ -175,176 +538,633 @@ void ULive2DMocModel::UpdateDrawables()
 		// The following three items are important on rendering.
 		Drawable.Opacity = Opacities[ModelDrawableIndex];
 		Drawable.RenderOrder = RenderOrders[ModelDrawableIndex];
-		Drawable.DynamicFlag = DynamicFlags[ModelDrawableIndex];
+		Drawable.DynamicFlag = DynamicFlag;
+
+		constexpr csmFlags ChangedFlags = csmVisibilityDidChange | csmOpacityDidChange | csmDrawOrderDidChange | csmRenderOrderDidChange | csmVertexPositionsDidChange;
+		Drawable.StaticUpdateCount = (Drawable.DynamicFlag & ChangedFlags) != 0 ? 0 : Drawable.StaticUpdateCount + 1;
+	}
+
+	bDrawablesDivergedFromCore = false;
+	if (bIsPoseCacheEnabled)
+	{
+		AddPoseCacheEntry(PoseKey, ScratchPose);
+		Swap(CurrentPose, ScratchPose);
 	}
 
+	FinishUpdateDrawables();
+}
+
+void ULive2DMocModel::FinishUpdateDrawables()
+{
 	Drawables.Sort([](const FLive2DModelDrawable& l, const FLive2DModelDrawable& r)
 	{
 		return (l.RenderOrder < r.RenderOrder);
 	});
 
-	UpdateRenderTarget();
+#if WITH_EDITORONLY_DATA
+	for (FLive2DModelDrawable& Drawable: UnSortedDrawables)
+	{
+		Drawable.EditorVertexPositions.Reset(Drawable.VertexPositions.Num());
+		for (const FVector2f& VertexPosition: Drawable.VertexPositions)
+		{
+			Drawable.EditorVertexPositions.Add(FVector2D(VertexPosition));
+		}
+	}
+#endif
+
+	// The render target only exists once something displays the model as an image
+	if (RenderTarget2D)
+	{
+		UpdateRenderTarget();
+	}
+	UpdateScratchHighWater();
 	OnDrawablesUpdated.Broadcast();
 }
 
-float ULive2DMocModel::GetParameterValue(const FString& ParameterName)
+FCanvasTriangleItem& ULive2DMocModel::GetScratchTriangleItem(const FTexture* Texture)
 {
-	auto* ParameterValue = ParameterValues.Find(ParameterName);
-
-	if (!ParameterValue)
+	if (!ScratchTriangleItem)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
-		return 0.f;
+		ScratchTriangleItem = MakeUnique<FCanvasTriangleItem>(TArray<FCanvasUVTri>(), Texture);
 	}
 
-	return *ParameterValue;
+	ScratchTriangleItem->Texture = Texture;
+	ScratchTriangleItem->TriangleList.Reset();
+	ScratchTriangleItem->BatchedElementParameters = nullptr;
+	ScratchTriangleItem->StereoDepth = 0;
+	return *ScratchTriangleItem;
 }
 
-float ULive2DMocModel::GetMinimumParameterValue(const FString& ParameterName)
+void ULive2DMocModel::UpdateScratchHighWater()
 {
-	auto* MinimumParameterValue = ParameterMinimumValues.Find(ParameterName);
-
-	if (!MinimumParameterValue)
+#if STATS
+	SIZE_T ScratchSize = ScratchPose.GetAllocatedSize() + ScratchDrawQueue.GetAllocatedSize() + (ScratchTriangleItem ? ScratchTriangleItem->TriangleList.GetAllocatedSize() : 0);
+	for (const TArray<FCanvasUVTri>& Triangles: ScratchTriangleSlots)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetMinimumParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
-		return 0.f;
+		ScratchSize += Triangles.GetAllocatedSize();
 	}
+	ScratchHighWater = FMath::Max(ScratchHighWater, ScratchSize);
 
-	return *MinimumParameterValue;
+	// A model updating several times in a frame is counted once, with its largest mark
+	if (ScratchStatFrame != GFrameCounter)
+	{
+		ScratchStatFrame = GFrameCounter;
+		CountedScratchHighWater = 0;
+	}
+	AddFrameScratchHighWater(ScratchHighWater - CountedScratchHighWater);
+	CountedScratchHighWater = ScratchHighWater;
+#endif
 }
 
-float ULive2DMocModel::GetMaximumParameterValue(const FString& ParameterName)
+void ULive2DMocModel::EvaluateDrawableOutputs(FLive2DModelDrawableOutputs& OutOutputs)
 {
-	auto* MaximumParameterValue = ParameterMaximumValues.Find(ParameterName);
+	csmUpdateModel(Model);
 
-	if (!MaximumParameterValue)
+	// The next core update reports its changes relative to this evaluation instead of the drawables
+	bDrawablesDivergedFromCore = true;
+
+	const int32 DrawableCount = csmGetDrawableCount(Model);
+	const int* VertexCounts = csmGetDrawableVertexCounts(Model);
+	const csmVector2** VertexPositions = csmGetDrawableVertexPositions(Model);
+	const float* Opacities = csmGetDrawableOpacities(Model);
+	const int* DrawOrders = csmGetDrawableDrawOrders(Model);
+	const int* RenderOrders = csmGetDrawableRenderOrders(Model);
+	const csmFlags* DynamicFlags = csmGetDrawableDynamicFlags(Model);
+
+	OutOutputs.VertexPositions.Reset();
+	OutOutputs.Opacities.Reset(DrawableCount);
+	OutOutputs.DrawOrders.Reset(DrawableCount);
+	OutOutputs.RenderOrders.Reset(DrawableCount);
+	OutOutputs.Visibilities.Reset(DrawableCount);
+	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < DrawableCount; ModelDrawableIndex++)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetMaximumParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
-		return 0.f;
+		OutOutputs.VertexPositions.Append(reinterpret_cast<const FVector2f*>(VertexPositions[ModelDrawableIndex]), VertexCounts[ModelDrawableIndex]);
+		OutOutputs.Opacities.Add(Opacities[ModelDrawableIndex]);
+		OutOutputs.DrawOrders.Add(DrawOrders[ModelDrawableIndex]);
+		OutOutputs.RenderOrders.Add(RenderOrders[ModelDrawableIndex]);
+		OutOutputs.Visibilities.Add((DynamicFlags[ModelDrawableIndex] & csmIsVisible) == csmIsVisible);
 	}
+}
 
-	return *MaximumParameterValue;
+void ULive2DMocModel::SetDrawableOutputs(const FLive2DModelDrawableOutputs& Outputs)
+{
+	ApplyDrawableOutputs(Outputs);
+	CurrentPose.Reset();
+	bDrawablesDivergedFromCore = true;
+	bDrawableOutputsSet = true;
+	FinishUpdateDrawables();
 }
 
-float ULive2DMocModel::GetDefaultParameterValue(const FString& ParameterName)
+uint32 ULive2DMocModel::CalcPoseKey(TArray<int32>& OutQuantizedPose) const
 {
-	auto* DefaultParameterValue = ParameterDefaultValues.Find(ParameterName);
+	const int32 ParameterCount = csmGetParameterCount(Model);
+	const float* ModelParameterValues = csmGetParameterValues(Model);
+	const int32 PartCount = csmGetPartCount(Model);
+	const float* ModelPartOpacities = csmGetPartOpacities(Model);
+	const float InvStep = 1.f / FMath::Max(CVarLive2DPoseCacheQuantization.GetValueOnGameThread(), KINDA_SMALL_NUMBER);
 
-	if (!DefaultParameterValue)
+	OutQuantizedPose.SetNumUninitialized(ParameterCount + PartCount);
+	for (int32 ParameterIndex = 0; ParameterIndex < ParameterCount; ParameterIndex++)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetDefaultParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
-		return 0.f;
+		OutQuantizedPose[ParameterIndex] = FMath::RoundToInt(ModelParameterValues[ParameterIndex] * InvStep);
+	}
+	for (int32 PartIndex = 0; PartIndex < PartCount; PartIndex++)
+	{
+		OutQuantizedPose[ParameterCount + PartIndex] = FMath::RoundToInt(ModelPartOpacities[PartIndex] * InvStep);
 	}
 
-	return *DefaultParameterValue;
+	return FCrc::MemCrc32(OutQuantizedPose.GetData(), OutQuantizedPose.Num() * sizeof(int32));
 }
 
-void ULive2DMocModel::SetParameterValue(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
+void ULive2DMocModel::ApplyDrawableOutputs(const FLive2DModelDrawableOutputs& Outputs)
 {
-	TArray<FString> AffectedIds;
-	if (GetAffectedParameterIdsByGroupName(ParameterName, TEXT("Parameter"), AffectedIds))
+	CullDrawables(Outputs.Opacities.GetData(), [&Outputs](const int32 ModelDrawableIndex)
+	{
+		return Outputs.Visibilities[ModelDrawableIndex];
+	});
+
+	int32 VertexOffset = 0;
+	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < UnSortedDrawables.Num(); ModelDrawableIndex++)
 	{
-		for (const auto& AffectedId: AffectedIds)
+		FLive2DModelDrawable& Drawable = UnSortedDrawables[ModelDrawableIndex];
+
+		// Vertex counts of a drawable never change, so the outputs line up with the current positions
+		const int32 VertexCount = Drawable.VertexPositions.Num();
+		const FVector2f* OutputPositions = Outputs.VertexPositions.GetData() + VertexOffset;
+		const bool bPositionsChanged = ScratchVerticesNeeded[ModelDrawableIndex] && FMemory::Memcmp(Drawable.VertexPositions.GetData(), OutputPositions, VertexCount * sizeof(FVector2f)) != 0;
+		if (bPositionsChanged)
 		{
-			SetParameterValueInternal(AffectedId, Value, bUpdateDrawables);
+			FMemory::Memcpy(Drawable.VertexPositions.GetData(), OutputPositions, VertexCount * sizeof(FVector2f));
 		}
-		return;
+		VertexOffset += VertexCount;
+
+		const float Opacity = Outputs.Opacities[ModelDrawableIndex];
+		const int32 DrawOrder = Outputs.DrawOrders[ModelDrawableIndex];
+		const int32 RenderOrder = Outputs.RenderOrders[ModelDrawableIndex];
+		const bool bIsVisible = Outputs.Visibilities[ModelDrawableIndex];
+		const csmFlags ChangedFlags = CalcDrawableChangedFlags(Drawable, bPositionsChanged, Opacity, DrawOrder, RenderOrder, bIsVisible);
+
+		Drawable.DrawOrder = DrawOrder;
+		Drawable.Opacity = Opacity;
+		Drawable.RenderOrder = RenderOrder;
+		Drawable.DynamicFlag = (bIsVisible ? csmIsVisible : 0) | ChangedFlags;
+		Drawable.StaticUpdateCount = ChangedFlags != 0 ? 0 : Drawable.StaticUpdateCount + 1;
 	}
-	
-	SetParameterValueInternal(ParameterName, Value, bUpdateDrawables);
 }
 
-void ULive2DMocModel::ResetParametersToDefault()
+void ULive2DMocModel::CullDrawables(const float* Opacities, TFunctionRef<bool(int32)> IsVisible)
 {
-	const int32 ModelParameterCount = csmGetParameterCount(Model);
-	const char** ModelParameterIds = csmGetParameterIds(Model);
-	float* ModelParameterValues = csmGetParameterValues(Model);
-	const float* ModelParameterDefaultValues = csmGetParameterDefaultValues(Model);
+	const bool bIsCullingEnabled = CVarLive2DCulling.GetValueOnGameThread() != 0;
+	const float MinOpacity = bIsCullingEnabled ? CVarLive2DCullingMinOpacity.GetValueOnGameThread() : 0.f;
 
-	for(int32 ParameterIndex = 0; ParameterIndex < ModelParameterCount; ParameterIndex++)
+	ScratchVerticesNeeded.SetNumUninitialized(UnSortedDrawables.Num(), false);
+	int32 CulledDrawableCount = 0;
+	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < UnSortedDrawables.Num(); ModelDrawableIndex++)
 	{
-		const FString ParameterId = ModelParameterIds[ParameterIndex];
-		ParameterValues.Add(ParameterId, ModelParameterDefaultValues[ParameterIndex]);
-		ModelParameterValues[ParameterIndex] = ModelParameterDefaultValues[ParameterIndex];
+		FLive2DModelDrawable& Drawable = UnSortedDrawables[ModelDrawableIndex];
+		Drawable.bIsCulled = !IsVisible(ModelDrawableIndex) || Opacities[ModelDrawableIndex] < MinOpacity;
+		ScratchVerticesNeeded[ModelDrawableIndex] = !bIsCullingEnabled || !Drawable.bIsCulled;
+		CulledDrawableCount += Drawable.bIsCulled ? 1 : 0;
 	}
-}
 
-float ULive2DMocModel::GetPartOpacityValue(const FString& ParameterName)
-{
-	auto* PartOpacity = PartOpacities.Find(ParameterName);
+	// Masks are drawn for their clients whether they are visible themselves or not
+	for (const FLive2DModelDrawable& Drawable: UnSortedDrawables)
+	{
+		if (Drawable.bIsCulled)
+		{
+			continue;
+		}
 
-	if (!PartOpacity)
+		for (const int32 MaskIndex: Drawable.Masks)
+		{
+			if (ScratchVerticesNeeded.IsValidIndex(MaskIndex))
+			{
+				ScratchVerticesNeeded[MaskIndex] = true;
+			}
+		}
+	}
+
+	int32 CulledMaskCount = 0;
+	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < UnSortedDrawables.Num(); ModelDrawableIndex++)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetPartOpacityValue: Part Opacity Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
-		return 0.f;
+		CulledMaskCount += UnSortedDrawables[ModelDrawableIndex].bIsMask && !ScratchVerticesNeeded[ModelDrawableIndex] ? 1 : 0;
 	}
 
-	return *PartOpacity;
+	INC_DWORD_STAT_BY(STAT_Live2DCulledDrawables, CulledDrawableCount);
+	INC_DWORD_STAT_BY(STAT_Live2DCulledMasks, CulledMaskCount);
 }
 
-void ULive2DMocModel::SetPartOpacityValue(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
+void ULive2DMocModel::AddPoseCacheEntry(const uint32 PoseKey, const TArray<int32>& QuantizedPose)
 {
-	TArray<FString> AffectedIds;
-	if (GetAffectedParameterIdsByGroupName(ParameterName, TEXT("PartOpacity"), AffectedIds))
+	const int32 DrawableCount = UnSortedDrawables.Num();
+	const SIZE_T MaxPoseCacheSize = static_cast<SIZE_T>(CVarLive2DPoseCacheMaxMemoryKB.GetValueOnGameThread()) * 1024;
+	const SIZE_T EntrySize = QuantizedPose.Num() * sizeof(int32) + VertexPositionArena.Num() * sizeof(FVector2f)
+		+ DrawableCount * (sizeof(float) + sizeof(int32) + sizeof(int32) + sizeof(bool));
+	if (EntrySize > MaxPoseCacheSize)
+	{
+		return;
+	}
+
+	// A different pose with the same key is overwritten in place
+	int32 EntryIndex = INDEX_NONE;
+	SIZE_T ReusedEntrySize = 0;
+	if (const int32* CollidingEntryIndex = PoseCacheEntryIndices.Find(PoseKey))
+	{
+		EntryIndex = *CollidingEntryIndex;
+		ReusedEntrySize = PoseCacheEntries[EntryIndex].GetAllocatedSize();
+		UnlinkPoseCacheEntry(EntryIndex);
+	}
+
+	// The least recently used entries make room, the first one is refilled and the others give their memory back
+	while (PoseCacheSize - ReusedEntrySize + EntrySize > MaxPoseCacheSize && LeastRecentPoseCacheEntry != INDEX_NONE)
 	{
-		for (const auto& AffectedId: AffectedIds)
+		const int32 EvictedEntryIndex = LeastRecentPoseCacheEntry;
+		UnlinkPoseCacheEntry(EvictedEntryIndex);
+		PoseCacheEntryIndices.Remove(PoseCacheEntries[EvictedEntryIndex].PoseKey);
+
+		if (EntryIndex == INDEX_NONE)
 		{
-			SetPartOpacityValueInternal(AffectedId, Value, bUpdateDrawables);
+			EntryIndex = EvictedEntryIndex;
+			ReusedEntrySize = PoseCacheEntries[EntryIndex].GetAllocatedSize();
+		}
+		else
+		{
+			FPoseCacheEntry& EvictedEntry = PoseCacheEntries[EvictedEntryIndex];
+			PoseCacheSize -= EvictedEntry.GetAllocatedSize();
+			DEC_MEMORY_STAT_BY(STAT_Live2DPoseCacheMemory, EvictedEntry.GetAllocatedSize());
+			EvictedEntry = FPoseCacheEntry();
+			FreePoseCacheEntries.Add(EvictedEntryIndex);
 		}
-		return;
 	}
-	
-	SetPartOpacityValueInternal(ParameterName, Value, bUpdateDrawables);
-}
 
-FSlateBrush& ULive2DMocModel::GetImageBrush()
-{
-	if (!RenderTarget2D)
+	if (EntryIndex == INDEX_NONE)
 	{
-		SetupRenderTarget();
-		UpdateRenderTarget();
+		EntryIndex = FreePoseCacheEntries.Num() > 0 ? FreePoseCacheEntries.Pop(false) : PoseCacheEntries.AddDefaulted();
 	}
-	
-	return RenderTargetBrush; 
-}
 
-void ULive2DMocModel::StartTicking(const float TickRate)
-{
-	UWorld* World =
-#if WITH_EDITOR
-	GWorld;
-#else
-	GetWorld();
-#endif
+	// Refills the arrays of a reused entry, which already have the capacity for a pose of this model
+	FPoseCacheEntry& PoseCacheEntry = PoseCacheEntries[EntryIndex];
+	const SIZE_T PreviousEntrySize = PoseCacheEntry.GetAllocatedSize();
+	PoseCacheEntry.PoseKey = PoseKey;
+	PoseCacheEntry.QuantizedPose.Reset(QuantizedPose.Num());
+	PoseCacheEntry.QuantizedPose.Append(QuantizedPose);
+
+	FLive2DModelDrawableOutputs& Outputs = PoseCacheEntry.Outputs;
+	Outputs.VertexPositions.Reset(VertexPositionArena.Num());
+	Outputs.VertexPositions.Append(VertexPositionArena);
+	Outputs.Opacities.Reset(DrawableCount);
+	Outputs.DrawOrders.Reset(DrawableCount);
+	Outputs.RenderOrders.Reset(DrawableCount);
+	Outputs.Visibilities.Reset(DrawableCount);
+	for (const FLive2DModelDrawable& Drawable: UnSortedDrawables)
+	{
+		Outputs.Opacities.Add(Drawable.Opacity);
+		Outputs.DrawOrders.Add(Drawable.DrawOrder);
+		Outputs.RenderOrders.Add(Drawable.RenderOrder);
+		Outputs.Visibilities.Add(Drawable.IsVisible());
+	}
 
-	World = GWorld;
+	PoseCacheSize = PoseCacheSize - PreviousEntrySize + PoseCacheEntry.GetAllocatedSize();
+	INC_MEMORY_STAT_BY(STAT_Live2DPoseCacheMemory, PoseCacheEntry.GetAllocatedSize());
+	DEC_MEMORY_STAT_BY(STAT_Live2DPoseCacheMemory, PreviousEntrySize);
 
-	World->GetTimerManager().SetTimer(TickHandle,  FTimerDelegate::CreateUObject(this, &ULive2DMocModel::OnTick, TickRate), TickRate, true);
+	PoseCacheEntryIndices.Add(PoseKey, EntryIndex);
+	LinkPoseCacheEntry(EntryIndex);
 }
 
-void ULive2DMocModel::StopTicking()
+void ULive2DMocModel::LinkPoseCacheEntry(const int32 EntryIndex)
 {
-	UWorld* World =
-#if WITH_EDITOR
-	GWorld;
-#else
-	GetWorld();
-#endif
+	FPoseCacheEntry& Entry = PoseCacheEntries[EntryIndex];
+	Entry.LessRecent = MostRecentPoseCacheEntry;
+	Entry.MoreRecent = INDEX_NONE;
 
-	World = GWorld;
-	
-	World->GetTimerManager().ClearTimer(TickHandle);
+	if (MostRecentPoseCacheEntry != INDEX_NONE)
+	{
+		PoseCacheEntries[MostRecentPoseCacheEntry].MoreRecent = EntryIndex;
+	}
+	MostRecentPoseCacheEntry = EntryIndex;
+
+	if (LeastRecentPoseCacheEntry == INDEX_NONE)
+	{
+		LeastRecentPoseCacheEntry = EntryIndex;
+	}
+}
+
+void ULive2DMocModel::UnlinkPoseCacheEntry(const int32 EntryIndex)
+{
+	FPoseCacheEntry& Entry = PoseCacheEntries[EntryIndex];
+
+	if (Entry.LessRecent != INDEX_NONE)
+	{
+		PoseCacheEntries[Entry.LessRecent].MoreRecent = Entry.MoreRecent;
+	}
+	else
+	{
+		LeastRecentPoseCacheEntry = Entry.MoreRecent;
+	}
+
+	if (Entry.MoreRecent != INDEX_NONE)
+	{
+		PoseCacheEntries[Entry.MoreRecent].LessRecent = Entry.LessRecent;
+	}
+	else
+	{
+		MostRecentPoseCacheEntry = Entry.LessRecent;
+	}
+
+	Entry.LessRecent = INDEX_NONE;
+	Entry.MoreRecent = INDEX_NONE;
+}
+
+void ULive2DMocModel::ResetPoseCache()
+{
+	DEC_MEMORY_STAT_BY(STAT_Live2DPoseCacheMemory, PoseCacheSize);
+	PoseCacheEntries.Empty();
+	PoseCacheEntryIndices.Empty();
+	FreePoseCacheEntries.Empty();
+	MostRecentPoseCacheEntry = INDEX_NONE;
+	LeastRecentPoseCacheEntry = INDEX_NONE;
+	PoseCacheSize = 0;
+	CurrentPose.Empty();
+	ScratchPose.Empty();
+}
+
+float ULive2DMocModel::GetParameterValue(const FString& ParameterName)
+{
+	// Read from the core, which also holds the values physics writes by index
+	const int32 ParameterIndex = GetParameterIndex(ParameterName);
+
+	if (ParameterIndex == INDEX_NONE)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
+		return 0.f;
+	}
+
+	return GetParameterValueData()[ParameterIndex];
+}
+
+float ULive2DMocModel::GetMinimumParameterValue(const FString& ParameterName)
+{
+	auto* MinimumParameterValue = ParameterMinimumValues.Find(ParameterName);
+
+	if (!MinimumParameterValue)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetMinimumParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
+		return 0.f;
+	}
+
+	return *MinimumParameterValue;
+}
+
+float ULive2DMocModel::GetMaximumParameterValue(const FString& ParameterName)
+{
+	auto* MaximumParameterValue = ParameterMaximumValues.Find(ParameterName);
+
+	if (!MaximumParameterValue)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetMaximumParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
+		return 0.f;
+	}
+
+	return *MaximumParameterValue;
+}
+
+float ULive2DMocModel::GetDefaultParameterValue(const FString& ParameterName)
+{
+	auto* DefaultParameterValue = ParameterDefaultValues.Find(ParameterName);
+
+	if (!DefaultParameterValue)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetDefaultParameterValue: Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
+		return 0.f;
+	}
+
+	return *DefaultParameterValue;
+}
+
+void ULive2DMocModel::SetParameterValue(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
+{
+	if (const TArray<FString>* AffectedIds = FindAffectedParameterIds(ParameterName, TEXT("Parameter")))
+	{
+		for (const auto& AffectedId: *AffectedIds)
+		{
+			SetParameterValueInternal(AffectedId, Value, bUpdateDrawables);
+		}
+		return;
+	}
+	
+	SetParameterValueInternal(ParameterName, Value, bUpdateDrawables);
+}
+
+int32 ULive2DMocModel::GetParameterCount() const
+{
+	return csmGetParameterCount(Model);
+}
+
+int32 ULive2DMocModel::GetParameterIndex(const FString& ParameterId) const
+{
+	return ParameterIndices.FindRef(ParameterId, INDEX_NONE);
+}
+
+FString ULive2DMocModel::GetParameterId(const int32 ParameterIndex) const
+{
+	return csmGetParameterIds(Model)[ParameterIndex];
+}
+
+TArray<int32> ULive2DMocModel::FindParameterIndices(const FString& ParameterName) const
+{
+	TArray<int32> Indices;
+	if (const TArray<FString>* AffectedIds = FindAffectedParameterIds(ParameterName, TEXT("Parameter")))
+	{
+		for (const auto& AffectedId: *AffectedIds)
+		{
+			const int32 ParameterIndex = GetParameterIndex(AffectedId);
+			if (ParameterIndex != INDEX_NONE)
+			{
+				Indices.Add(ParameterIndex);
+			}
+		}
+		return Indices;
+	}
+
+	const int32 ParameterIndex = GetParameterIndex(ParameterName);
+	if (ParameterIndex != INDEX_NONE)
+	{
+		Indices.Add(ParameterIndex);
+	}
+	return Indices;
+}
+
+float ULive2DMocModel::CalcParameterInfluence(TConstArrayView<int32> ParameterIndices)
+{
+	float* ModelParameterValues = csmGetParameterValues(Model);
+	const float* ParameterMinimumValues = csmGetParameterMinimumValues(Model);
+	const float* ParameterMaximumValues = csmGetParameterMaximumValues(Model);
+	TArray<float> SavedValues;
+	SavedValues.Append(ModelParameterValues, csmGetParameterCount(Model));
+
+	for (const int32 ParameterIndex: ParameterIndices)
+	{
+		ModelParameterValues[ParameterIndex] = ParameterMinimumValues[ParameterIndex];
+	}
+	FLive2DModelDrawableOutputs MinimumOutputs;
+	EvaluateDrawableOutputs(MinimumOutputs);
+
+	for (const int32 ParameterIndex: ParameterIndices)
+	{
+		ModelParameterValues[ParameterIndex] = ParameterMaximumValues[ParameterIndex];
+	}
+	csmUpdateModel(Model);
+
+	const int32 DrawableCount = csmGetDrawableCount(Model);
+	const int* VertexCounts = csmGetDrawableVertexCounts(Model);
+	const csmVector2** VertexPositions = csmGetDrawableVertexPositions(Model);
+	const float* Opacities = csmGetDrawableOpacities(Model);
+	float Influence = 0.f;
+	int32 VertexOffset = 0;
+	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < DrawableCount; ModelDrawableIndex++)
+	{
+		const float Opacity = MinimumOutputs.Visibilities[ModelDrawableIndex] ? FMath::Max(MinimumOutputs.Opacities[ModelDrawableIndex], Opacities[ModelDrawableIndex]) : 0.f;
+		for (int32 VertexIndex = 0; VertexIndex < VertexCounts[ModelDrawableIndex]; VertexIndex++)
+		{
+			const FVector2f MaximumPosition(VertexPositions[ModelDrawableIndex][VertexIndex].X, VertexPositions[ModelDrawableIndex][VertexIndex].Y);
+			Influence += Opacity * FVector2f::Distance(MinimumOutputs.VertexPositions[VertexOffset + VertexIndex], MaximumPosition);
+		}
+		VertexOffset += VertexCounts[ModelDrawableIndex];
+	}
+
+	FMemory::Memcpy(ModelParameterValues, SavedValues.GetData(), SavedValues.Num() * sizeof(float));
+	return Influence;
+}
+
+float* ULive2DMocModel::GetParameterValueData() const
+{
+	return csmGetParameterValues(Model);
+}
+
+const float* ULive2DMocModel::GetParameterMinimumValueData() const
+{
+	return csmGetParameterMinimumValues(Model);
+}
+
+const float* ULive2DMocModel::GetParameterMaximumValueData() const
+{
+	return csmGetParameterMaximumValues(Model);
+}
+
+const float* ULive2DMocModel::GetParameterDefaultValueData() const
+{
+	return csmGetParameterDefaultValues(Model);
+}
+
+void ULive2DMocModel::ResetParametersToDefault()
+{
+	const int32 ModelParameterCount = csmGetParameterCount(Model);
+	const char** ModelParameterIds = csmGetParameterIds(Model);
+	float* ModelParameterValues = csmGetParameterValues(Model);
+	const float* ModelParameterDefaultValues = csmGetParameterDefaultValues(Model);
+
+	for(int32 ParameterIndex = 0; ParameterIndex < ModelParameterCount; ParameterIndex++)
+	{
+		const FString ParameterId = ModelParameterIds[ParameterIndex];
+		ParameterValues.Add(ParameterId, ModelParameterDefaultValues[ParameterIndex]);
+		ModelParameterValues[ParameterIndex] = ModelParameterDefaultValues[ParameterIndex];
+	}
+}
+
+float ULive2DMocModel::GetPartOpacityValue(const FString& ParameterName)
+{
+	auto* PartOpacity = PartOpacities.Find(ParameterName);
+
+	if (!PartOpacity)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::GetPartOpacityValue: Part Opacity Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
+		return 0.f;
+	}
+
+	return *PartOpacity;
+}
+
+void ULive2DMocModel::SetPartOpacityValue(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
+{
+	if (const TArray<FString>* AffectedIds = FindAffectedParameterIds(ParameterName, TEXT("PartOpacity")))
+	{
+		for (const auto& AffectedId: *AffectedIds)
+		{
+			SetPartOpacityValueInternal(AffectedId, Value, bUpdateDrawables);
+		}
+		return;
+	}
+	
+	SetPartOpacityValueInternal(ParameterName, Value, bUpdateDrawables);
+}
+
+FSlateBrush& ULive2DMocModel::GetImageBrush()
+{
+	if (!RenderTarget2D)
+	{
+		SetupRenderTarget();
+		UpdateRenderTarget();
+	}
+	
+	return RenderTargetBrush; 
+}
+
+void ULive2DMocModel::StartTicking(const float TickRate)
+{
+	UWorld* World =
+#if WITH_EDITOR
+	GWorld;
+#else
+	GetWorld();
+#endif
+
+	World = GWorld;
+
+	World->GetTimerManager().SetTimer(TickHandle,  FTimerDelegate::CreateUObject(this, &ULive2DMocModel::OnTick, TickRate), TickRate, true);
+}
+
+void ULive2DMocModel::StopTicking()
+{
+	UWorld* World =
+#if WITH_EDITOR
+	GWorld;
+#else
+	GetWorld();
+#endif
+
+	World = GWorld;
+	
+	World->GetTimerManager().ClearTimer(TickHandle);
 }
 
 void ULive2DMocModel::OnTick(const float DeltaTime)
 {
+	bDrawableOutputsSet = false;
 	OnModelTick.Broadcast(DeltaTime);
 
+	// A listener already provided the drawables of this tick, e.g. from a baked vertex stream
+	if (bDrawableOutputsSet)
+	{
+		return;
+	}
+
+	// Physics of all ticking models is evaluated together later in the frame, which then finishes this tick
+	if (Physics->HasRigs() && GEngine && GEngine->GetEngineSubsystem<ULive2DPhysicsScheduler>()->Schedule(this, DeltaTime))
+	{
+		return;
+	}
+
 	Physics->Evaluate(DeltaTime);
 	
 	UpdateDrawables();
 }
 
+void ULive2DMocModel::FinishTick()
+{
+	UpdateDrawables();
+}
+
 FLive2DModelCanvasInfo ULive2DMocModel::GetModelCanvasInfoInternal() const
 {
 	FLive2DModelCanvasInfo CanvasInfo;
@@ -362,19 +1182,17 @@ FLive2DModelCanvasInfo ULive2DMocModel::GetModelCanvasInfoInternal() const
 	return CanvasInfo;
 }
 
-bool ULive2DMocModel::GetAffectedParameterIdsByGroupName(const FString& GroupName, const FString& TargetName, TArray<FString>& AffectedIds )
+const TArray<FString>* ULive2DMocModel::FindAffectedParameterIds(const FString& GroupName, const TCHAR* TargetName) const
 {
-	AffectedIds.Empty();
 	for (const auto& Group: Groups)
 	{
 		if (Group.Name == GroupName && Group.Target == TargetName)
 		{
-			AffectedIds = Group.Ids;
-			return true;
+			return &Group.Ids;
 		}
 	}
 
-	return false;
+	return nullptr;
 }
 
 void ULive2DMocModel::SetParameterValueInternal(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
@@ -388,20 +1206,10 @@ void ULive2DMocModel::SetParameterValueInternal(const FString& ParameterName, co
 	}
 
 	
-	auto* parameterIds = csmGetParameterIds(Model);
 	auto* parameterValues = csmGetParameterValues(Model);
-	// Scan array position corresponding to target ID
-	int32 targetIndex = -1;
-	for(int32 i = 0; i < ParameterValues.Num() ;++i)
-	{
-		if( ParameterName.Compare(parameterIds[i]) == 0 )
-		{
-			targetIndex = i;
-			break;
-		}
-	}
+	const int32 targetIndex = ParameterIndices.FindRef(ParameterName, INDEX_NONE);
 	//In case that the desired ID could n't be found ID
-	if(targetIndex == -1 )
+	if(targetIndex == INDEX_NONE)
 	{
 		return;
 	}
@@ -424,78 +1232,469 @@ void ULive2DMocModel::SetParameterValueInternal(const FString& ParameterName, co
 		parameterValues[targetIndex] = Value;
 		*ParameterValue = Value;
 	}
-	
-	if (bUpdateDrawables)
+	
+	if (bUpdateDrawables)
+	{
+		UpdateDrawables();
+	}
+}
+
+void ULive2DMocModel::SetPartOpacityValueInternal(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
+{
+	auto* PartOpacity = PartOpacities.Find(ParameterName);
+
+	if (!PartOpacity)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::SetPartOpacityValue: Part Opacity Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
+		return;
+	}
+
+	
+	float* ModelPartOpacities = csmGetPartOpacities(Model);
+	const int32 targetIndex = PartIndices.FindRef(ParameterName, INDEX_NONE);
+	//In case that the desired ID could n't be found ID
+	if(targetIndex == INDEX_NONE)
+	{
+		return;
+	}
+	
+	//Multiply the difference from reference value by the specified magnification ratio from the parameter.
+	ModelPartOpacities[targetIndex] = Value;
+	*PartOpacity = Value;
+	
+	if (bUpdateDrawables)
+	{
+		UpdateDrawables();
+	}
+}
+
+void ULive2DMocModel::SetupRenderTarget()
+{
+	if (RenderTarget2D)
+	{
+		return;
+	}
+	
+	RenderTarget2D = NewObject<UTextureRenderTarget2D>(this);
+	check(RenderTarget2D);
+	RenderTarget2D->TargetGamma = 1.f;
+	RenderTarget2D->RenderTargetFormat = RTF_RGBA8;
+	RenderTarget2D->ClearColor = FLinearColor::Transparent;
+	RenderTarget2D->bAutoGenerateMips = false;
+	RenderTarget2D->InitAutoFormat(RenderTargetSize.X, RenderTargetSize.Y);
+	RenderTarget2D->UpdateResourceImmediate(true);
+	
+	bRenderTargetNeedsFullRedraw = true;
+	RenderTargetBrush.SetResourceObject(RenderTarget2D);
+	RenderTargetBrush.ImageSize = GetDisplaySize();
+	RenderTargetBrush.DrawAs = ESlateBrushDrawType::Image;
+	RenderTargetBrush.TintColor = FLinearColor::White;
+
+	// Avoid the pipeline state creation hitch on the first frame this model is drawn
+	FLive2DPipelineStatePrecache::Precache(GMaxRHIFeatureLevel, RenderTarget2D->GetFormat());
+}
+
+void ULive2DMocModel::UpdateRenderTarget()
+{
+	// Live2D.RenderTargetScale can change at runtime, e.g. with dynamic resolution, a resize already redraws
+	if (GetRenderTargetScale() != AppliedRenderTargetScale && UpdateRenderTargetSize())
+	{
+		return;
+	}
+
+	// Masks and static layers are drawn up front so the render target itself is drawn in a single pass
+	PrepareDrawToCanvas();
+
+	const FBox2D FullRect(FVector2D::ZeroVector, FVector2D(RenderTarget2D->SizeX, RenderTarget2D->SizeY));
+	const FBox2D DirtyRect = CalcDirtyRect(FullRect);
+	if (!DirtyRect.bIsValid)
+	{
+		return;
+	}
+
+	const bool bIsFullRedraw = DirtyRect.Min == FullRect.Min && DirtyRect.Max == FullRect.Max;
+
+	UWorld* World =
+#if WITH_EDITOR
+	GWorld;
+#else
+	GetWorld();
+#endif
+
+	World = GWorld;
+	UCanvas* Canvas;
+
+	FDrawToRenderTargetContext Context;
+	if (bIsFullRedraw)
+	{
+		UKismetRenderingLibrary::ClearRenderTarget2D(World, RenderTarget2D, FLinearColor::Black);
+	}
+	FVector2D Size;
+	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(World, RenderTarget2D, Canvas, Size, Context);
+	if (!bIsFullRedraw)
+	{
+		FCanvasTileItem ClearItem(DirtyRect.Min, DirtyRect.GetSize(), FLinearColor::Black);
+		ClearItem.BlendMode = SE_BLEND_Opaque;
+		Canvas->DrawItem(ClearItem);
+	}
+	DrawToCanvas(Canvas, FullRect, bIsFullRedraw ? FBox2D(ForceInit) : DirtyRect);
+	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(World, Context);
+}
+
+FBox2D ULive2DMocModel::CalcDirtyRect(const FBox2D& FullRect)
+{
+	const FLive2DModelCanvasInfo CanvasInfo = GetModelCanvasInfoInternal();
+	const bool bIsFullRedraw = bRenderTargetNeedsFullRedraw || CVarLive2DDirtyRects.GetValueOnGameThread() == 0;
+	bRenderTargetNeedsFullRedraw = false;
+
+	// Old and new bounds of every drawable that changed, or whose masks changed
+	FBox2D DirtyCanvasRect(ForceInit);
+	for (FLive2DModelDrawable& Drawable: UnSortedDrawables)
+	{
+		bool bHasChanged = bIsFullRedraw || Drawable.StaticUpdateCount == 0;
+		for (int32 MaskIndex = 0; !bHasChanged && MaskIndex < Drawable.Masks.Num(); MaskIndex++)
+		{
+			bHasChanged = UnSortedDrawables.IsValidIndex(Drawable.Masks[MaskIndex]) && UnSortedDrawables[Drawable.Masks[MaskIndex]].StaticUpdateCount == 0;
+		}
+
+		if (!bHasChanged)
+		{
+			continue;
+		}
+
+		if (Drawable.CanvasBounds.bIsValid)
+		{
+			DirtyCanvasRect += Drawable.CanvasBounds;
+		}
+
+		Drawable.CanvasBounds.Init();
+		if (!Drawable.bIsCulled)
+		{
+			FMemMark Mark(FMemStack::Get());
+			FVector2f* CanvasPositions = New<FVector2f>(FMemStack::Get(), Drawable.VertexPositions.Num());
+			TransformDrawableVertices(Drawable, CanvasInfo, FBox2D(FVector2D::ZeroVector, CanvasInfo.Size), CanvasPositions);
+			for (int32 VertexIndex = 0; VertexIndex < Drawable.VertexPositions.Num(); VertexIndex++)
+			{
+				Drawable.CanvasBounds += FVector2D(CanvasPositions[VertexIndex]);
+			}
+			DirtyCanvasRect += Drawable.CanvasBounds;
+		}
+	}
+
+	if (bIsFullRedraw)
+	{
+		return FullRect;
+	}
+
+	if (!DirtyCanvasRect.bIsValid)
+	{
+		return DirtyCanvasRect;
+	}
+
+	// Whole pixels with a margin for the bilinear footprint of the edges
+	const FVector2D CanvasToTarget = FullRect.GetSize() / CanvasInfo.Size;
+	FBox2D DirtyRect(
+		FVector2D(FMath::FloorToDouble(DirtyCanvasRect.Min.X * CanvasToTarget.X) - 1.0, FMath::FloorToDouble(DirtyCanvasRect.Min.Y * CanvasToTarget.Y) - 1.0),
+		FVector2D(FMath::CeilToDouble(DirtyCanvasRect.Max.X * CanvasToTarget.X) + 1.0, FMath::CeilToDouble(DirtyCanvasRect.Max.Y * CanvasToTarget.Y) + 1.0));
+	DirtyRect = DirtyRect.Overlap(FullRect);
+
+	if (!DirtyRect.bIsValid || DirtyRect.GetArea() <= 0.0)
+	{
+		return FBox2D(ForceInit);
+	}
+
+	if (DirtyRect.GetArea() > FullRect.GetArea() * CVarLive2DDirtyRectsMaxAreaFraction.GetValueOnGameThread())
+	{
+		return FullRect;
+	}
+
+	return DirtyRect;
+}
+
+void ULive2DMocModel::DrawToCanvas(UCanvas* Canvas, const FBox2D& Rect, const FBox2D& ClipRect)
+{
+	// Masked drawables locate their mask from the screen position, so their parameters depend on the rect
+	if (Rect.Min != BatchedElementViewport.Min || Rect.Max != BatchedElementViewport.Max)
+	{
+		ResetBatchedElementParameters();
+		BatchedElementViewport = Rect;
+	}
+
+	const FLive2DModelCanvasInfo CanvasInfo = GetModelCanvasInfoInternal();
+	const FVector2D CanvasToRect = Rect.GetSize() / CanvasInfo.Size;
+	int32 StaticLayerIndex = 0;
+
+	ScratchDrawQueue.Reset();
+	for (int32 RenderIndex = 0; RenderIndex < Drawables.Num(); RenderIndex++)
+	{
+		while (StaticLayers.IsValidIndex(StaticLayerIndex) && (!StaticLayers[StaticLayerIndex].bIsBaked || StaticLayers[StaticLayerIndex].FirstRenderIndex < RenderIndex))
+		{
+			StaticLayerIndex++;
+		}
+
+		if (StaticLayers.IsValidIndex(StaticLayerIndex) && StaticLayers[StaticLayerIndex].FirstRenderIndex == RenderIndex)
+		{
+			ScratchDrawQueue.Add({ nullptr, StaticLayerIndex });
+			RenderIndex += StaticLayers[StaticLayerIndex].DrawableCount - 1;
+			continue;
+		}
+
+		const FLive2DModelDrawable* Drawable = Drawables[RenderIndex];
+		if (Drawable->bIsCulled)
+		{
+			continue;
+		}
+
+		if (ClipRect.bIsValid)
+		{
+			const FBox2D DrawableRect(Rect.Min + Drawable->CanvasBounds.Min * CanvasToRect, Rect.Min + Drawable->CanvasBounds.Max * CanvasToRect);
+			if (!Drawable->CanvasBounds.bIsValid || !ClipRect.Intersect(DrawableRect))
+			{
+				continue;
+			}
+		}
+
+		ScratchDrawQueue.Add({ Drawable, INDEX_NONE });
+	}
+
+	DrawQueue(Canvas, CanvasInfo, Rect, ClipRect, false);
+}
+
+void ULive2DMocModel::DrawQueue(UCanvas* Canvas, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport, const FBox2D& ClipRect, const bool bIntoStaticLayer)
+{
+	if (ScratchTriangleSlots.Num() < ScratchDrawQueue.Num())
+	{
+		ScratchTriangleSlots.SetNum(ScratchDrawQueue.Num());
+	}
+
+	// Assembling a drawable only reads its own outputs and writes its own slot, so the drawables are assembled in parallel
+	const bool bIsParallel = CVarLive2DParallelAssembly.GetValueOnGameThread() != 0 && ScratchDrawQueue.Num() >= CVarLive2DParallelAssemblyMinDrawables.GetValueOnGameThread();
+	ParallelFor(ScratchDrawQueue.Num(), [this, &CanvasInfo, &Viewport, &ClipRect](const int32 QueueIndex)
+	{
+		TArray<FCanvasUVTri>& Triangles = ScratchTriangleSlots[QueueIndex];
+		Triangles.Reset();
+		if (const FLive2DModelDrawable* Drawable = ScratchDrawQueue[QueueIndex].Drawable)
+		{
+			AddDrawableTriangles(*Drawable, CanvasInfo, Viewport, ClipRect, Triangles);
+		}
+	}, bIsParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+
+	// Submission stays serial and in render order
+	for (int32 QueueIndex = 0; QueueIndex < ScratchDrawQueue.Num(); QueueIndex++)
+	{
+		const FDrawQueueEntry& Entry = ScratchDrawQueue[QueueIndex];
+		if (!Entry.Drawable)
+		{
+			// The layer holds premultiplied color, which composites correctly over both alpha modes
+			const FStaticLayer& StaticLayer = StaticLayers[Entry.StaticLayerIndex];
+			const FBox2D TileRect = ClipRect.bIsValid ? Viewport.Overlap(ClipRect) : Viewport;
+			if (TileRect.bIsValid)
+			{
+				const FVector2D UV0 = (TileRect.Min - Viewport.Min) / Viewport.GetSize();
+				const FVector2D UV1 = (TileRect.Max - Viewport.Min) / Viewport.GetSize();
+				FCanvasTileItem TileItem(TileRect.Min, StaticLayer.RenderTarget->GetResource(), TileRect.GetSize(), UV0, UV1, FLinearColor::White);
+				TileItem.BlendMode = SE_BLEND_AlphaComposite;
+				Canvas->DrawItem(TileItem);
+			}
+			continue;
+		}
+
+		if (Entry.Drawable->IsMasked())
+		{
+			ProcessMaskedDrawable(Entry.Drawable, Canvas, ScratchTriangleSlots[QueueIndex], bIntoStaticLayer);
+		}
+		else
+		{
+			ProcessNonMaskedDrawable(Entry.Drawable, Canvas, ScratchTriangleSlots[QueueIndex], bIntoStaticLayer);
+		}
+	}
+}
+
+void ULive2DMocModel::UpdateMaskingRenderTargets()
+{
+	const FLive2DModelCanvasInfo CanvasInfo = GetModelCanvasInfoInternal();
+
+	for (const auto& Drawable: Drawables)
+	{
+		// Masks of drawables in a static layer didn't change since the layer was baked
+		if (Drawable->bIsCulled || !Drawable->IsMasked() || Drawable->bIsInStaticLayer)
+		{
+			continue;
+		}
+
+		if (UTextureRenderTarget2D* RenderTarget = GetMaskingRenderTarget(*Drawable))
+		{
+			DrawMaskingRenderTarget(Drawable, RenderTarget, CanvasInfo);
+		}
+	}
+}
+
+void ULive2DMocModel::PrepareDrawToCanvas()
+{
+	UpdateStaticLayers();
+	UpdateMaskingRenderTargets();
+
+	const FLive2DModelCanvasInfo CanvasInfo = GetModelCanvasInfoInternal();
+	for (FStaticLayer& StaticLayer: StaticLayers)
+	{
+		if (!StaticLayer.bIsBaked)
+		{
+			BakeStaticLayer(StaticLayer, CanvasInfo);
+		}
+	}
+}
+
+bool ULive2DMocModel::IsStaticLayerCandidate(const FLive2DModelDrawable& Drawable, const int32 SettleUpdates) const
+{
+	// Multiplying can't be baked over transparency, it depends on what is below the layer
+	if (Drawable.StaticUpdateCount < SettleUpdates || Drawable.BlendMode == ELive2dModelBlendMode::MULTIPLICATIVE_BLENDING)
+	{
+		return false;
+	}
+
+	for (const int32 MaskIndex: Drawable.Masks)
+	{
+		if (UnSortedDrawables.IsValidIndex(MaskIndex) && UnSortedDrawables[MaskIndex].StaticUpdateCount < SettleUpdates)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ULive2DMocModel::UpdateStaticLayers()
+{
+	const int32 MaxLayers = CVarLive2DStaticLayersMaxLayers.GetValueOnGameThread();
+	const int32 SettleUpdates = FMath::Max(1, CVarLive2DStaticLayersSettleUpdates.GetValueOnGameThread());
+	const int32 MinDrawables = FMath::Max(1, CVarLive2DStaticLayersMinDrawables.GetValueOnGameThread());
+
+	for (FLive2DModelDrawable& Drawable: UnSortedDrawables)
+	{
+		Drawable.bIsInStaticLayer = false;
+	}
+
+	// Collect the ranges of static drawables in render order, with the number of drawables they save per draw
+	FMemMark Mark(FMemStack::Get());
+	TArray<TPair<FStaticLayer, int32>, TMemStackAllocator<>> Ranges;
+	int32 RangeStart = INDEX_NONE;
+	int32 VisibleCount = 0;
+
+	for (int32 RenderIndex = 0; MaxLayers > 0 && RenderIndex <= Drawables.Num(); RenderIndex++)
+	{
+		if (RenderIndex < Drawables.Num() && IsStaticLayerCandidate(*Drawables[RenderIndex], SettleUpdates))
+		{
+			if (RangeStart == INDEX_NONE)
+			{
+				RangeStart = RenderIndex;
+				VisibleCount = 0;
+			}
+			VisibleCount += Drawables[RenderIndex]->bIsCulled ? 0 : 1;
+			continue;
+		}
+
+		if (RangeStart != INDEX_NONE && VisibleCount >= MinDrawables)
+		{
+			FStaticLayer Range;
+			Range.FirstRenderIndex = RangeStart;
+			Range.DrawableCount = RenderIndex - RangeStart;
+			Range.FirstDrawable = Drawables[RangeStart];
+			Ranges.Emplace(Range, VisibleCount);
+		}
+		RangeStart = INDEX_NONE;
+	}
+
+	Ranges.Sort([](const TPair<FStaticLayer, int32>& l, const TPair<FStaticLayer, int32>& r)
 	{
-		UpdateDrawables();
+		return l.Value > r.Value;
+	});
+	if (Ranges.Num() > MaxLayers)
+	{
+		Ranges.SetNum(FMath::Max(MaxLayers, 0));
 	}
-}
-
-void ULive2DMocModel::SetPartOpacityValueInternal(const FString& ParameterName, const float Value, const bool bUpdateDrawables)
-{
-	auto* PartOpacity = PartOpacities.Find(ParameterName);
 
-	if (!PartOpacity)
+	// Layers covering the same range as before keep their baked render target
+	TArray<FStaticLayer, TMemStackAllocator<>> NewStaticLayers;
+	for (const auto& Range: Ranges)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::SetPartOpacityValue: Part Opacity Parameter %s doesn't exist on Live 2D Model!"), *ParameterName);
-		return;
+		FStaticLayer& NewStaticLayer = NewStaticLayers.Add_GetRef(Range.Key);
+
+		for (FStaticLayer& StaticLayer: StaticLayers)
+		{
+			if (StaticLayer.bIsBaked && StaticLayer.FirstRenderIndex == NewStaticLayer.FirstRenderIndex && StaticLayer.DrawableCount == NewStaticLayer.DrawableCount && StaticLayer.FirstDrawable == NewStaticLayer.FirstDrawable)
+			{
+				NewStaticLayer.RenderTarget = StaticLayer.RenderTarget;
+				NewStaticLayer.bIsBaked = true;
+				StaticLayer.RenderTarget = nullptr;
+				break;
+			}
+		}
 	}
 
-	
-	const char** ModelPartIds = csmGetPartIds(Model);
-	float* ModelPartOpacities = csmGetPartOpacities(Model);
-	// Scan array position corresponding to target ID
-	int32 targetIndex = -1;
-	for(int32 i = 0; i < ParameterValues.Num() ;++i)
+	// Render targets of layers that went away are reused by the new ones
+	TArray<UTextureRenderTarget2D*, TInlineAllocator<4>> FreeRenderTargets;
+	for (UTextureRenderTarget2D* RenderTarget: StaticLayerRenderTargets)
 	{
-		if( ParameterName.Compare(ModelPartIds[i]) == 0 )
+		const bool bIsUsed = NewStaticLayers.ContainsByPredicate([RenderTarget](const FStaticLayer& StaticLayer)
 		{
-			targetIndex = i;
-			break;
+			return StaticLayer.RenderTarget == RenderTarget;
+		});
+		if (!bIsUsed)
+		{
+			FreeRenderTargets.Add(RenderTarget);
 		}
 	}
-	//In case that the desired ID could n't be found ID
-	if(targetIndex == -1 )
+
+	for (FStaticLayer& StaticLayer: NewStaticLayers)
 	{
-		return;
+		if (!StaticLayer.RenderTarget)
+		{
+			StaticLayer.RenderTarget = FreeRenderTargets.Num() > 0 ? FreeRenderTargets.Pop(false) : CreateStaticLayerRenderTarget();
+		}
+
+		for (int32 RenderIndex = StaticLayer.FirstRenderIndex; StaticLayer.bIsBaked && RenderIndex < StaticLayer.FirstRenderIndex + StaticLayer.DrawableCount; RenderIndex++)
+		{
+			Drawables[RenderIndex]->bIsInStaticLayer = true;
+		}
 	}
-	
-	//Multiply the difference from reference value by the specified magnification ratio from the parameter.
-	ModelPartOpacities[targetIndex] = Value;
-	*PartOpacity = Value;
-	
-	if (bUpdateDrawables)
+
+	// Keep at most one spare render target around for layers that come and go
+	for (int32 FreeIndex = 1; FreeIndex < FreeRenderTargets.Num(); FreeIndex++)
 	{
-		UpdateDrawables();
+		StaticLayerRenderTargets.Remove(FreeRenderTargets[FreeIndex]);
 	}
+
+	NewStaticLayers.Sort([](const FStaticLayer& l, const FStaticLayer& r)
+	{
+		return l.FirstRenderIndex < r.FirstRenderIndex;
+	});
+	StaticLayers.Reset();
+	StaticLayers.Append(NewStaticLayers);
 }
 
-void ULive2DMocModel::SetupRenderTarget()
+UTextureRenderTarget2D* ULive2DMocModel::CreateStaticLayerRenderTarget()
 {
-	if (RenderTarget2D)
-	{
-		return;
-	}
-	
-	const FVector2D ModelSize = GetModelSize();
-	RenderTarget2D = NewObject<UTextureRenderTarget2D>(this);
-	check(RenderTarget2D);
-	RenderTarget2D->TargetGamma = 1.f;
-	RenderTarget2D->RenderTargetFormat = RTF_RGBA8;
-	RenderTarget2D->ClearColor = FLinearColor::Transparent;
-	RenderTarget2D->bAutoGenerateMips = false;
-	RenderTarget2D->InitAutoFormat(ModelSize.X, ModelSize.Y);
-	RenderTarget2D->UpdateResourceImmediate(true);
-	
-	RenderTargetBrush.SetResourceObject(RenderTarget2D);
-	RenderTargetBrush.ImageSize = ModelSize;
-	RenderTargetBrush.DrawAs = ESlateBrushDrawType::Image;
-	RenderTargetBrush.TintColor = FLinearColor::White;
+	auto* RenderTarget = NewObject<UTextureRenderTarget2D>(this);
+	check(RenderTarget);
+	RenderTarget->TargetGamma = 1.f;
+	RenderTarget->RenderTargetFormat = RTF_RGBA8;
+	RenderTarget->ClearColor = FLinearColor::Transparent;
+	RenderTarget->bAutoGenerateMips = false;
+	RenderTarget->InitAutoFormat(RenderTargetSize.X, RenderTargetSize.Y);
+	RenderTarget->UpdateResourceImmediate(true);
+
+	StaticLayerRenderTargets.Add(RenderTarget);
+	return RenderTarget;
 }
 
-void ULive2DMocModel::UpdateRenderTarget()
+void ULive2DMocModel::BakeStaticLayer(FStaticLayer& StaticLayer, const FLive2DModelCanvasInfo& CanvasInfo)
 {
-	auto CanvasInfo = GetModelCanvasInfoInternal();
+	UTextureRenderTarget2D* RenderTarget = StaticLayer.RenderTarget;
+	if (RenderTarget->SizeX != RenderTargetSize.X || RenderTarget->SizeY != RenderTargetSize.Y)
+	{
+		RenderTarget->ResizeTarget(RenderTargetSize.X, RenderTargetSize.Y);
+	}
+
 	UWorld* World =
 #if WITH_EDITOR
 	GWorld;
@@ -505,50 +1704,112 @@ void ULive2DMocModel::UpdateRenderTarget()
 
 	World = GWorld;
 	UCanvas* Canvas;
-
-	FDrawToRenderTargetContext Context;
-	UKismetRenderingLibrary::ClearRenderTarget2D(World, RenderTarget2D, FLinearColor::Black);
 	FVector2D Size;
-	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(World, RenderTarget2D, Canvas, Size, Context);
+	FDrawToRenderTargetContext Context;
+	UKismetRenderingLibrary::ClearRenderTarget2D(World, RenderTarget, FLinearColor::Transparent);
+	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(World, RenderTarget, Canvas, Size, Context);
 
-	for (const auto& Drawable: Drawables)
+	const FBox2D Viewport(FVector2D::ZeroVector, Size);
+	ScratchDrawQueue.Reset();
+	for (int32 RenderIndex = StaticLayer.FirstRenderIndex; RenderIndex < StaticLayer.FirstRenderIndex + StaticLayer.DrawableCount; RenderIndex++)
 	{
-		if (!Drawable->IsVisible())
+		FLive2DModelDrawable* Drawable = Drawables[RenderIndex];
+		Drawable->bIsInStaticLayer = true;
+
+		if (!Drawable->bIsCulled)
 		{
-			continue;
+			ScratchDrawQueue.Add({ Drawable, INDEX_NONE });
 		}
+	}
+	DrawQueue(Canvas, CanvasInfo, Viewport, FBox2D(ForceInit), true);
 
-		// if (!Drawable->IsMasked())
-		// {
-		// 	continue;
-		// }
+	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(World, Context);
+	StaticLayer.bIsBaked = true;
+}
 
-		if (Drawable->IsMasked())
-		{
-			ProcessMaskedDrawable(Drawable, Canvas, CanvasInfo, Context);
-		}
-		else
-		{
-			ProcessNonMaskedDrawable(Drawable, Canvas, CanvasInfo);
-		}
-	}	
+void ULive2DMocModel::InvalidateStaticLayers()
+{
+	// Also everything drawn from the same state as the layers
+	bRenderTargetNeedsFullRedraw = true;
+
+	for (FStaticLayer& StaticLayer: StaticLayers)
+	{
+		StaticLayer.bIsBaked = false;
+	}
+	for (auto& Parameters: StaticLayerBatchedElementParameters)
+	{
+		Parameters.SafeRelease();
+	}
 }
 
-void ULive2DMocModel::ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas*& Canvas, const FLive2DModelCanvasInfo& CanvasInfo, FDrawToRenderTargetContext& Context)
+UTextureRenderTarget2D* ULive2DMocModel::GetMaskingRenderTarget(const FLive2DModelDrawable& Drawable) const
+{
+	UTextureRenderTarget2D* const* RenderTarget = MaskingRenderTargets.Find(Drawable.ID);
+	return RenderTarget ? *RenderTarget : nullptr;
+}
+
+void ULive2DMocModel::ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas* Canvas, TArray<FCanvasUVTri>& Triangles, const bool bIntoStaticLayer)
 {
 	if (!Drawable->IsMasked())
 	{
 		return;
 	}
 
-	auto* RenderTarget = MaskingRenderTargets[Drawable->ID];
+	if (!MaskingRenderTargets.FindRef(Drawable->ID))
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::ProcessMaskedDrawable: Masking Render Target for Drawable Id %s doesn't exist!"), *Drawable->ID.ToString());
+		return;
+	}
 
-	if (!RenderTarget)
+	if (Triangles.Num() == 0)
 	{
-		UE_LOG(LogLive2D, Error, TEXT("ULive2DMocModel::ProcessMaskedDrawable: Masking Render Target for Drawable Id %s doesn't exist!"), *Drawable->ID);
 		return;
 	}
+
+	// The item takes the assembled triangles without a copy and leaves its previous list in the slot
+	FCanvasTriangleItem& TriangleItem = GetScratchTriangleItem(Textures[Drawable->TextureIndex]->GetResource());
+	Swap(TriangleItem.TriangleList, Triangles);
+	
+	switch (Drawable->BlendMode)
+	{
+	case ELive2dModelBlendMode::ADDITIVE_BLENDING:
+		TriangleItem.BlendMode = SE_BLEND_Additive;
+		break;
+	case ELive2dModelBlendMode::MULTIPLICATIVE_BLENDING:
+		TriangleItem.BlendMode = SE_BLEND_Modulate;
+		break;
+	case ELive2dModelBlendMode::NORMAL_BLENDING:
+	default:
+		TriangleItem.BlendMode = SE_BLEND_Masked;
+		break;
+	}
+	TriangleItem.StereoDepth = Drawable->DrawOrder;
+	TriangleItem.BatchedElementParameters = GetDrawableBatchedElementParameters(Drawable, TriangleItem.BlendMode, bIntoStaticLayer);
+	
+	Canvas->DrawItem(TriangleItem);
 	
+	// FCanvasTileItem TileItem(FVector2D::ZeroVector, RenderTarget->GetResource(), FLinearColor::White);
+	//
+	// switch (Drawable->BlendMode)
+	// {
+	// case ELive2dModelBlendMode::ADDITIVE_BLENDING:
+	// 	TileItem.BlendMode = SE_BLEND_Additive;
+	// 	break;
+	// case ELive2dModelBlendMode::MULTIPLICATIVE_BLENDING:
+	// 	TileItem.BlendMode = SE_BLEND_Modulate;
+	// 	break;
+	// case ELive2dModelBlendMode::NORMAL_BLENDING:
+	// default:
+	// 	TileItem.BlendMode = SE_BLEND_Masked;
+	// 	break;
+	// }
+	//
+	// TileItem.StereoDepth = Drawable->DrawOrder;
+	// Canvas->DrawItem(TileItem);
+}
+
+void ULive2DMocModel::DrawMaskingRenderTarget(const FLive2DModelDrawable* Drawable, UTextureRenderTarget2D* RenderTarget, const FLive2DModelCanvasInfo& CanvasInfo)
+{
 	UWorld* World =
 #if WITH_EDITOR
 	GWorld;
@@ -561,8 +1822,8 @@ void ULive2DMocModel::ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable
 	UCanvas* MaskingCanvas;
 	FVector2D Size;
 	FDrawToRenderTargetContext MaskingContext;
-	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(World, Context);
 	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(World, RenderTarget, MaskingCanvas,Size, MaskingContext);
+	const FBox2D MaskViewport(FVector2D::ZeroVector, Size);
 
 	uint32 Result = static_cast<uint32>(SE_BLEND_RGBA_MASK_START);
 	Result += Drawable->Masks.Num() == 1 ? (1 << 0) : 0; // R
@@ -579,44 +1840,12 @@ void ULive2DMocModel::ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable
 		}
 		
 		const auto& MaskDrawable = UnSortedDrawables[MaskIndex];
-		TArray<FCanvasUVTri> TriangleList;
-
-		for (int32 i = 0; i < MaskDrawable.VertexIndices.Num(); i += 3)
-		{
-			const int32 VertexIndex0 = MaskDrawable.VertexIndices[i];
-			const int32 VertexIndex1 = MaskDrawable.VertexIndices[i+1];
-			const int32 VertexIndex2 = MaskDrawable.VertexIndices[i+2];
-			
-			FCanvasUVTri Triangle;
-			Triangle.V0_Pos = ProcessVertex(MaskDrawable.VertexPositions[VertexIndex0], CanvasInfo);
-			Triangle.V1_Pos = ProcessVertex(MaskDrawable.VertexPositions[VertexIndex1], CanvasInfo);
-			Triangle.V2_Pos = ProcessVertex(MaskDrawable.VertexPositions[VertexIndex2], CanvasInfo);
-			Triangle.V0_UV = MaskDrawable.VertexUVs[VertexIndex0];
-			Triangle.V0_UV.Y = 1 - Triangle.V0_UV.Y;
-			Triangle.V1_UV = MaskDrawable.VertexUVs[VertexIndex1];
-			Triangle.V1_UV.Y = 1 - Triangle.V1_UV.Y;
-			Triangle.V2_UV = MaskDrawable.VertexUVs[VertexIndex2];
-			Triangle.V2_UV.Y = 1 - Triangle.V2_UV.Y;
-			Triangle.V0_Color = FLinearColor::White;
-			Triangle.V1_Color = FLinearColor::White;
-			Triangle.V2_Color = FLinearColor::White;
-
-			TriangleList.Add(Triangle);
-		}
-		
-		FCanvasTriangleItem TriangleItem(TriangleList, Textures[MaskDrawable.TextureIndex]->GetResource());
+		FCanvasTriangleItem& TriangleItem = GetScratchTriangleItem(Textures[MaskDrawable.TextureIndex]->GetResource());
+		AddDrawableTriangles(MaskDrawable, CanvasInfo, MaskViewport, FBox2D(ForceInit), TriangleItem.TriangleList);
 		
 		TriangleItem.BlendMode = SE_BLEND_Masked;
 		//TriangleItem.StereoDepth = MaskDrawable.DrawOrder;
-
-		if (Drawable->bIsInvertedMask)
-		{
-			TriangleItem.BatchedElementParameters = new FLive2DInvertedMaskBatchedElements(Textures[MaskDrawable.TextureIndex], MaskDrawable.Opacity);
-		}
-		else
-		{
-			TriangleItem.BatchedElementParameters = new FLive2DMaskBatchedElements(Textures[MaskDrawable.TextureIndex], MaskDrawable.Opacity);
-		}
+		TriangleItem.BatchedElementParameters = GetMaskBatchedElementParameters(MaskDrawable, Drawable->bIsInvertedMask);
 
 		MaskingCanvas->DrawItem(TriangleItem);
 	}
@@ -657,37 +1886,18 @@ void ULive2DMocModel::ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable
 	// MaskingCanvas->DrawItem(TriangleItem);
 
 	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(World, MaskingContext);
-	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(World, RenderTarget2D, Canvas,Size, Context);
+}
 
-	TArray<FCanvasUVTri> TriangleList;
-	
-	for (int32 i = 0; i < Drawable->VertexIndices.Num(); i += 3)
+void ULive2DMocModel::ProcessNonMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas* Canvas, TArray<FCanvasUVTri>& Triangles, const bool bIntoStaticLayer)
+{
+	if (Triangles.Num() == 0)
 	{
-		const int32 VertexIndex0 = Drawable->VertexIndices[i];
-		const int32 VertexIndex1 = Drawable->VertexIndices[i+1];
-		const int32 VertexIndex2 = Drawable->VertexIndices[i+2];
-			
-		FCanvasUVTri Triangle;
-		Triangle.V0_Pos = ProcessVertex(Drawable->VertexPositions[VertexIndex0], CanvasInfo);
-		Triangle.V1_Pos = ProcessVertex(Drawable->VertexPositions[VertexIndex1], CanvasInfo);
-		Triangle.V2_Pos = ProcessVertex(Drawable->VertexPositions[VertexIndex2], CanvasInfo);
-		Triangle.V0_UV = Drawable->VertexUVs[VertexIndex0];
-		Triangle.V0_UV.Y = 1 - Triangle.V0_UV.Y;
-		Triangle.V1_UV = Drawable->VertexUVs[VertexIndex1];
-		Triangle.V1_UV.Y = 1 - Triangle.V1_UV.Y;
-		Triangle.V2_UV = Drawable->VertexUVs[VertexIndex2];
-		Triangle.V2_UV.Y = 1 - Triangle.V2_UV.Y;
-		Triangle.V0_Color = FLinearColor::White;
-		Triangle.V0_Color.A = Drawable->Opacity;
-		Triangle.V1_Color = FLinearColor::White;
-		Triangle.V1_Color.A = Drawable->Opacity;
-		Triangle.V2_Color = FLinearColor::White;
-		Triangle.V2_Color.A = Drawable->Opacity;
-	
-		TriangleList.Add(Triangle);
+		return;
 	}
-	
-	FCanvasTriangleItem TriangleItem(TriangleList, Textures[Drawable->TextureIndex]->GetResource());
+
+	FCanvasTriangleItem& TriangleItem = GetScratchTriangleItem(Textures[Drawable->TextureIndex]->GetResource());
+	Swap(TriangleItem.TriangleList, Triangles);
+
 	switch (Drawable->BlendMode)
 	{
 	case ELive2dModelBlendMode::ADDITIVE_BLENDING:
@@ -701,95 +1911,161 @@ void ULive2DMocModel::ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable
 		TriangleItem.BlendMode = SE_BLEND_Masked;
 		break;
 	}
+
 	TriangleItem.StereoDepth = Drawable->DrawOrder;
-	TriangleItem.BatchedElementParameters = new FLive2DMaskedBatchedElements(RenderTarget, Textures[Drawable->TextureIndex], TriangleItem.BlendMode, Drawable->Opacity);
-	
+	TriangleItem.BatchedElementParameters = GetDrawableBatchedElementParameters(Drawable, TriangleItem.BlendMode, bIntoStaticLayer);
 	Canvas->DrawItem(TriangleItem);
-	
-	// FCanvasTileItem TileItem(FVector2D::ZeroVector, RenderTarget->GetResource(), FLinearColor::White);
-	//
-	// switch (Drawable->BlendMode)
-	// {
-	// case ELive2dModelBlendMode::ADDITIVE_BLENDING:
-	// 	TileItem.BlendMode = SE_BLEND_Additive;
-	// 	break;
-	// case ELive2dModelBlendMode::MULTIPLICATIVE_BLENDING:
-	// 	TileItem.BlendMode = SE_BLEND_Modulate;
-	// 	break;
-	// case ELive2dModelBlendMode::NORMAL_BLENDING:
-	// default:
-	// 	TileItem.BlendMode = SE_BLEND_Masked;
-	// 	break;
-	// }
-	//
-	// TileItem.StereoDepth = Drawable->DrawOrder;
-	// Canvas->DrawItem(TileItem);
 }
 
-void ULive2DMocModel::ProcessNonMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas* Canvas, const FLive2DModelCanvasInfo& CanvasInfo)
+
+void ULive2DMocModel::AddDrawableTriangles(const FLive2DModelDrawable& Drawable, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport, const FBox2D& ClipRect, TArray<FCanvasUVTri>& OutTriangles) const
 {
-	TArray<FCanvasUVTri> TriangleList;
+	OutTriangles.Reserve(OutTriangles.Num() + Drawable.VertexIndices.Num() / 3);
+
+	// Every vertex is transformed once, the triangles only gather them by index. The memory stack is per thread
+	FMemMark Mark(FMemStack::Get());
+	FVector2f* CanvasPositions = New<FVector2f>(FMemStack::Get(), Drawable.VertexPositions.Num());
+	TransformDrawableVertices(Drawable, CanvasInfo, Viewport, CanvasPositions);
+	const TConstArrayView<FVector2f> CanvasUVs = Drawable.CanvasVertexUVs;
+	const FLinearColor Color(1.f, 1.f, 1.f, Drawable.Opacity);
+	int32 CulledTriangleCount = 0;
 
-	for (int32 i = 0; i < Drawable->VertexIndices.Num(); i += 3)
+	for (int32 i = 0; i < Drawable.VertexIndices.Num(); i += 3)
 	{
-		const int32 VertexIndex0 = Drawable->VertexIndices[i];
-		const int32 VertexIndex1 = Drawable->VertexIndices[i+1];
-		const int32 VertexIndex2 = Drawable->VertexIndices[i+2];
-			
+		const int32 VertexIndex0 = Drawable.VertexIndices[i];
+		const int32 VertexIndex1 = Drawable.VertexIndices[i+1];
+		const int32 VertexIndex2 = Drawable.VertexIndices[i+2];
+
+		// Collapsed triangles, such as the folded away frames of a flipbook, cover no pixels
+		const FVector2f Edge0 = CanvasPositions[VertexIndex1] - CanvasPositions[VertexIndex0];
+		const FVector2f Edge1 = CanvasPositions[VertexIndex2] - CanvasPositions[VertexIndex0];
+		if (FMath::Abs(Edge0 ^ Edge1) <= KINDA_SMALL_NUMBER)
+		{
+			CulledTriangleCount++;
+			continue;
+		}
+
 		FCanvasUVTri Triangle;
-		Triangle.V0_Pos = ProcessVertex(Drawable->VertexPositions[VertexIndex0], CanvasInfo);
-		Triangle.V1_Pos = ProcessVertex(Drawable->VertexPositions[VertexIndex1], CanvasInfo);
-		Triangle.V2_Pos = ProcessVertex(Drawable->VertexPositions[VertexIndex2], CanvasInfo);
-		Triangle.V0_UV = Drawable->VertexUVs[VertexIndex0];
-		Triangle.V0_UV.Y = 1 - Triangle.V0_UV.Y;
-		Triangle.V1_UV = Drawable->VertexUVs[VertexIndex1];
-		Triangle.V1_UV.Y = 1 - Triangle.V1_UV.Y;
-		Triangle.V2_UV = Drawable->VertexUVs[VertexIndex2];
-		Triangle.V2_UV.Y = 1 - Triangle.V2_UV.Y;
-		Triangle.V0_Color = FLinearColor::White;
-		Triangle.V0_Color.A = Drawable->Opacity;
-		Triangle.V1_Color = FLinearColor::White;
-		Triangle.V1_Color.A = Drawable->Opacity;
-		Triangle.V2_Color = FLinearColor::White;
-		Triangle.V2_Color.A = Drawable->Opacity;
-
-		TriangleList.Add(Triangle);
+		Triangle.V0_Pos = FVector2D(CanvasPositions[VertexIndex0]);
+		Triangle.V1_Pos = FVector2D(CanvasPositions[VertexIndex1]);
+		Triangle.V2_Pos = FVector2D(CanvasPositions[VertexIndex2]);
+		Triangle.V0_UV = FVector2D(CanvasUVs[VertexIndex0]);
+		Triangle.V1_UV = FVector2D(CanvasUVs[VertexIndex1]);
+		Triangle.V2_UV = FVector2D(CanvasUVs[VertexIndex2]);
+		Triangle.V0_Color = Color;
+		Triangle.V1_Color = Color;
+		Triangle.V2_Color = Color;
+
+		if (ClipRect.bIsValid)
+		{
+			ClipTriangleToRect(Triangle, ClipRect, OutTriangles);
+		}
+		else
+		{
+			OutTriangles.Add(Triangle);
+		}
 	}
-		
-	FCanvasTriangleItem TriangleItem(TriangleList, Textures[Drawable->TextureIndex]->GetResource());
 
-	switch (Drawable->BlendMode)
+	INC_DWORD_STAT_BY(STAT_Live2DCulledTriangles, CulledTriangleCount);
+}
+
+void ULive2DMocModel::TransformDrawableVertices(const FLive2DModelDrawable& Drawable, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport, FVector2f* OutPositions) const
+{
+	// ProcessVertex folded into one scale and offset: canvas units to pixels, pivot, Y flip and viewport mapping
+	const FVector2D ViewportScale = Viewport.GetSize() / CanvasInfo.Size;
+	const FVector2f Scale(CanvasInfo.PixelsPerUnit * ViewportScale.X, -CanvasInfo.PixelsPerUnit * ViewportScale.Y);
+	const FVector2f Offset(
+		Viewport.Min.X + CanvasInfo.PivotOrigin.X * ViewportScale.X,
+		Viewport.Min.Y + (CanvasInfo.Size.Y - CanvasInfo.PivotOrigin.Y) * ViewportScale.Y);
+
+	TransformVertices(Drawable.VertexPositions.GetData(), OutPositions, Drawable.VertexPositions.Num(), Scale, Offset);
+}
+
+FVector2D ULive2DMocModel::ProcessVertex(const FVector2f& Vertex, const FLive2DModelCanvasInfo& CanvasInfo)
+{
+	FVector2D Position(Vertex);
+	Position *= CanvasInfo.PixelsPerUnit;
+	Position += CanvasInfo.PivotOrigin;
+	Position.Y = CanvasInfo.Size.Y - Position.Y;
+
+	return Position;
+}
+
+FVector2D ULive2DMocModel::ProcessVertex(const FVector2f& Vertex, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport)
+{
+	return Viewport.Min + ProcessVertex(Vertex, CanvasInfo) * Viewport.GetSize() / CanvasInfo.Size;
+}
+
+FBatchedElementParameters* ULive2DMocModel::GetDrawableBatchedElementParameters(const FLive2DModelDrawable* Drawable, ESimpleElementBlendMode BlendMode, const bool bIntoStaticLayer)
+{
+	const int32 DrawableIndex = Drawable - UnSortedDrawables.GetData();
+	check(DrawableBatchedElementParameters.IsValidIndex(DrawableIndex));
+
+	// Static layers are always premultiplied and cover the whole render target
+	if (bIntoStaticLayer && StaticLayerBatchedElementParameters.Num() != UnSortedDrawables.Num())
 	{
-	case ELive2dModelBlendMode::ADDITIVE_BLENDING:
-		TriangleItem.BlendMode = SE_BLEND_Additive;
-		break;
-	case ELive2dModelBlendMode::MULTIPLICATIVE_BLENDING:
-		TriangleItem.BlendMode = SE_BLEND_Modulate;
-		break;
-	case ELive2dModelBlendMode::NORMAL_BLENDING:
-	default:
-		TriangleItem.BlendMode = SE_BLEND_Masked;
-		break;
+		StaticLayerBatchedElementParameters.SetNum(UnSortedDrawables.Num());
 	}
 
-	TriangleItem.StereoDepth = Drawable->DrawOrder;
-	TriangleItem.BatchedElementParameters = new FLive2DNormalBatchedElements(Textures[Drawable->TextureIndex], TriangleItem.BlendMode, Drawable->Opacity);
-	Canvas->DrawItem(TriangleItem);
-}
+	TRefCountPtr<FBatchedElementParameters>& Parameters = bIntoStaticLayer ? StaticLayerBatchedElementParameters[DrawableIndex] : DrawableBatchedElementParameters[DrawableIndex];
+
+	if (!Parameters.IsValid())
+	{
+		UTexture2D* Texture = Textures[Drawable->TextureIndex];
+		const bool bPremultipliedAlpha = bIntoStaticLayer || bUsePremultipliedAlpha;
+		if (Drawable->IsMasked())
+		{
+			const FBox2D MaskViewport = bIntoStaticLayer ? FBox2D(FVector2D::ZeroVector, FVector2D(RenderTargetSize)) : BatchedElementViewport;
+			Parameters = new FLive2DMaskedBatchedElements(MaskingRenderTargets[Drawable->ID], Texture, BlendMode, MaskViewport, bPremultipliedAlpha);
+		}
+		else
+		{
+			Parameters = new FLive2DNormalBatchedElements(Texture, BlendMode, bPremultipliedAlpha);
+		}
+	}
 
+	return Parameters.GetReference();
+}
 
-FVector2D ULive2DMocModel::ProcessVertex(FVector2D Vertex, const FLive2DModelCanvasInfo& CanvasInfo)
+FBatchedElementParameters* ULive2DMocModel::GetMaskBatchedElementParameters(const FLive2DModelDrawable& MaskDrawable, const bool bIsInvertedMask)
 {
-	Vertex *= CanvasInfo.PixelsPerUnit;
-	Vertex += CanvasInfo.PivotOrigin;
-	Vertex.Y = CanvasInfo.Size.Y - Vertex.Y;
+	if (MaskBatchedElementParameters.Num() != Textures.Num() * 2)
+	{
+		MaskBatchedElementParameters.Reset();
+		MaskBatchedElementParameters.SetNum(Textures.Num() * 2);
+	}
 
-	return Vertex;
+	TRefCountPtr<FBatchedElementParameters>& Parameters = MaskBatchedElementParameters[MaskDrawable.TextureIndex * 2 + (bIsInvertedMask ? 1 : 0)];
+
+	if (!Parameters.IsValid())
+	{
+		UTexture2D* Texture = Textures[MaskDrawable.TextureIndex];
+		if (bIsInvertedMask)
+		{
+			Parameters = new FLive2DInvertedMaskBatchedElements(Texture);
+		}
+		else
+		{
+			Parameters = new FLive2DMaskBatchedElements(Texture);
+		}
+	}
+
+	return Parameters.GetReference();
+}
+
+void ULive2DMocModel::ResetBatchedElementParameters()
+{
+	for (auto& Parameters: DrawableBatchedElementParameters)
+	{
+		Parameters.SafeRelease();
+	}
+	MaskBatchedElementParameters.Reset();
 }
 
 bool ULive2DMocModel::InitializeMoc(uint8* Source)
 {
 	Moc = csmReviveMocInPlace(Source, MocSourceSize);
+	MocHash = FCrc::MemCrc32(MocSource, MocSourceSize);
 	return Moc != nullptr;
 }
 
@@ -820,9 +2096,11 @@ void ULive2DMocModel::InitializeParameterList()
 	const float* ModelParameterMinimumValues = csmGetParameterMinimumValues(Model);
 	const float* ModelParameterDefaultValues = csmGetParameterDefaultValues(Model);
 
+	ParameterIndices.Reset();
 	for(int32 ParameterIndex = 0; ParameterIndex < ModelParameterCount; ParameterIndex++)
 	{
 		const FString ParameterId = ModelParameterIds[ParameterIndex];
+		ParameterIndices.Add(ParameterId, ParameterIndex);
 		ParameterValues.Add(ParameterId, ModelParameterValues[ParameterIndex]);
 		ParameterDefaultValues.Add(ParameterId, ModelParameterDefaultValues[ParameterIndex]);
 		ParameterMinimumValues.Add(ParameterId, ModelParameterMinimumValues[ParameterIndex]);
@@ -836,9 +2114,11 @@ void ULive2DMocModel::InitializePartOpacities()
 	const char** ModelPartIds = csmGetPartIds(Model);
 	float* ModelPartOpacities = csmGetPartOpacities(Model);
 
+	PartIndices.Reset();
 	for(int32 PartIndex = 0; PartIndex < PartCount; PartIndex++)
 	{
 		const FString PartId = ModelPartIds[PartIndex];
+		PartIndices.Add(PartId, PartIndex);
 		PartOpacities.Add(PartId, ModelPartOpacities[PartIndex]);
 	}
 }
@@ -847,6 +2127,15 @@ void ULive2DMocModel::InitializeDrawables()
 {
 	auto DrawableCount= csmGetDrawableCount(Model);
 	UnSortedDrawables.SetNum(DrawableCount);
+	DrawableBatchedElementParameters.Reset();
+	DrawableBatchedElementParameters.SetNum(DrawableCount);
+	MaskBatchedElementParameters.Reset();
+	StaticLayerBatchedElementParameters.Reset();
+	StaticLayers.Reset();
+	ResetPoseCache();
+	bRenderTargetNeedsFullRedraw = true;
+	RenderTargetSize = CalcDesiredRenderTargetSize();
+	AppliedRenderTargetScale = GetRenderTargetScale();
 	
 	const int* TextureIndices = csmGetDrawableTextureIndices(Model);
 	const csmFlags* ConstantFlags = csmGetDrawableConstantFlags(Model);
@@ -863,6 +2152,15 @@ void ULive2DMocModel::InitializeDrawables()
 	const int* MaskCounts = csmGetDrawableMaskCounts(Model);
 	const int** Masks = csmGetDrawableMasks(Model);
 
+	int32 TotalVertexCount = 0;
+	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < DrawableCount; ModelDrawableIndex++)
+	{
+		TotalVertexCount += VertexCounts[ModelDrawableIndex];
+	}
+	VertexPositionArena.SetNumUninitialized(TotalVertexCount);
+	CanvasUVArena.SetNumUninitialized(TotalVertexCount);
+	int32 VertexOffset = 0;
+
 	for (int32 ModelDrawableIndex = 0; ModelDrawableIndex < DrawableCount; ModelDrawableIndex++)
 	{
 		FLive2DModelDrawable& Drawable = UnSortedDrawables[ModelDrawableIndex];
@@ -885,28 +2183,21 @@ void ULive2DMocModel::InitializeDrawables()
 		Drawable.bIsInvertedMask = (ConstantFlags[ModelDrawableIndex] & csmIsInvertedMask) == csmIsDoubleSided;
 
 		const int32 VertexCount = VertexCounts[ModelDrawableIndex];
-		Drawable.VertexPositions.SetNum(VertexCount);
-		Drawable.VertexUVs.SetNum(VertexCount);
-
-		for (int VertexIndex = 0; VertexIndex < VertexCount; VertexIndex++)
-		{
-			Drawable.VertexPositions[VertexIndex].X = VertexPositions[ModelDrawableIndex][VertexIndex].X;
-			Drawable.VertexPositions[VertexIndex].Y = VertexPositions[ModelDrawableIndex][VertexIndex].Y;
+		Drawable.VertexPositions = TArrayView<FVector2f>(VertexPositionArena.GetData() + VertexOffset, VertexCount);
+		FMemory::Memcpy(Drawable.VertexPositions.GetData(), VertexPositions[ModelDrawableIndex], VertexCount * sizeof(FVector2f));
 
-			Drawable.VertexUVs[VertexIndex].X = VertexUvs[ModelDrawableIndex][VertexIndex].X;
-			Drawable.VertexUVs[VertexIndex].Y = VertexUvs[ModelDrawableIndex][VertexIndex].Y;
-		}
-
-		const int32 IndexCount = IndexCounts[ModelDrawableIndex];
-		Drawable.VertexIndices.SetNum(IndexCount);
-
-		for (int32 Index = 0; Index < IndexCount; Index++)
+		// UVs, indices and masks never change, they are viewed in place instead of copied
+		Drawable.VertexUVs = TConstArrayView<FVector2f>(reinterpret_cast<const FVector2f*>(VertexUvs[ModelDrawableIndex]), VertexCount);
+		Drawable.CanvasVertexUVs = TConstArrayView<FVector2f>(CanvasUVArena.GetData() + VertexOffset, VertexCount);
+		for (int32 VertexIndex = 0; VertexIndex < VertexCount; VertexIndex++)
 		{
-			Drawable.VertexIndices[Index] = VertexIndices[ModelDrawableIndex][Index];
+			CanvasUVArena[VertexOffset + VertexIndex] = FVector2f(Drawable.VertexUVs[VertexIndex].X, 1.f - Drawable.VertexUVs[VertexIndex].Y);
 		}
+		VertexOffset += VertexCount;
+		Drawable.VertexIndices = TConstArrayView<uint16>(VertexIndices[ModelDrawableIndex], IndexCounts[ModelDrawableIndex]);
 		
 		// Access to other Drawable elements
-		Drawable.ID = Ids[ModelDrawableIndex];
+		Drawable.ID = FName(Ids[ModelDrawableIndex]);
 		Drawable.DrawOrder = DrawOrders[ModelDrawableIndex];
 
 		// The following three items are important on rendering.
@@ -914,30 +2205,50 @@ void ULive2DMocModel::InitializeDrawables()
 		Drawable.RenderOrder = RenderOrders[ModelDrawableIndex];
 		Drawable.DynamicFlag = DynamicFlags[ModelDrawableIndex];
 		const int32 MaskCount = MaskCounts[ModelDrawableIndex];
-		Drawable.Masks.SetNum(MaskCount);
-		for (int32 MaskIndex = 0; MaskIndex < MaskCount; MaskIndex++)
+		// Numbers in masks are index of Drawable
+		Drawable.Masks = TConstArrayView<int32>(Masks[ModelDrawableIndex], MaskCount);
+
+#if WITH_EDITORONLY_DATA
+		Drawable.EditorVertexPositions.Reset(VertexCount);
+		for (const FVector2f& VertexPosition: Drawable.VertexPositions)
 		{
-			Drawable.Masks[MaskIndex] = Masks[ModelDrawableIndex][MaskIndex];
-			// Numbers in masks are index of Drawable
-			//Drawable.MaskLinks = &Drawables[Masks[ModelDrawableIndex][MaskIndex]];
+			Drawable.EditorVertexPositions.Add(FVector2D(VertexPosition));
 		}
+		Drawable.EditorVertexUVs.Reset(VertexCount);
+		for (const FVector2f& VertexUV: Drawable.VertexUVs)
+		{
+			Drawable.EditorVertexUVs.Add(FVector2D(VertexUV));
+		}
+		Drawable.EditorVertexIndices = TArray<int32>(Drawable.VertexIndices.GetData(), Drawable.VertexIndices.Num());
+		Drawable.EditorMasks = TArray<int32>(Drawable.Masks.GetData(), Drawable.Masks.Num());
+#endif
 
 		if (MaskCount > 0)
 		{
-			const FVector2D ModelSize = GetModelSize();
 			auto* RenderTarget = NewObject<UTextureRenderTarget2D>(this);
 			check(RenderTarget);
 			RenderTarget->TargetGamma = 1.f;
 			RenderTarget->RenderTargetFormat = RTF_RGBA8;
 			RenderTarget->ClearColor = FLinearColor::Transparent;
 			RenderTarget->bAutoGenerateMips = false;
-			RenderTarget->InitAutoFormat(ModelSize.X, ModelSize.Y);
+			RenderTarget->InitAutoFormat(RenderTargetSize.X, RenderTargetSize.Y);
 			RenderTarget->UpdateResourceImmediate(true);
 			MaskingRenderTargets.Add(Drawable.ID, RenderTarget);
 		}
 
 		Drawables.Add(&Drawable);
 	}
+
+	for (FLive2DModelDrawable& Drawable: UnSortedDrawables)
+	{
+		for (const int32 MaskIndex: Drawable.Masks)
+		{
+			if (UnSortedDrawables.IsValidIndex(MaskIndex))
+			{
+				UnSortedDrawables[MaskIndex].bIsMask = true;
+			}
+		}
+	}
 	
 	Drawables.Sort([](const FLive2DModelDrawable& l, const FLive2DModelDrawable& r)
 	{
@@ -1,5 +1,8 @@
 ﻿#include "Live2DModelMotion.h"
 
+#include "Live2DLogCategory.h"
+#include "Live2DModelPhysics.h"
+
 UWorld* ULive2DModelMotion::GetWorld() const
 {
 	// This implementation is needed so the blueprint can access worldcontext methods from blueprintFunctionLibraries. The check for for the defaultObject is there because in the editor the object doesn't have an outer.
@@ -48,6 +51,23 @@ void ULive2DModelMotion::ToggleMotionInEditor()
 void ULive2DModelMotion::StartMotion()
 {
 	RebindDelegates();
+	if (bBakeVertexStream && !BakedVertexStream.IsValid())
+	{
+		if (CanBakeVertexStream())
+		{
+			BakeVertexStream();
+		}
+		else
+		{
+			UE_LOG(LogLive2D, Warning, TEXT("ULive2DModelMotion::StartMotion: %s plays without a baked vertex stream, only looping motions of models without physics can be baked!"), *GetName());
+		}
+	}
+	if (bStabilizePhysicsOnStart && Model->GetPhysicsSystem()->HasRigs())
+	{
+		EvaluateCurves(CurrentTime);
+		Model->GetPhysicsSystem()->Stabilize();
+		Model->UpdateDrawables();
+	}
 	Model->OnModelTick.AddUniqueDynamic(this, &ULive2DModelMotion::Tick);
 	Model->StartTicking(DeltaTime);
 }
@@ -78,27 +98,132 @@ void ULive2DModelMotion::ToggleTimer()
 	}
 }
 
-void ULive2DModelMotion::Tick(const float InDeltaTime)
+void ULive2DModelMotion::EvaluateCurves(const float Time)
 {
-	const float PreviousTime = CurrentTime;
-	CurrentTime = FMath::Min(Duration, CurrentTime + InDeltaTime);
 	for (auto& Curve: Curves)
 	{
 		if (Curve.Target == ECurveTarget::TARGET_MODEL)
 		{
 			if (Curve.Id != TEXT("Opacity"))
 			{
-				Curve.UpdateParameter(Model, CurrentTime);
+				Curve.UpdateParameter(Model, Time);
 			}
 		}
 		if (Curve.Target == ECurveTarget::TARGET_PARAMETER)
 		{
-			Curve.UpdateParameter(Model, CurrentTime);
+			Curve.UpdateParameter(Model, Time);
 		}
 		else if (Curve.Target == ECurveTarget::TARGET_PART_OPACITY)
 		{
-			Curve.UpdatePartOpacity(Model, CurrentTime);
+			Curve.UpdatePartOpacity(Model, Time);
+		}
+	}
+}
+
+bool ULive2DModelMotion::CanBakeVertexStream() const
+{
+	// Physics depends on the state of previous frames, so only motions without it repeat exactly
+	return Model && bLoop && FPS > 0.f && Duration > 0.f && !Model->GetPhysicsSystem()->HasRigs();
+}
+
+void ULive2DModelMotion::BakeVertexStream()
+{
+	const int32 FrameCount = FMath::CeilToInt(Duration * FPS) + 1;
+
+	TArray<FLive2DModelDrawableOutputs> Frames;
+	Frames.SetNum(FrameCount);
+	FBox2D PositionBounds(ForceInit);
+	for (int32 FrameIndex = 0; FrameIndex < FrameCount; FrameIndex++)
+	{
+		EvaluateCurves(FMath::Min(FrameIndex * DeltaTime, Duration));
+		Model->EvaluateDrawableOutputs(Frames[FrameIndex]);
+		for (const FVector2f& Position: Frames[FrameIndex].VertexPositions)
+		{
+			PositionBounds += FVector2D(Position);
+		}
+	}
+
+	FLive2DBakedVertexStream& Stream = BakedVertexStream;
+	Stream.FrameCount = FrameCount;
+	Stream.VertexCount = Frames[0].VertexPositions.Num();
+	Stream.DrawableCount = Frames[0].Opacities.Num();
+	Stream.PositionMin = PositionBounds.bIsValid ? PositionBounds.Min : FVector2D::ZeroVector;
+	Stream.PositionScale = PositionBounds.bIsValid ? PositionBounds.GetSize().ComponentMax(FVector2D(KINDA_SMALL_NUMBER)) / MAX_uint16 : FVector2D::ZeroVector;
+
+	Stream.Positions.Reset(FrameCount * Stream.VertexCount * 2);
+	Stream.Opacities.Reset(FrameCount * Stream.DrawableCount);
+	Stream.DrawOrders.Reset(FrameCount * Stream.DrawableCount);
+	Stream.RenderOrders.Reset(FrameCount * Stream.DrawableCount);
+	Stream.Visibilities.Reset(FrameCount * Stream.DrawableCount);
+	for (const FLive2DModelDrawableOutputs& Frame: Frames)
+	{
+		for (const FVector2f& Position: Frame.VertexPositions)
+		{
+			const FVector2D Quantized = (FVector2D(Position) - Stream.PositionMin) / Stream.PositionScale;
+			Stream.Positions.Add(static_cast<uint16>(FMath::Clamp(FMath::RoundToInt(Quantized.X), 0, MAX_uint16)));
+			Stream.Positions.Add(static_cast<uint16>(FMath::Clamp(FMath::RoundToInt(Quantized.Y), 0, MAX_uint16)));
 		}
+		Stream.Opacities.Append(Frame.Opacities);
+		Stream.DrawOrders.Append(Frame.DrawOrders);
+		Stream.RenderOrders.Append(Frame.RenderOrders);
+		Stream.Visibilities.Append(Frame.Visibilities);
+	}
+
+	UE_LOG(LogLive2D, Log, TEXT("ULive2DModelMotion::BakeVertexStream: Baked %d frames of %s into %d KB"), FrameCount, *GetName(),
+		static_cast<int32>((Stream.Positions.GetAllocatedSize() + Stream.Opacities.GetAllocatedSize() + Stream.DrawOrders.GetAllocatedSize()
+			+ Stream.RenderOrders.GetAllocatedSize() + Stream.Visibilities.GetAllocatedSize()) / 1024));
+}
+
+void ULive2DModelMotion::ApplyBakedVertexStream(const float Time)
+{
+	const FLive2DBakedVertexStream& Stream = BakedVertexStream;
+	const float Frame = FMath::Clamp(Time * FPS, 0.f, static_cast<float>(Stream.FrameCount - 1));
+	const int32 Frame0 = FMath::FloorToInt(Frame);
+	const int32 Frame1 = FMath::Min(Frame0 + 1, Stream.FrameCount - 1);
+	const float Alpha = Frame - Frame0;
+
+	const uint16* Positions0 = Stream.Positions.GetData() + Frame0 * Stream.VertexCount * 2;
+	const uint16* Positions1 = Stream.Positions.GetData() + Frame1 * Stream.VertexCount * 2;
+	BakedFrameOutputs.VertexPositions.SetNumUninitialized(Stream.VertexCount);
+	for (int32 VertexIndex = 0; VertexIndex < Stream.VertexCount; VertexIndex++)
+	{
+		const FVector2D Quantized(
+			FMath::Lerp<float>(Positions0[VertexIndex * 2], Positions1[VertexIndex * 2], Alpha),
+			FMath::Lerp<float>(Positions0[VertexIndex * 2 + 1], Positions1[VertexIndex * 2 + 1], Alpha));
+		BakedFrameOutputs.VertexPositions[VertexIndex] = FVector2f(Stream.PositionMin + Quantized * Stream.PositionScale);
+	}
+
+	const float* Opacities0 = Stream.Opacities.GetData() + Frame0 * Stream.DrawableCount;
+	const float* Opacities1 = Stream.Opacities.GetData() + Frame1 * Stream.DrawableCount;
+	BakedFrameOutputs.Opacities.SetNumUninitialized(Stream.DrawableCount);
+	for (int32 DrawableIndex = 0; DrawableIndex < Stream.DrawableCount; DrawableIndex++)
+	{
+		BakedFrameOutputs.Opacities[DrawableIndex] = FMath::Lerp(Opacities0[DrawableIndex], Opacities1[DrawableIndex], Alpha);
+	}
+
+	// Orders and visibility can't be blended, they come from the nearest frame
+	const int32 NearestOffset = (Alpha < 0.5f ? Frame0 : Frame1) * Stream.DrawableCount;
+	BakedFrameOutputs.DrawOrders.Reset();
+	BakedFrameOutputs.DrawOrders.Append(Stream.DrawOrders.GetData() + NearestOffset, Stream.DrawableCount);
+	BakedFrameOutputs.RenderOrders.Reset();
+	BakedFrameOutputs.RenderOrders.Append(Stream.RenderOrders.GetData() + NearestOffset, Stream.DrawableCount);
+	BakedFrameOutputs.Visibilities.Reset();
+	BakedFrameOutputs.Visibilities.Append(Stream.Visibilities.GetData() + NearestOffset, Stream.DrawableCount);
+
+	Model->SetDrawableOutputs(BakedFrameOutputs);
+}
+
+void ULive2DModelMotion::Tick(const float InDeltaTime)
+{
+	const float PreviousTime = CurrentTime;
+	CurrentTime = FMath::Min(Duration, CurrentTime + InDeltaTime);
+	if (BakedVertexStream.IsValid())
+	{
+		ApplyBakedVertexStream(CurrentTime);
+	}
+	else
+	{
+		EvaluateCurves(CurrentTime);
 	}
 
 	for (const auto& Event: UserData)
@@ -3,13 +3,127 @@
 
 #include "Live2DModelPhysics.h"
 
+#include "Live2D.h"
+#include "Live2DLogCategory.h"
 #include "Live2DMocModel.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsFixedStep(
+	TEXT("Live2D.Physics.FixedStep"),
+	1,
+	TEXT("Steps physics with a Fps at its fixed rate and interpolates the output, instead of once per tick with the tick delta."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsParallelMinBatches(
+	TEXT("Live2D.Physics.ParallelMinBatches"),
+	8,
+	TEXT("Minimum number of independent batches of four rigs in a model for them to be solved in parallel."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsMaxSteps(
+	TEXT("Live2D.Physics.MaxSteps"),
+	4,
+	TEXT("Maximum number of fixed physics steps per tick, the time of longer ticks is dropped."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsSleep(
+	TEXT("Live2D.Physics.Sleep"),
+	1,
+	TEXT("Puts converged physics rigs to sleep, they skip integration and output writes until their inputs change."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsSleepSteps(
+	TEXT("Live2D.Physics.Sleep.Steps"),
+	30,
+	TEXT("Number of consecutive calm steps after which a rig falls asleep."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DPhysicsSleepInputThreshold(
+	TEXT("Live2D.Physics.Sleep.InputThreshold"),
+	0.001f,
+	TEXT("Change of the rig inputs, relative to their normalization range, below which a rig counts as calm and above which it wakes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DPhysicsSleepVelocityThreshold(
+	TEXT("Live2D.Physics.Sleep.VelocityThreshold"),
+	0.01f,
+	TEXT("Particle velocity below which a rig counts as calm."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsStabilizationCacheMaxEntries(
+	TEXT("Live2D.Physics.StabilizationCache.MaxEntries"),
+	256,
+	TEXT("Number of rest poses cached for stabilizing physics, shared by all models. The least recently used poses are evicted above it."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLive2DPhysicsStabilizationCacheQuantization(
+	TEXT("Live2D.Physics.StabilizationCache.Quantization"),
+	0.01f,
+	TEXT("Step the parameters physics reads and writes are rounded to before looking up a cached rest pose."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsLOD(
+	TEXT("Live2D.Physics.LOD"),
+	1,
+	TEXT("Applies the physics levels of detail of the models by their display size."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsForceLOD(
+	TEXT("Live2D.Physics.ForceLOD"),
+	-1,
+	TEXT("Forces the physics level of detail with this index on all models that have one, -1 picks it by display size."),
+	ECVF_Default);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sleeping Physics Rigs"), STAT_Live2DSleepingPhysicsRigs, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Frozen Physics Rigs"), STAT_Live2DFrozenPhysicsRigs, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Physics Stabilization Cache Hits"), STAT_Live2DStabilizationCacheHits, STATGROUP_Live2D);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Physics Stabilization Cache Misses"), STAT_Live2DStabilizationCacheMisses, STATGROUP_Live2D);
 
 namespace
 {
 	constexpr float MaximumWeight = 100.0f;
 	constexpr float MovementThreshold = 0.001f;
 	constexpr float AirResistance = 5.0f;
+
+	/** Stabilized state of all rigs of a physics setup for one quantized input pose */
+	struct FStabilizationCacheEntry
+	{
+		uint32 SetupHash = 0;
+		TArray<int32> QuantizedPose;
+		/** Particle state of all rigs in rig order, then the last inputs of each rig and the value of each output */
+		TArray<float> ParticleStates;
+		TArray<float> RigInputs;
+		TArray<float> OutputValues;
+		uint64 LastUsed = 0;
+	};
+
+	/** Rest poses of all physics assets by pose key, stabilization runs on the game thread */
+	TMap<uint32, FStabilizationCacheEntry> StabilizationCache;
+	uint64 StabilizationCacheUseCount = 0;
+
+	/** Relative influence of each rig by setup and moc hash, shared by all copies of a model since measuring it runs the model core twice per rig */
+	TMap<uint32, TArray<float>> RigInfluenceCache;
+
+	void SerializeSnapshotBool(FArchive& Ar, bool& bValue)
+	{
+		uint8 Value = bValue ? 1 : 0;
+		Ar << Value;
+		bValue = Value != 0;
+	}
+
+	void SerializeSnapshotVector(FArchive& Ar, FVector2D& Vector)
+	{
+		float X = Vector.X;
+		float Y = Vector.Y;
+		Ar << X << Y;
+		if (Ar.IsLoading())
+		{
+			Vector = FVector2D(X, Y);
+		}
+	}
 }
 
 UWorld* ULive2DModelPhysics::GetWorld() const
@@ -63,251 +177,898 @@ bool ULive2DModelPhysics::Init(const FPhysics3FileData& Physics3FileData)
 		PhysicsRigs.Add(PhysicsRig);
 	}
 
+	Fps = Physics3FileData.Meta.Fps;
 	InitializeParticles();
+	bAreParametersBound = false;
+	RemainingTime = 0.f;
+	bHasStepped = false;
 
 	return true;
 }
 
-void ULive2DModelPhysics::Evaluate(const float DeltaTime)
+void ULive2DModelPhysics::SetModel(ULive2DMocModel* InModel)
 {
-	for (auto& PhysicsRig : PhysicsRigs)
-	{
-		float TotalAngle = 0.f;
-		FVector2D TotalTranslation = FVector2D::ZeroVector;
+	Model = InModel;
+	bAreParametersBound = false;
+}
 
-		for (const auto& Input : PhysicsRig.Input)
+void ULive2DModelPhysics::BindParameters()
+{
+	bAreParametersBound = true;
+
+	for (auto& PhysicsRig: PhysicsRigs)
+	{
+		PhysicsRig.InputBindings.Reset(PhysicsRig.Input.Num());
+		PhysicsRig.InputMaps.Reset(PhysicsRig.Input.Num());
+		for (const auto& Input: PhysicsRig.Input)
 		{
-			float Weight = Input.Weight / MaximumWeight;
-			
-			switch (Input.Type)
+			const int32 ParameterIndex = Model->GetParameterIndex(Input.Source.Id);
+			if (ParameterIndex == INDEX_NONE)
 			{
-			case EPhysics3SourceType::X:
-				{
-					GetInputTranslationXFromNormalizedParameterValue(TotalTranslation, TotalAngle,
-						Model->GetParameterValue(Input.Source.Id),
-						Model->GetMinimumParameterValue(Input.Source.Id), Model->GetMaximumParameterValue(Input.Source.Id), Model->GetDefaultParameterValue(Input.Source.Id),
-						PhysicsRig.Normalization.Position, PhysicsRig.Normalization.Angle,
-						Input.bReflect, Weight);
-				}
-				break;
-			case EPhysics3SourceType::Y:
-				{
-					GetInputTranslationYFromNormalizedParameterValue(TotalTranslation, TotalAngle,
-						Model->GetParameterValue(Input.Source.Id),
-						Model->GetMinimumParameterValue(Input.Source.Id), Model->GetMaximumParameterValue(Input.Source.Id), Model->GetDefaultParameterValue(Input.Source.Id),
-						PhysicsRig.Normalization.Position, PhysicsRig.Normalization.Angle,
-						Input.bReflect, Weight);
-				}
-				break;
-			case EPhysics3SourceType::Angle:
-				{
-					GetInputAngleFromNormalizedParameterValue(TotalTranslation, TotalAngle,
-						Model->GetParameterValue(Input.Source.Id),
-						Model->GetMinimumParameterValue(Input.Source.Id), Model->GetMaximumParameterValue(Input.Source.Id), Model->GetDefaultParameterValue(Input.Source.Id),
-						PhysicsRig.Normalization.Position, PhysicsRig.Normalization.Angle,
-						Input.bReflect, Weight);
-				}
-				break;
-			default:
-				break;
+				UE_LOG(LogLive2D, Error, TEXT("ULive2DModelPhysics::BindParameters: Parameter %s doesn't exist on Live 2D Model!"), *Input.Source.Id);
 			}
+			PhysicsRig.InputBindings.Add(BindParameter(ParameterIndex));
+			PhysicsRig.InputMaps.Add(CompileInputMap(Input, PhysicsRig.InputBindings.Last(), PhysicsRig.Normalization));
 		}
 
-		float RadAngle = FMath::DegreesToRadians(-TotalAngle);
-		
-		TotalTranslation.X = (TotalTranslation.X * FMath::Cos(RadAngle) - TotalTranslation.Y * FMath::Sin(RadAngle));
-		TotalTranslation.Y = (TotalTranslation.X * FMath::Sin(RadAngle) + TotalTranslation.Y * FMath::Cos(RadAngle));
-
-		UpdateParticles(
-			PhysicsRig.Particles,
-			PhysicsRig.Particles.Num(),
-			TotalTranslation,
-			TotalAngle,
-			EffectiveForces.Wind,
-			MovementThreshold * PhysicsRig.Normalization.Position.Maximum,
-			DeltaTime,
-			AirResistance
-		);
+		// The solver restarts from the initial particles
+		PhysicsRig.bIsSleeping = false;
+		PhysicsRig.bIsFrozen = false;
+		PhysicsRig.CalmStepCount = 0;
+		PhysicsRig.bNeedsHeldOutputWrite = false;
+		PhysicsRig.bWereOutputsOverwritten = false;
 
 		for (auto& Output: PhysicsRig.Output)
 		{
-			if (Output.VertexIndex < 1)
+			Output.DestinationBindings.Reset();
+			for (const int32 ParameterIndex: Model->FindParameterIndices(Output.Destination.Id))
 			{
-				break;
+				Output.DestinationBindings.Add(BindParameter(ParameterIndex));
 			}
 
-			FVector2D Translation;
-			Translation.X = PhysicsRig.Particles[Output.VertexIndex].Position.X - PhysicsRig.Particles[Output.VertexIndex- 1].Position.X;
-			Translation.Y = PhysicsRig.Particles[Output.VertexIndex].Position.Y - PhysicsRig.Particles[Output.VertexIndex- 1].Position.Y;
+			if (Output.DestinationBindings.Num() == 0)
+			{
+				UE_LOG(LogLive2D, Error, TEXT("ULive2DModelPhysics::BindParameters: Parameter %s doesn't exist on Live 2D Model!"), *Output.Destination.Id);
+			}
+		}
+	}
 
-			float OutputValue = 0.f;
-			
-			switch (Output.Type)
+	// A rig reading a parameter that an earlier rig writes has to be solved after it, the rest are solved side by side.
+	// Waves never decrease in rig order, so reads and writes of shared parameters keep their order
+	TArray<int32> RigWaves;
+	RigWaves.Init(0, PhysicsRigs.Num());
+	for (int32 RigIndex = 0; RigIndex < PhysicsRigs.Num(); RigIndex++)
+	{
+		RigWaves[RigIndex] = RigIndex > 0 ? RigWaves[RigIndex - 1] : 0;
+		for (int32 EarlierRigIndex = 0; EarlierRigIndex < RigIndex; EarlierRigIndex++)
+		{
+			if (ReadsOutputsOf(PhysicsRigs[RigIndex], PhysicsRigs[EarlierRigIndex]))
 			{
-			case EPhysics3SourceType::X:
-				{
-					OutputValue = GetOutputTranslationX(Translation, PhysicsRig.Particles, Output.VertexIndex, Output.bReflect, EffectiveForces.Gravity);
-				}
-				break;
-			case EPhysics3SourceType::Y:
+				RigWaves[RigIndex] = FMath::Max(RigWaves[RigIndex], RigWaves[EarlierRigIndex] + 1);
+			}
+		}
+	}
+	Solver.Build(PhysicsRigs, RigWaves);
+	SetupHash = CalcSetupHash();
+	RigInfluences.Reset();
+}
+
+uint32 ULive2DModelPhysics::CalcSetupHash() const
+{
+	TArray<float> Setup;
+	Setup.Add(EffectiveForces.Gravity.X);
+	Setup.Add(EffectiveForces.Gravity.Y);
+	Setup.Add(EffectiveForces.Wind.X);
+	Setup.Add(EffectiveForces.Wind.Y);
+	for (const auto& PhysicsRig: PhysicsRigs)
+	{
+		Setup.Add(PhysicsRig.Normalization.Position.Minimum);
+		Setup.Add(PhysicsRig.Normalization.Position.Default);
+		Setup.Add(PhysicsRig.Normalization.Position.Maximum);
+		Setup.Add(PhysicsRig.Normalization.Angle.Minimum);
+		Setup.Add(PhysicsRig.Normalization.Angle.Default);
+		Setup.Add(PhysicsRig.Normalization.Angle.Maximum);
+		for (int32 InputIndex = 0; InputIndex < PhysicsRig.Input.Num(); InputIndex++)
+		{
+			const auto& Input = PhysicsRig.Input[InputIndex];
+			Setup.Add(static_cast<float>(PhysicsRig.InputBindings[InputIndex].ParameterIndex));
+			Setup.Add(static_cast<float>(Input.Weight));
+			Setup.Add(static_cast<float>(Input.Type));
+			Setup.Add(Input.bReflect ? 1.f : 0.f);
+		}
+		for (const auto& Output: PhysicsRig.Output)
+		{
+			Setup.Add(static_cast<float>(Output.DestinationBindings.Num() > 0 ? Output.DestinationBindings[0].ParameterIndex : INDEX_NONE));
+			Setup.Add(static_cast<float>(Output.VertexIndex));
+			Setup.Add(Output.Scale);
+			Setup.Add(static_cast<float>(Output.Weight));
+			Setup.Add(static_cast<float>(Output.Type));
+			Setup.Add(Output.bReflect ? 1.f : 0.f);
+		}
+		for (const auto& Particle: PhysicsRig.Particles)
+		{
+			Setup.Add(Particle.Mobility);
+			Setup.Add(Particle.Delay);
+			Setup.Add(Particle.Acceleration);
+			Setup.Add(Particle.Radius);
+		}
+	}
+	return FCrc::MemCrc32(Setup.GetData(), Setup.Num() * sizeof(float));
+}
+
+bool ULive2DModelPhysics::ReadsOutputsOf(const FLive2DModelPhysicsRig& PhysicsRig, const FLive2DModelPhysicsRig& OtherPhysicsRig)
+{
+	for (const FLive2DModelPhysicsParameterBinding& Source: PhysicsRig.InputBindings)
+	{
+		for (const auto& Output: OtherPhysicsRig.Output)
+		{
+			for (const FLive2DModelPhysicsParameterBinding& Destination: Output.DestinationBindings)
+			{
+				if (Source.ParameterIndex != INDEX_NONE && Source.ParameterIndex == Destination.ParameterIndex)
 				{
-					OutputValue = GetOutputTranslationY(Translation, PhysicsRig.Particles, Output.VertexIndex, Output.bReflect, EffectiveForces.Gravity);
+					return true;
 				}
-				break;
-			case EPhysics3SourceType::Angle:
+			}
+		}
+	}
+	return false;
+}
+
+FLive2DModelPhysicsParameterBinding ULive2DModelPhysics::BindParameter(const int32 ParameterIndex) const
+{
+	FLive2DModelPhysicsParameterBinding Binding;
+	if (ParameterIndex == INDEX_NONE)
+	{
+		return Binding;
+	}
+
+	Binding.ParameterIndex = ParameterIndex;
+	Binding.Minimum = Model->GetParameterMinimumValueData()[ParameterIndex];
+	Binding.Maximum = Model->GetParameterMaximumValueData()[ParameterIndex];
+	Binding.Default = Model->GetParameterDefaultValueData()[ParameterIndex];
+	return Binding;
+}
+
+void ULive2DModelPhysics::Evaluate(const float DeltaTime)
+{
+	BeginEvaluate();
+	Simulate(DeltaTime);
+	EndEvaluate();
+}
+
+void ULive2DModelPhysics::Stabilize()
+{
+	if (!bAreParametersBound)
+	{
+		BindParameters();
+	}
+
+	float* ParameterValues = Model->GetParameterValueData();
+	ParameterCache.Reset();
+	ParameterCache.Append(ParameterValues, Model->GetParameterCount());
+
+	// The rest pose depends on the parameters the rigs read, and on the values their outputs blend into
+	const float InvStep = 1.f / FMath::Max(CVarLive2DPhysicsStabilizationCacheQuantization.GetValueOnGameThread(), KINDA_SMALL_NUMBER);
+	TArray<int32> QuantizedPose;
+	int32 ParticleCount = 0;
+	int32 OutputCount = 0;
+	for (const auto& PhysicsRig: PhysicsRigs)
+	{
+		for (const FLive2DModelPhysicsParameterBinding& Source: PhysicsRig.InputBindings)
+		{
+			QuantizedPose.Add(Source.ParameterIndex != INDEX_NONE ? FMath::RoundToInt(ParameterCache[Source.ParameterIndex] * InvStep) : 0);
+		}
+		for (const auto& Output: PhysicsRig.Output)
+		{
+			QuantizedPose.Add(Output.DestinationBindings.Num() > 0 ? FMath::RoundToInt(ParameterCache[Output.DestinationBindings[0].ParameterIndex] * InvStep) : 0);
+		}
+		ParticleCount += PhysicsRig.Particles.Num();
+		OutputCount += PhysicsRig.Output.Num();
+	}
+	const uint32 PoseKey = FCrc::MemCrc32(QuantizedPose.GetData(), QuantizedPose.Num() * sizeof(int32), SetupHash);
+
+	FStabilizationCacheEntry* CacheEntry = StabilizationCache.Find(PoseKey);
+	if (CacheEntry && (CacheEntry->SetupHash != SetupHash || CacheEntry->QuantizedPose != QuantizedPose))
+	{
+		CacheEntry = nullptr;
+	}
+
+	const bool bCanSleep = IsSleepEnabled() && EffectiveForces.Wind.IsNearlyZero();
+	if (CacheEntry)
+	{
+		INC_DWORD_STAT(STAT_Live2DStabilizationCacheHits);
+		CacheEntry->LastUsed = ++StabilizationCacheUseCount;
+
+		int32 ParticleOffset = 0;
+		int32 OutputOffset = 0;
+		for (int32 RigIndex = 0; RigIndex < PhysicsRigs.Num(); RigIndex++)
+		{
+			FLive2DModelPhysicsRig& PhysicsRig = PhysicsRigs[RigIndex];
+			Solver.SetRigState(RigIndex, PhysicsRig.Particles.Num(), &CacheEntry->ParticleStates[ParticleOffset * FLive2DModelPhysicsSolver::StateFloatsPerParticle]);
+			ParticleOffset += PhysicsRig.Particles.Num();
+			PhysicsRig.LastTotalTranslation = FVector2D(CacheEntry->RigInputs[RigIndex * 3], CacheEntry->RigInputs[RigIndex * 3 + 1]);
+			PhysicsRig.LastTotalAngle = CacheEntry->RigInputs[RigIndex * 3 + 2];
+			for (auto& Output: PhysicsRig.Output)
+			{
+				Output.CurrentValue = CacheEntry->OutputValues[OutputOffset++];
+			}
+		}
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_Live2DStabilizationCacheMisses);
+
+		// In rig order, so rigs reading the outputs of earlier rigs rest on their rest pose
+		FStabilizationCacheEntry NewEntry;
+		NewEntry.SetupHash = SetupHash;
+		NewEntry.QuantizedPose = QuantizedPose;
+		NewEntry.ParticleStates.SetNumUninitialized(ParticleCount * FLive2DModelPhysicsSolver::StateFloatsPerParticle);
+		NewEntry.RigInputs.Reserve(PhysicsRigs.Num() * 3);
+		NewEntry.OutputValues.Reserve(OutputCount);
+		int32 ParticleOffset = 0;
+		for (int32 RigIndex = 0; RigIndex < PhysicsRigs.Num(); RigIndex++)
+		{
+			FLive2DModelPhysicsRig& PhysicsRig = PhysicsRigs[RigIndex];
+			GatherRigInputs(PhysicsRig, PhysicsRig.LastTotalTranslation, PhysicsRig.LastTotalAngle);
+			Solver.Stabilize(RigIndex, PhysicsRig.Particles.Num(), PhysicsRig.LastTotalTranslation, PhysicsRig.LastTotalAngle,
+				MovementThreshold * PhysicsRig.Normalization.Position.Maximum, EffectiveForces.Wind);
+			UpdateRigOutputs(PhysicsRig, RigIndex);
+
+			Solver.GetRigState(RigIndex, PhysicsRig.Particles.Num(), &NewEntry.ParticleStates[ParticleOffset * FLive2DModelPhysicsSolver::StateFloatsPerParticle]);
+			ParticleOffset += PhysicsRig.Particles.Num();
+			NewEntry.RigInputs.Add(PhysicsRig.LastTotalTranslation.X);
+			NewEntry.RigInputs.Add(PhysicsRig.LastTotalTranslation.Y);
+			NewEntry.RigInputs.Add(PhysicsRig.LastTotalAngle);
+			for (const auto& Output: PhysicsRig.Output)
+			{
+				NewEntry.OutputValues.Add(Output.CurrentValue);
+			}
+		}
+
+		const int32 MaxEntries = CVarLive2DPhysicsStabilizationCacheMaxEntries.GetValueOnGameThread();
+		if (MaxEntries > 0)
+		{
+			while (StabilizationCache.Num() >= MaxEntries)
+			{
+				uint32 LeastRecentlyUsedKey = 0;
+				uint64 LeastRecentlyUsed = MAX_uint64;
+				for (const auto& CachedPose: StabilizationCache)
 				{
-					OutputValue = GetOutputAngle(Translation, PhysicsRig.Particles, Output.VertexIndex, Output.bReflect, EffectiveForces.Gravity);
+					if (CachedPose.Value.LastUsed < LeastRecentlyUsed)
+					{
+						LeastRecentlyUsedKey = CachedPose.Key;
+						LeastRecentlyUsed = CachedPose.Value.LastUsed;
+					}
 				}
-				break;
-			default:
-				break;
+				StabilizationCache.Remove(LeastRecentlyUsedKey);
 			}
 
-			float ParameterValue;
-
-			UpdateOutputParameterValue(ParameterValue, Model->GetMinimumParameterValue(Output.Destination.Id), Model->GetMaximumParameterValue(Output.Destination.Id), OutputValue, Output);
+			// A different pose with the same key is replaced
+			NewEntry.LastUsed = ++StabilizationCacheUseCount;
+			StabilizationCache.Add(PoseKey, MoveTemp(NewEntry));
+		}
+	}
 
-			Model->SetParameterValue(Output.Destination.Id, ParameterValue);
+	// Written at rest straight away, a settled rig sleeps until its inputs change
+	for (auto& PhysicsRig: PhysicsRigs)
+	{
+		for (auto& Output: PhysicsRig.Output)
+		{
+			Output.PreviousValue = Output.CurrentValue;
 		}
+		WriteRigOutputs(PhysicsRig, ParameterValues, 1.f);
+		PhysicsRig.bIsSleeping = bCanSleep;
+		PhysicsRig.CalmStepCount = 0;
+		PhysicsRig.bNeedsHeldOutputWrite = false;
+		PhysicsRig.bWereOutputsOverwritten = false;
+		PhysicsRig.bHasPendingWriteback = false;
 	}
+	RemainingTime = 0.f;
+	bHasStepped = true;
+
+#if WITH_EDITOR
+	Solver.CopyToRigs(PhysicsRigs);
+#endif
 }
 
-void ULive2DModelPhysics::InitializeParticles()
+int32 ULive2DModelPhysics::CalcSnapshotSize() const
 {
-	for (auto& PhysicsRig: PhysicsRigs)
+	// Bools are stored as uint8 and vectors as two floats, see SerializeSnapshotData
+	int32 Size = Solver.GetStateSize() + sizeof(float) + sizeof(uint8);
+	for (const auto& PhysicsRig: PhysicsRigs)
 	{
-		// Initialize the top of particle.
-		PhysicsRig.Particles[0].InitialPosition = FVector2D(0.0f, 0.0f);
-		PhysicsRig.Particles[0].LastPosition = PhysicsRig.Particles[0].InitialPosition;
-		PhysicsRig.Particles[0].LastGravity = FVector2D(0.0f, -1.0f);
-		PhysicsRig.Particles[0].LastGravity.Y *= -1.0f;
-		PhysicsRig.Particles[0].Velocity = FVector2D(0.0f, 0.0f);
-		PhysicsRig.Particles[0].Force = FVector2D(0.0f, 0.0f);
+		Size += sizeof(uint8) + sizeof(int32) + 3 * sizeof(float);
+		Size += PhysicsRig.Output.Num() * 3 * sizeof(float);
+	}
+	return Size;
+}
 
-		for (int32 i = 1; i < PhysicsRig.Particles.Num(); i++)
+bool ULive2DModelPhysics::IsFixedStepEnabled() const
+{
+	return EvaluationOptions.bFixedStep.Get(CVarLive2DPhysicsFixedStep.GetValueOnAnyThread() != 0);
+}
+
+bool ULive2DModelPhysics::IsSleepEnabled() const
+{
+	return EvaluationOptions.bSleep.Get(CVarLive2DPhysicsSleep.GetValueOnAnyThread() != 0);
+}
+
+bool ULive2DModelPhysics::IsLODEnabled() const
+{
+	return EvaluationOptions.bLOD.Get(CVarLive2DPhysicsLOD.GetValueOnAnyThread() != 0);
+}
+
+void ULive2DModelPhysics::SerializeSnapshotData(FArchive& Ar)
+{
+	Solver.SerializeState(Ar);
+	Ar << RemainingTime;
+	SerializeSnapshotBool(Ar, bHasStepped);
+	for (auto& PhysicsRig: PhysicsRigs)
+	{
+		SerializeSnapshotBool(Ar, PhysicsRig.bIsSleeping);
+		Ar << PhysicsRig.CalmStepCount;
+		SerializeSnapshotVector(Ar, PhysicsRig.LastTotalTranslation);
+		Ar << PhysicsRig.LastTotalAngle;
+		for (auto& Output: PhysicsRig.Output)
 		{
-			FVector2D Radius = FVector2D::ZeroVector;
-			Radius.Y = PhysicsRig.Particles[i].Radius;
-			PhysicsRig.Particles[i].InitialPosition = PhysicsRig.Particles[i - 1].InitialPosition + Radius;
-			PhysicsRig.Particles[i].Position = PhysicsRig.Particles[i].InitialPosition;
-			PhysicsRig.Particles[i].LastPosition = PhysicsRig.Particles[i].InitialPosition;
-			PhysicsRig.Particles[i].LastGravity = FVector2D(0.0f, -1.0f);
-			PhysicsRig.Particles[i].LastGravity.Y *= -1.0f;
-			PhysicsRig.Particles[i].Velocity = FVector2D(0.0f, 0.0f);
-			PhysicsRig.Particles[i].Force = FVector2D(0.0f, 0.0f);
+			Ar << Output.PreviousValue;
+			Ar << Output.CurrentValue;
+			Ar << Output.WrittenValue;
 		}
 	}
 }
 
-void ULive2DModelPhysics::GetInputTranslationXFromNormalizedParameterValue(FVector2D& TargetTranslation, float& TargetAngle, float Value, float ParameterMinimumValue, float ParameterMaximumValue, float ParameterDefaultValue, const FPhysics3PhysicsRangeData& NormalizationPosition,
-                                                                           const FPhysics3PhysicsRangeData& NormalizationAngle, bool bIsInverted, float Weight)
+void ULive2DModelPhysics::SaveSnapshot(FLive2DModelPhysicsSnapshot& OutSnapshot)
 {
-	TargetTranslation.X += NormalizeParameterValue(
-		Value,
-		ParameterMinimumValue,
-		ParameterMaximumValue,
-		ParameterDefaultValue,
-		NormalizationPosition.Minimum,
-		NormalizationPosition.Maximum,
-		NormalizationPosition.Default,
-		bIsInverted
-	) * Weight;
+	if (!bAreParametersBound)
+	{
+		BindParameters();
+	}
+
+	OutSnapshot.Version = SnapshotVersion;
+	OutSnapshot.SetupHash = SetupHash;
+	OutSnapshot.Data.Reset(CalcSnapshotSize());
+
+	FMemoryWriter Writer(OutSnapshot.Data, true);
+	SerializeSnapshotData(Writer);
 }
 
-void ULive2DModelPhysics::GetInputTranslationYFromNormalizedParameterValue(FVector2D& TargetTranslation, float& TargetAngle, float Value, float ParameterMinimumValue, float ParameterMaximumValue, float ParameterDefaultValue, const FPhysics3PhysicsRangeData& NormalizationPosition,
-	const FPhysics3PhysicsRangeData& NormalizationAngle, bool bIsInverted, float Weight)
+bool ULive2DModelPhysics::RestoreSnapshot(const FLive2DModelPhysicsSnapshot& Snapshot)
 {
-	TargetTranslation.Y += NormalizeParameterValue(
-		Value,
-		ParameterMinimumValue,
-		ParameterMaximumValue,
-		ParameterDefaultValue,
-		NormalizationPosition.Minimum,
-		NormalizationPosition.Maximum,
-		NormalizationPosition.Default,
-		bIsInverted
-	) * Weight;
+	if (Snapshot.Version != SnapshotVersion)
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DModelPhysics::RestoreSnapshot: Snapshot version %d doesn't match version %d!"), Snapshot.Version, SnapshotVersion);
+		return false;
+	}
+
+	if (!bAreParametersBound)
+	{
+		BindParameters();
+	}
+
+	if (Snapshot.SetupHash != SetupHash || Snapshot.Data.Num() != CalcSnapshotSize())
+	{
+		UE_LOG(LogLive2D, Error, TEXT("ULive2DModelPhysics::RestoreSnapshot: Snapshot was taken from physics of another asset!"));
+		return false;
+	}
+
+	FMemoryReader Reader(Snapshot.Data, true);
+	SerializeSnapshotData(Reader);
+
+	// The model shows the restored outputs right away, not only after the next step
+	float* ParameterValues = Model->GetParameterValueData();
+	for (auto& PhysicsRig: PhysicsRigs)
+	{
+		if (bHasStepped)
+		{
+			WriteRigOutputs(PhysicsRig, ParameterValues, 1.f);
+		}
+		PhysicsRig.bNeedsHeldOutputWrite = false;
+		PhysicsRig.bWereOutputsOverwritten = false;
+		PhysicsRig.bHasPendingWriteback = false;
+	}
+
+#if WITH_EDITOR
+	Solver.CopyToRigs(PhysicsRigs);
+#endif
+	return true;
 }
 
-void ULive2DModelPhysics::GetInputAngleFromNormalizedParameterValue(FVector2D& TargetTranslation, float& TargetAngle, float Value, float ParameterMinimumValue, float ParameterMaximumValue, float ParameterDefaultValue, const FPhysics3PhysicsRangeData& NormalizationPosition,
-	const FPhysics3PhysicsRangeData& NormalizationAngle, bool bIsInverted, float Weight)
+void ULive2DModelPhysics::BeginEvaluate()
 {
-	TargetTranslation.Y += NormalizeParameterValue(
-		Value,
-		ParameterMinimumValue,
-		ParameterMaximumValue,
-		ParameterDefaultValue,
-		NormalizationAngle.Minimum,
-		NormalizationAngle.Maximum,
-		NormalizationAngle.Default,
-		bIsInverted
-	) * Weight;
+	if (!bAreParametersBound)
+	{
+		BindParameters();
+	}
+
+	UpdateLOD();
+
+	ParameterSnapshot.Reset();
+	ParameterSnapshot.Append(Model->GetParameterValueData(), Model->GetParameterCount());
+	for (auto& PhysicsRig : PhysicsRigs)
+	{
+		PhysicsRig.bHasPendingWriteback = false;
+	}
 }
 
-float ULive2DModelPhysics::NormalizeParameterValue(float Value, float ParameterMinimum, float ParameterMaximum, float ParameterDefault, float NormalizedMinimum, float NormalizedMaximum, float NormalizedDefault, bool bIsInverted)
+void ULive2DModelPhysics::UpdateLOD()
 {
-	float Result = 0.0f;
+	CurrentLOD = INDEX_NONE;
+	if (IsLODEnabled() && LODs.Num() > 0)
+	{
+		const int32 ForcedLOD = CVarLive2DPhysicsForceLOD.GetValueOnGameThread();
+		const float DisplaySize = Model->GetDisplaySize().GetMax();
+		for (int32 LODIndex = 0; LODIndex < LODs.Num() && ForcedLOD < 0; LODIndex++)
+		{
+			if (DisplaySize <= LODs[LODIndex].MaxDisplaySize && (CurrentLOD == INDEX_NONE || LODs[LODIndex].MaxDisplaySize < LODs[CurrentLOD].MaxDisplaySize))
+			{
+				CurrentLOD = LODIndex;
+			}
+		}
+		if (ForcedLOD >= 0)
+		{
+			CurrentLOD = FMath::Min(ForcedLOD, LODs.Num() - 1);
+		}
+	}
+
+	const float RateScale = CurrentLOD != INDEX_NONE ? LODs[CurrentLOD].RateScale : 1.f;
+	const float MinRigInfluence = CurrentLOD != INDEX_NONE ? LODs[CurrentLOD].MinRigInfluence : 0.f;
+	if (MinRigInfluence > 0.f && RigInfluences.Num() != PhysicsRigs.Num())
+	{
+		// Copies of a model share the measurement, the rigs of a setup move the same drawables of the same moc
+		const uint32 InfluenceKey = HashCombine(SetupHash, Model->GetMocHash());
+		if (const TArray<float>* CachedInfluences = RigInfluenceCache.Find(InfluenceKey))
+		{
+			RigInfluences = *CachedInfluences;
+		}
+	}
+	if (MinRigInfluence > 0.f && RigInfluences.Num() != PhysicsRigs.Num())
+	{
+		// A rig matters as much as the drawables its output parameters move
+		TArray<int32> ParameterIndices;
+		float MaxInfluence = 0.f;
+		RigInfluences.Reset(PhysicsRigs.Num());
+		for (const auto& PhysicsRig: PhysicsRigs)
+		{
+			ParameterIndices.Reset();
+			for (const auto& Output: PhysicsRig.Output)
+			{
+				for (const FLive2DModelPhysicsParameterBinding& Destination: Output.DestinationBindings)
+				{
+					ParameterIndices.AddUnique(Destination.ParameterIndex);
+				}
+			}
+			RigInfluences.Add(Model->CalcParameterInfluence(ParameterIndices));
+			MaxInfluence = FMath::Max(MaxInfluence, RigInfluences.Last());
+		}
+		for (float& RigInfluence: RigInfluences)
+		{
+			RigInfluence = MaxInfluence > 0.f ? RigInfluence / MaxInfluence : 1.f;
+		}
+		RigInfluenceCache.Add(HashCombine(SetupHash, Model->GetMocHash()), RigInfluences);
+	}
 
-	const float MaxValue = FMath::Max(ParameterMaximum, ParameterMinimum);
+	for (int32 RigIndex = 0; RigIndex < PhysicsRigs.Num(); RigIndex++)
+	{
+		FLive2DModelPhysicsRig& PhysicsRig = PhysicsRigs[RigIndex];
+		const bool bIsFrozen = RateScale <= 0.f || (MinRigInfluence > 0.f && RigInfluences[RigIndex] < MinRigInfluence);
+		if (bIsFrozen && !PhysicsRig.bIsFrozen)
+		{
+			// Holds the output of its last step, without interpolating towards it
+			for (auto& Output: PhysicsRig.Output)
+			{
+				Output.PreviousValue = Output.CurrentValue;
+			}
+			PhysicsRig.CalmStepCount = 0;
+			PhysicsRig.bNeedsHeldOutputWrite = true;
+		}
+		PhysicsRig.bIsFrozen = bIsFrozen;
+	}
+}
 
-	if (MaxValue < Value)
+void ULive2DModelPhysics::Simulate(const float DeltaTime)
+{
+	const bool bCanSleep = IsSleepEnabled();
+	for (auto& PhysicsRig : PhysicsRigs)
 	{
-		Value = MaxValue;
+		if (PhysicsRig.bIsSleeping && !bCanSleep)
+		{
+			PhysicsRig.bIsSleeping = false;
+			PhysicsRig.CalmStepCount = 0;
+			PhysicsRig.bNeedsHeldOutputWrite = false;
+		}
+		PhysicsRig.bWereOutputsOverwritten = IsRigIdle(PhysicsRig) && !HasWrittenOutputs(PhysicsRig, ParameterSnapshot.GetData());
 	}
 
-	const float MinValue = FMath::Min(ParameterMaximum, ParameterMinimum);
+	ParameterCache.Reset();
+	ParameterCache.Append(ParameterSnapshot);
 
-	if (MinValue > Value)
+	// A level of detail lowers the rate, at zero all rigs are frozen
+	const float RateScale = CurrentLOD != INDEX_NONE ? LODs[CurrentLOD].RateScale : 1.f;
+	const bool bIsFixedStep = Fps > 0.f && IsFixedStepEnabled();
+	float Alpha = 1.f;
+	if (RateScale <= 0.f)
 	{
-		Value = MinValue;
+		RemainingTime = 0.f;
 	}
+	else if (bIsFixedStep)
+	{
+		// Time beyond the step cap is dropped, so a long frame costs a bounded number of steps instead of catching up
+		const float StepTime = 1.f / (Fps * RateScale);
+		const int32 MaxSteps = FMath::Max(1, CVarLive2DPhysicsMaxSteps.GetValueOnAnyThread());
+		RemainingTime = FMath::Min(RemainingTime + DeltaTime, StepTime * MaxSteps);
 
-	const float MinNormValue = FMath::Min(NormalizedMinimum, NormalizedMaximum);
-	const float MaxNormValue = FMath::Max(NormalizedMinimum, NormalizedMaximum);
-	const float MiddleNormValue = NormalizedDefault;
+		while (RemainingTime >= StepTime)
+		{
+			StepRigs(StepTime);
+			bHasStepped = true;
+			RemainingTime -= StepTime;
+		}
 
-	const float MiddleValue = MinValue + (FMath::Abs(MaxValue - MinValue) / 2.f);
-	const float ParamValue = Value - MiddleValue;
+		Alpha = RemainingTime / StepTime;
+	}
+	else if (RateScale < 1.f)
+	{
+		// Integrates the time of several ticks in one step
+		RemainingTime += DeltaTime;
+		if (RemainingTime * RateScale >= DeltaTime)
+		{
+			StepRigs(RemainingTime);
+			bHasStepped = true;
+			RemainingTime = 0.f;
+		}
+	}
+	else
+	{
+		StepRigs(DeltaTime);
+		bHasStepped = true;
+	}
+
+	if (!bHasStepped)
+	{
+		return;
+	}
 
-	const int32 SignValue = FMath::Sign(ParamValue);
-	switch (SignValue)
+	// The outputs are blended over the snapshot, which leaves it holding the parameter values to write back.
+	// Idle rigs write their held outputs once after falling asleep or freezing, and again only when they were overwritten
+	int32 SleepingRigCount = 0;
+	int32 FrozenRigCount = 0;
+	for (auto& PhysicsRig : PhysicsRigs)
 	{
-	case 1: {
-			const float nLength = MaxNormValue - MiddleNormValue;
-			const float pLength = MaxValue - MiddleValue;
-			if (pLength != 0.0f)
+		if (IsRigIdle(PhysicsRig))
+		{
+			SleepingRigCount += PhysicsRig.bIsSleeping ? 1 : 0;
+			FrozenRigCount += PhysicsRig.bIsFrozen ? 1 : 0;
+			if (!PhysicsRig.bNeedsHeldOutputWrite && !PhysicsRig.bWereOutputsOverwritten)
 			{
-				Result = ParamValue * (nLength / pLength);
-				Result += MiddleNormValue;
+				continue;
 			}
+			PhysicsRig.bNeedsHeldOutputWrite = false;
+		}
+		WriteRigOutputs(PhysicsRig, ParameterSnapshot.GetData(), Alpha);
+		PhysicsRig.bHasPendingWriteback = true;
+	}
+	INC_DWORD_STAT_BY(STAT_Live2DSleepingPhysicsRigs, SleepingRigCount);
+	INC_DWORD_STAT_BY(STAT_Live2DFrozenPhysicsRigs, FrozenRigCount);
+}
 
-			break;
+void ULive2DModelPhysics::EndEvaluate()
+{
+#if WITH_EDITOR
+	Solver.CopyToRigs(PhysicsRigs);
+#endif
+
+	float* ParameterValues = Model->GetParameterValueData();
+	for (auto& PhysicsRig : PhysicsRigs)
+	{
+		if (!PhysicsRig.bHasPendingWriteback)
+		{
+			continue;
+		}
+		PhysicsRig.bHasPendingWriteback = false;
+
+		for (const auto& Output: PhysicsRig.Output)
+		{
+			for (const FLive2DModelPhysicsParameterBinding& Destination: Output.DestinationBindings)
+			{
+				ParameterValues[Destination.ParameterIndex] = ParameterSnapshot[Destination.ParameterIndex];
+			}
+		}
 	}
-	case -1: {
-			const float nLength = MinNormValue - MiddleNormValue;
-			const float pLength = MinValue - MiddleValue;
-			if (pLength != 0.0f)
+}
+
+void ULive2DModelPhysics::StepRigs(const float DeltaTime)
+{
+	for (int32 WaveIndex = 0; WaveIndex < Solver.GetWaveCount(); WaveIndex++)
+	{
+		const int32 FirstBatch = Solver.GetWaveFirstBatch(WaveIndex);
+		const int32 LastBatch = Solver.GetWaveLastBatch(WaveIndex);
+
+		// Batches of a wave only read the parameter cache and write their own particles, large models solve them in parallel
+		const int32 BatchCount = LastBatch - FirstBatch + 1;
+		const bool bIsParallel = BatchCount >= FMath::Max(1, CVarLive2DPhysicsParallelMinBatches.GetValueOnAnyThread());
+		ParallelFor(BatchCount, [this, FirstBatch, DeltaTime](const int32 BatchOffset)
+		{
+			const int32 BatchIndex = FirstBatch + BatchOffset;
+			for (const int32 RigIndex: Solver.GetBatch(BatchIndex).RigIndices)
+			{
+				if (RigIndex == INDEX_NONE)
+				{
+					continue;
+				}
+
+				// Frozen rigs don't read their inputs, only the level of detail thaws them
+				FLive2DModelPhysicsRig& PhysicsRig = PhysicsRigs[RigIndex];
+				if (PhysicsRig.bIsFrozen)
+				{
+					Solver.SetRigInput(RigIndex, PhysicsRig.LastTotalTranslation, PhysicsRig.LastTotalAngle, 0.f, false);
+					continue;
+				}
+
+				FVector2D TotalTranslation;
+				float TotalAngle;
+				GatherRigInputs(PhysicsRig, TotalTranslation, TotalAngle);
+				UpdateRigSleep(PhysicsRig, TotalTranslation, TotalAngle);
+				Solver.SetRigInput(RigIndex, TotalTranslation, TotalAngle, MovementThreshold * PhysicsRig.Normalization.Position.Maximum, !PhysicsRig.bIsSleeping);
+			}
+			Solver.Solve(BatchIndex, EffectiveForces.Wind, DeltaTime, AirResistance);
+		}, bIsParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+
+		// Rigs are in order within a wave, so outputs to shared parameters blend in the same order as before.
+		// Idle rigs blend their held outputs, unless the cache still holds what they wrote last
+		const int32 SleepSteps = FMath::Max(1, CVarLive2DPhysicsSleepSteps.GetValueOnAnyThread());
+		for (int32 BatchIndex = FirstBatch; BatchIndex <= LastBatch; BatchIndex++)
+		{
+			for (const int32 RigIndex: Solver.GetBatch(BatchIndex).RigIndices)
 			{
-				Result = ParamValue * (nLength / pLength);
-				Result += MiddleNormValue;
+				if (RigIndex == INDEX_NONE)
+				{
+					continue;
+				}
+
+				FLive2DModelPhysicsRig& PhysicsRig = PhysicsRigs[RigIndex];
+				if (IsRigIdle(PhysicsRig))
+				{
+					if (PhysicsRig.bWereOutputsOverwritten)
+					{
+						WriteRigOutputs(PhysicsRig, ParameterCache.GetData(), 1.f);
+					}
+					continue;
+				}
+
+				UpdateRigOutputs(PhysicsRig, RigIndex);
+				if (PhysicsRig.CalmStepCount > 0 && Solver.GetMaxSpeedSquared(RigIndex, PhysicsRig.Particles.Num()) > FMath::Square(CVarLive2DPhysicsSleepVelocityThreshold.GetValueOnAnyThread()))
+				{
+					PhysicsRig.CalmStepCount = 0;
+				}
+				else if (PhysicsRig.CalmStepCount >= SleepSteps)
+				{
+					// Falls asleep holding the output of this step, without interpolating towards it
+					PhysicsRig.bIsSleeping = true;
+					PhysicsRig.CalmStepCount = 0;
+					PhysicsRig.bNeedsHeldOutputWrite = true;
+					for (auto& Output: PhysicsRig.Output)
+					{
+						Output.PreviousValue = Output.CurrentValue;
+					}
+				}
 			}
+		}
+	}
+}
+
+void ULive2DModelPhysics::GatherRigInputs(const FLive2DModelPhysicsRig& PhysicsRig, FVector2D& TotalTranslation, float& TotalAngle)
+{
+	float Totals[3] = { 0.f, 0.f, 0.f };
+	for (const FLive2DModelPhysicsInputMap& InputMap: PhysicsRig.InputMaps)
+	{
+		const float Value = InputMap.ParameterIndex != INDEX_NONE ? ParameterCache[InputMap.ParameterIndex] : 0.f;
+		const float Offset = FMath::Clamp(Value, InputMap.Minimum, InputMap.Maximum) - InputMap.Middle;
+		Totals[InputMap.Target] += InputMap.Offset + Offset * (Offset > 0.f ? InputMap.HighSlope : InputMap.LowSlope);
+	}
+	TotalTranslation = FVector2D(Totals[0], Totals[1]);
+	TotalAngle = Totals[2];
 
+	float RadAngle = FMath::DegreesToRadians(-TotalAngle);
+	
+	TotalTranslation.X = (TotalTranslation.X * FMath::Cos(RadAngle) - TotalTranslation.Y * FMath::Sin(RadAngle));
+	TotalTranslation.Y = (TotalTranslation.X * FMath::Sin(RadAngle) + TotalTranslation.Y * FMath::Cos(RadAngle));
+}
+
+void ULive2DModelPhysics::UpdateRigSleep(FLive2DModelPhysicsRig& PhysicsRig, const FVector2D& TotalTranslation, const float TotalAngle) const
+{
+	const float InputThreshold = CVarLive2DPhysicsSleepInputThreshold.GetValueOnAnyThread();
+	const bool bIsCalm = FMath::Abs(TotalTranslation.X - PhysicsRig.LastTotalTranslation.X) <= InputThreshold * PhysicsRig.Normalization.Position.Maximum
+		&& FMath::Abs(TotalTranslation.Y - PhysicsRig.LastTotalTranslation.Y) <= InputThreshold * PhysicsRig.Normalization.Position.Maximum
+		&& FMath::Abs(TotalAngle - PhysicsRig.LastTotalAngle) <= InputThreshold * PhysicsRig.Normalization.Angle.Maximum;
+
+	if (PhysicsRig.bIsSleeping)
+	{
+		if (bIsCalm)
+		{
+			return;
+		}
+		PhysicsRig.bIsSleeping = false;
+		PhysicsRig.bNeedsHeldOutputWrite = false;
+	}
+
+	// Wind keeps pushing the particles, so it never settles
+	const bool bCanSleep = IsSleepEnabled() && EffectiveForces.Wind.IsNearlyZero();
+	PhysicsRig.CalmStepCount = bIsCalm && bCanSleep ? PhysicsRig.CalmStepCount + 1 : 0;
+	PhysicsRig.LastTotalTranslation = TotalTranslation;
+	PhysicsRig.LastTotalAngle = TotalAngle;
+}
+
+bool ULive2DModelPhysics::HasWrittenOutputs(const FLive2DModelPhysicsRig& PhysicsRig, const float* ParameterValues)
+{
+	for (const auto& Output: PhysicsRig.Output)
+	{
+		if (Output.VertexIndex < 1)
+		{
 			break;
+		}
+
+		if (Output.DestinationBindings.Num() > 0 && ParameterValues[Output.DestinationBindings[0].ParameterIndex] != Output.WrittenValue)
+		{
+			return false;
+		}
 	}
-	case 0: {
-			Result = MiddleNormValue;
+	return true;
+}
 
+void ULive2DModelPhysics::UpdateRigOutputs(FLive2DModelPhysicsRig& PhysicsRig, const int32 RigIndex)
+{
+	for (auto& Output: PhysicsRig.Output)
+	{
+		if (Output.VertexIndex < 1)
+		{
 			break;
+		}
+
+		const FVector2D Translation = Solver.GetParticlePosition(RigIndex, Output.VertexIndex) - Solver.GetParticlePosition(RigIndex, Output.VertexIndex - 1);
+
+		float OutputValue = 0.f;
+		
+		switch (Output.Type)
+		{
+		case EPhysics3SourceType::X:
+			{
+				OutputValue = GetOutputTranslationX(Translation, RigIndex, Output.VertexIndex, Output.bReflect, EffectiveForces.Gravity);
+			}
+			break;
+		case EPhysics3SourceType::Y:
+			{
+				OutputValue = GetOutputTranslationY(Translation, RigIndex, Output.VertexIndex, Output.bReflect, EffectiveForces.Gravity);
+			}
+			break;
+		case EPhysics3SourceType::Angle:
+			{
+				OutputValue = GetOutputAngle(Translation, RigIndex, Output.VertexIndex, Output.bReflect, EffectiveForces.Gravity);
+			}
+			break;
+		default:
+			break;
+		}
+
+		Output.PreviousValue = bHasStepped ? Output.CurrentValue : OutputValue;
+		Output.CurrentValue = OutputValue;
+
+		if (Output.DestinationBindings.Num() == 0)
+		{
+			continue;
+		}
+
+		const FLive2DModelPhysicsParameterBinding& Destination = Output.DestinationBindings[0];
+		float ParameterValue = ParameterCache[Destination.ParameterIndex];
+
+		UpdateOutputParameterValue(ParameterValue, Destination.Minimum, Destination.Maximum, OutputValue, Output);
+
+		for (const FLive2DModelPhysicsParameterBinding& Binding: Output.DestinationBindings)
+		{
+			ParameterCache[Binding.ParameterIndex] = FMath::Clamp(ParameterValue, Binding.Minimum, Binding.Maximum);
+		}
 	}
-	default:{
+}
+
+void ULive2DModelPhysics::WriteRigOutputs(FLive2DModelPhysicsRig& PhysicsRig, float* ParameterValues, const float Alpha)
+{
+	for (auto& Output: PhysicsRig.Output)
+	{
+		if (Output.VertexIndex < 1)
+		{
 			break;
+		}
+
+		if (Output.DestinationBindings.Num() == 0)
+		{
+			continue;
+		}
+
+		// The range of the first destination applies to the whole group, each parameter is still clamped to its own
+		const FLive2DModelPhysicsParameterBinding& Destination = Output.DestinationBindings[0];
+		float ParameterValue = ParameterValues[Destination.ParameterIndex];
+
+		UpdateOutputParameterValue(ParameterValue, Destination.Minimum, Destination.Maximum, FMath::Lerp(Output.PreviousValue, Output.CurrentValue, Alpha), Output);
+
+		for (const FLive2DModelPhysicsParameterBinding& Binding: Output.DestinationBindings)
+		{
+			ParameterValues[Binding.ParameterIndex] = FMath::Clamp(ParameterValue, Binding.Minimum, Binding.Maximum);
+		}
+		Output.WrittenValue = ParameterValues[Destination.ParameterIndex];
 	}
+}
+
+void ULive2DModelPhysics::InitializeParticles()
+{
+	for (auto& PhysicsRig: PhysicsRigs)
+	{
+		// Initialize the top of particle.
+		PhysicsRig.Particles[0].InitialPosition = FVector2D(0.0f, 0.0f);
+		PhysicsRig.Particles[0].LastPosition = PhysicsRig.Particles[0].InitialPosition;
+		PhysicsRig.Particles[0].LastGravity = FVector2D(0.0f, -1.0f);
+		PhysicsRig.Particles[0].LastGravity.Y *= -1.0f;
+		PhysicsRig.Particles[0].Velocity = FVector2D(0.0f, 0.0f);
+		PhysicsRig.Particles[0].Force = FVector2D(0.0f, 0.0f);
+
+		for (int32 i = 1; i < PhysicsRig.Particles.Num(); i++)
+		{
+			FVector2D Radius = FVector2D::ZeroVector;
+			Radius.Y = PhysicsRig.Particles[i].Radius;
+			PhysicsRig.Particles[i].InitialPosition = PhysicsRig.Particles[i - 1].InitialPosition + Radius;
+			PhysicsRig.Particles[i].Position = PhysicsRig.Particles[i].InitialPosition;
+			PhysicsRig.Particles[i].LastPosition = PhysicsRig.Particles[i].InitialPosition;
+			PhysicsRig.Particles[i].LastGravity = FVector2D(0.0f, -1.0f);
+			PhysicsRig.Particles[i].LastGravity.Y *= -1.0f;
+			PhysicsRig.Particles[i].Velocity = FVector2D(0.0f, 0.0f);
+			PhysicsRig.Particles[i].Force = FVector2D(0.0f, 0.0f);
+		}
+	}
+}
+
+FLive2DModelPhysicsInputMap ULive2DModelPhysics::CompileInputMap(const FPhysics3PhysicsInputData& Input, const FLive2DModelPhysicsParameterBinding& Source,
+	const FPhysics3PhysicsNormalizationData& Normalization)
+{
+	FLive2DModelPhysicsInputMap InputMap;
+	InputMap.ParameterIndex = Source.ParameterIndex;
+	InputMap.Minimum = FMath::Min(Source.Minimum, Source.Maximum);
+	InputMap.Maximum = FMath::Max(Source.Minimum, Source.Maximum);
+	InputMap.Middle = InputMap.Minimum + (InputMap.Maximum - InputMap.Minimum) / 2.f;
+
+	// Angle inputs are normalized by the angle range but add to the Y translation, matching the original input accumulation
+	const FPhysics3PhysicsRangeData* NormalizationRange = &Normalization.Position;
+	switch (Input.Type)
+	{
+	case EPhysics3SourceType::X:
+		InputMap.Target = 0;
+		break;
+	case EPhysics3SourceType::Y:
+		InputMap.Target = 1;
+		break;
+	case EPhysics3SourceType::Angle:
+		InputMap.Target = 1;
+		NormalizationRange = &Normalization.Angle;
+		break;
+	default:
+		// Other sources don't contribute, all of their map stays zero
+		return InputMap;
 	}
 
-	return (bIsInverted) ? Result : (Result * -1.0f);
+	// Reflected inputs keep the sign of the normalized value, the others flip it
+	const float Scale = (Input.bReflect ? 1.f : -1.f) * Input.Weight / MaximumWeight;
+	const float MinNormValue = FMath::Min(NormalizationRange->Minimum, NormalizationRange->Maximum);
+	const float MaxNormValue = FMath::Max(NormalizationRange->Minimum, NormalizationRange->Maximum);
+	const float MiddleNormValue = NormalizationRange->Default;
+	const float HalfLength = InputMap.Maximum - InputMap.Middle;
+	if (HalfLength > 0.f)
+	{
+		InputMap.HighSlope = Scale * (MaxNormValue - MiddleNormValue) / HalfLength;
+		InputMap.LowSlope = Scale * (MiddleNormValue - MinNormValue) / HalfLength;
+	}
+	InputMap.Offset = Scale * MiddleNormValue;
+	return InputMap;
 }
 
-float ULive2DModelPhysics::GetOutputTranslationX(const FVector2D& Translation, const TArray<FLive2dModelPhysicsParticle>& Particles, int32 ParticleIndex, bool bIsInverted, FVector2D ParentGravity)
+float ULive2DModelPhysics::GetOutputTranslationX(const FVector2D& Translation, int32 RigIndex, int32 ParticleIndex, bool bIsInverted, FVector2D ParentGravity)
 {
 	float OutputValue = Translation.X;
 
@@ -319,7 +1080,7 @@ float ULive2DModelPhysics::GetOutputTranslationX(const FVector2D& Translation, c
 	return OutputValue;
 }
 
-float ULive2DModelPhysics::GetOutputTranslationY(const FVector2D& Translation, const TArray<FLive2dModelPhysicsParticle>& Particles, int32 ParticleIndex, bool bIsInverted, FVector2D ParentGravity)
+float ULive2DModelPhysics::GetOutputTranslationY(const FVector2D& Translation, int32 RigIndex, int32 ParticleIndex, bool bIsInverted, FVector2D ParentGravity)
 {
 	float OutputValue = Translation.Y;
 
@@ -331,11 +1092,11 @@ float ULive2DModelPhysics::GetOutputTranslationY(const FVector2D& Translation, c
 	return OutputValue;
 }
 
-float ULive2DModelPhysics::GetOutputAngle(const FVector2D& Translation, const TArray<FLive2dModelPhysicsParticle>& Particles, int32 ParticleIndex, bool bIsInverted, FVector2D ParentGravity)
+float ULive2DModelPhysics::GetOutputAngle(const FVector2D& Translation, int32 RigIndex, int32 ParticleIndex, bool bIsInverted, FVector2D ParentGravity)
 {
 	if (ParticleIndex >= 2)
 	{
-		ParentGravity = Particles[ParticleIndex - 1].Position - Particles[ParticleIndex - 2].Position;
+		ParentGravity = Solver.GetParticlePosition(RigIndex, ParticleIndex - 1) - Solver.GetParticlePosition(RigIndex, ParticleIndex - 2);
 	}
 	else
 	{
@@ -352,64 +1113,6 @@ float ULive2DModelPhysics::GetOutputAngle(const FVector2D& Translation, const TA
 	return OutputValue;
 }
 
-void ULive2DModelPhysics::UpdateParticles(TArray<FLive2dModelPhysicsParticle>& Strand, int32 StrandCount, FVector2D TotalTranslation, float TotalAngle, FVector2D WindDirection, float ThresholdValue, float DeltaTimeSeconds, float InAirResistance)
-{
-	Strand[0].Position = TotalTranslation;
-
-    float TotalRadian = FMath::DegreesToRadians(TotalAngle);
-    FVector2D CurrentGravity = FVector2D(FMath::Sin(TotalAngle), FMath::Cos(TotalAngle));
-    CurrentGravity.Normalize();
-
-    for (int32 i = 1; i < StrandCount; ++i)
-    {
-	    FVector2D Velocity;
-	    FVector2D Direction;
-	    Strand[i].Force = (CurrentGravity * Strand[i].Acceleration) + WindDirection;
-
-        Strand[i].LastPosition = Strand[i].Position;
-
-        float Delay = Strand[i].Delay * DeltaTimeSeconds * 30.0f;
-
-        Direction.X = Strand[i].Position.X - Strand[i - 1].Position.X;
-        Direction.Y = Strand[i].Position.Y - Strand[i - 1].Position.Y;
-
-        float Radian = DirectionToRadian(Strand[i].LastGravity, CurrentGravity) / InAirResistance;
-
-        Direction.X = ((FMath::Cos(Radian) * Direction.X) - (Direction.Y * FMath::Sin(Radian)));
-        Direction.Y = ((FMath::Sin(Radian) * Direction.X) + (Direction.Y * FMath::Cos(Radian)));
-
-        Strand[i].Position = Strand[i - 1].Position + Direction;
-
-        Velocity.X = Strand[i].Velocity.X * Delay;
-        Velocity.Y = Strand[i].Velocity.Y * Delay;
-        FVector2D Force = Strand[i].Force * Delay * Delay;
-
-        Strand[i].Position = Strand[i].Position + Velocity + Force;
-
-        FVector2D NewDirection = Strand[i].Position - Strand[i - 1].Position;
-
-        NewDirection.Normalize();
-
-        Strand[i].Position = Strand[i - 1].Position + (NewDirection * Strand[i].Radius);
-
-        if (FMath::Abs(Strand[i].Position.X) < ThresholdValue)
-        {
-            Strand[i].Position.X = 0.0f;
-        }
-
-        if (Delay != 0.0f)
-        {
-            Strand[i].Velocity.X = Strand[i].Position.X - Strand[i].LastPosition.X;
-            Strand[i].Velocity.Y = Strand[i].Position.Y - Strand[i].LastPosition.Y;
-            Strand[i].Velocity /= Delay;
-            Strand[i].Velocity *= Strand[i].Mobility;
-        }
-
-        Strand[i].Force = FVector2D( 0.0f, 0.0f );
-        Strand[i].LastGravity = CurrentGravity;
-    }
-}
-
 void ULive2DModelPhysics::UpdateOutputParameterValue(float& ParameterValue, float ParameterValueMinimum, float ParameterValueMaximum, float Translation, FLive2dModelPhysicsOutput& Output)
 {
 	float OutputScale;
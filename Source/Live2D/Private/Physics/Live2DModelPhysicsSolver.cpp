@@ -0,0 +1,327 @@
+﻿#include "Live2DModelPhysicsSolver.h"
+
+#include "Live2DModelPhysics.h"
+
+namespace
+{
+	/** Normalizes vectors like FVector2D::Normalize, vectors too short to normalize become zero */
+	void NormalizeVectors(VectorRegister4Float& X, VectorRegister4Float& Y)
+	{
+		const VectorRegister4Float SquareSum = VectorMultiplyAdd(X, X, VectorMultiply(Y, Y));
+		const VectorRegister4Float IsNormalizable = VectorCompareGT(SquareSum, VectorSetFloat1(SMALL_NUMBER));
+		const VectorRegister4Float Scale = VectorReciprocalSqrtAccurate(SquareSum);
+		X = VectorSelect(IsNormalizable, VectorMultiply(X, Scale), GlobalVectorConstants::FloatZero);
+		Y = VectorSelect(IsNormalizable, VectorMultiply(Y, Scale), GlobalVectorConstants::FloatZero);
+	}
+}
+
+void FLive2DModelPhysicsSolver::Build(const TArray<FLive2DModelPhysicsRig>& Rigs, const TArray<int32>& RigWaves)
+{
+	Batches.Reset();
+	WaveFirstBatches.Reset();
+	RigOffsets.Init(INDEX_NONE, Rigs.Num());
+	RigInputIndices.Init(INDEX_NONE, Rigs.Num());
+
+	int32 WaveCount = 0;
+	for (const int32 RigWave: RigWaves)
+	{
+		WaveCount = FMath::Max(WaveCount, RigWave + 1);
+	}
+
+	// Rigs keep their order within a wave, so their outputs are written in the same order as before
+	int32 SlotCount = 0;
+	for (int32 WaveIndex = 0; WaveIndex < WaveCount; WaveIndex++)
+	{
+		WaveFirstBatches.Add(Batches.Num());
+		for (int32 RigIndex = 0; RigIndex < Rigs.Num(); RigIndex++)
+		{
+			if (RigWaves[RigIndex] != WaveIndex)
+			{
+				continue;
+			}
+
+			if (Batches.Num() == WaveFirstBatches.Last() || Batches.Last().RigIndices[LaneCount - 1] != INDEX_NONE)
+			{
+				FBatch& Batch = Batches.AddDefaulted_GetRef();
+				for (int32& BatchRigIndex: Batch.RigIndices)
+				{
+					BatchRigIndex = INDEX_NONE;
+				}
+			}
+
+			FBatch& Batch = Batches.Last();
+			for (int32 Lane = 0; Lane < LaneCount; Lane++)
+			{
+				if (Batch.RigIndices[Lane] == INDEX_NONE)
+				{
+					Batch.RigIndices[Lane] = RigIndex;
+					break;
+				}
+			}
+			Batch.Depth = FMath::Max(Batch.Depth, Rigs[RigIndex].Particles.Num());
+		}
+	}
+	WaveFirstBatches.Add(Batches.Num());
+
+	for (FBatch& Batch: Batches)
+	{
+		Batch.FirstSlot = SlotCount;
+		SlotCount += Batch.Depth;
+	}
+
+	const int32 ParticleCount = SlotCount * LaneCount;
+	for (TArray<float>* Values: { &PositionX, &PositionY, &LastPositionX, &LastPositionY, &VelocityX, &VelocityY, &LastGravityX, &LastGravityY, &Mobility, &Delay, &Acceleration, &Radius, &Active })
+	{
+		Values->SetNumZeroed(ParticleCount);
+	}
+	for (TArray<float>* Values: { &RootX, &RootY, &TotalAngles, &Thresholds, &Awake })
+	{
+		Values->SetNumZeroed(Batches.Num() * LaneCount);
+	}
+
+	for (int32 BatchIndex = 0; BatchIndex < Batches.Num(); BatchIndex++)
+	{
+		const FBatch& Batch = Batches[BatchIndex];
+		for (int32 Lane = 0; Lane < LaneCount; Lane++)
+		{
+			const int32 RigIndex = Batch.RigIndices[Lane];
+			if (RigIndex == INDEX_NONE)
+			{
+				continue;
+			}
+
+			RigOffsets[RigIndex] = Batch.FirstSlot * LaneCount + Lane;
+			RigInputIndices[RigIndex] = BatchIndex * LaneCount + Lane;
+			const TArray<FLive2dModelPhysicsParticle>& Particles = Rigs[RigIndex].Particles;
+			for (int32 ParticleIndex = 0; ParticleIndex < Particles.Num(); ParticleIndex++)
+			{
+				const FLive2dModelPhysicsParticle& Particle = Particles[ParticleIndex];
+				const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+				PositionX[Index] = Particle.Position.X;
+				PositionY[Index] = Particle.Position.Y;
+				LastPositionX[Index] = Particle.LastPosition.X;
+				LastPositionY[Index] = Particle.LastPosition.Y;
+				VelocityX[Index] = Particle.Velocity.X;
+				VelocityY[Index] = Particle.Velocity.Y;
+				LastGravityX[Index] = Particle.LastGravity.X;
+				LastGravityY[Index] = Particle.LastGravity.Y;
+				Mobility[Index] = Particle.Mobility;
+				Delay[Index] = Particle.Delay;
+				Acceleration[Index] = Particle.Acceleration;
+				Radius[Index] = Particle.Radius;
+				Active[Index] = 1.f;
+			}
+		}
+	}
+}
+
+void FLive2DModelPhysicsSolver::CopyToRigs(TArray<FLive2DModelPhysicsRig>& Rigs) const
+{
+	for (int32 RigIndex = 0; RigIndex < Rigs.Num() && RigIndex < RigOffsets.Num(); RigIndex++)
+	{
+		TArray<FLive2dModelPhysicsParticle>& Particles = Rigs[RigIndex].Particles;
+		for (int32 ParticleIndex = 0; ParticleIndex < Particles.Num(); ParticleIndex++)
+		{
+			FLive2dModelPhysicsParticle& Particle = Particles[ParticleIndex];
+			const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+			Particle.Position = FVector2D(PositionX[Index], PositionY[Index]);
+			Particle.LastPosition = FVector2D(LastPositionX[Index], LastPositionY[Index]);
+			Particle.Velocity = FVector2D(VelocityX[Index], VelocityY[Index]);
+			Particle.LastGravity = FVector2D(LastGravityX[Index], LastGravityY[Index]);
+			Particle.Force = FVector2D::ZeroVector;
+		}
+	}
+}
+
+void FLive2DModelPhysicsSolver::SetRigInput(const int32 RigIndex, const FVector2D& RootPosition, const float TotalAngle, const float Threshold, const bool bIsAwake)
+{
+	const int32 Index = RigInputIndices[RigIndex];
+	Awake[Index] = bIsAwake ? 1.f : 0.f;
+	RootX[Index] = RootPosition.X;
+	RootY[Index] = RootPosition.Y;
+	TotalAngles[Index] = TotalAngle;
+	Thresholds[Index] = Threshold;
+}
+
+void FLive2DModelPhysicsSolver::Stabilize(const int32 RigIndex, const int32 ParticleCount, const FVector2D& RootPosition, const float TotalAngle, const float Threshold, const FVector2D& Wind)
+{
+	// Gravity as Solve computes it, each particle then hangs from its parent along its force, which Solve leaves in place
+	const FVector2D Gravity = FVector2D(FMath::Sin(TotalAngle), FMath::Cos(TotalAngle)).GetSafeNormal();
+	FVector2D Parent = RootPosition;
+	for (int32 ParticleIndex = 0; ParticleIndex < ParticleCount; ParticleIndex++)
+	{
+		const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+		FVector2D Position = RootPosition;
+		if (ParticleIndex > 0)
+		{
+			Position = Parent + (Gravity * Acceleration[Index] + Wind).GetSafeNormal() * Radius[Index];
+			if (FMath::Abs(Position.X) < Threshold)
+			{
+				Position.X = 0.f;
+			}
+		}
+
+		PositionX[Index] = Position.X;
+		PositionY[Index] = Position.Y;
+		LastPositionX[Index] = Position.X;
+		LastPositionY[Index] = Position.Y;
+		VelocityX[Index] = 0.f;
+		VelocityY[Index] = 0.f;
+		LastGravityX[Index] = Gravity.X;
+		LastGravityY[Index] = Gravity.Y;
+		Parent = Position;
+	}
+}
+
+void FLive2DModelPhysicsSolver::GetRigState(const int32 RigIndex, const int32 ParticleCount, float* OutState) const
+{
+	for (int32 ParticleIndex = 0; ParticleIndex < ParticleCount; ParticleIndex++)
+	{
+		const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+		float* ParticleState = OutState + ParticleIndex * StateFloatsPerParticle;
+		ParticleState[0] = PositionX[Index];
+		ParticleState[1] = PositionY[Index];
+		ParticleState[2] = LastPositionX[Index];
+		ParticleState[3] = LastPositionY[Index];
+		ParticleState[4] = VelocityX[Index];
+		ParticleState[5] = VelocityY[Index];
+		ParticleState[6] = LastGravityX[Index];
+		ParticleState[7] = LastGravityY[Index];
+	}
+}
+
+void FLive2DModelPhysicsSolver::SetRigState(const int32 RigIndex, const int32 ParticleCount, const float* State)
+{
+	for (int32 ParticleIndex = 0; ParticleIndex < ParticleCount; ParticleIndex++)
+	{
+		const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+		const float* ParticleState = State + ParticleIndex * StateFloatsPerParticle;
+		PositionX[Index] = ParticleState[0];
+		PositionY[Index] = ParticleState[1];
+		LastPositionX[Index] = ParticleState[2];
+		LastPositionY[Index] = ParticleState[3];
+		VelocityX[Index] = ParticleState[4];
+		VelocityY[Index] = ParticleState[5];
+		LastGravityX[Index] = ParticleState[6];
+		LastGravityY[Index] = ParticleState[7];
+	}
+}
+
+void FLive2DModelPhysicsSolver::SerializeState(FArchive& Ar)
+{
+	// Value by value, so the archive keeps the byte order portable
+	for (TArray<float>* Values: { &PositionX, &PositionY, &LastPositionX, &LastPositionY, &VelocityX, &VelocityY, &LastGravityX, &LastGravityY })
+	{
+		for (float& Value: *Values)
+		{
+			Ar << Value;
+		}
+	}
+}
+
+void FLive2DModelPhysicsSolver::Solve(const int32 BatchIndex, const FVector2D& Wind, const float DeltaTime, const float AirResistance)
+{
+	const FBatch& Batch = Batches[BatchIndex];
+	const int32 InputIndex = BatchIndex * LaneCount;
+	const VectorRegister4Float Zero = GlobalVectorConstants::FloatZero;
+
+	// Sleeping strands keep their state, a batch of sleeping strands is skipped entirely
+	const VectorRegister4Float IsAwake = VectorCompareGT(VectorLoad(&Awake[InputIndex]), Zero);
+	if (VectorMaskBits(IsAwake) == 0)
+	{
+		return;
+	}
+
+	const VectorRegister4Float WindX = VectorSetFloat1(Wind.X);
+	const VectorRegister4Float WindY = VectorSetFloat1(Wind.Y);
+	const VectorRegister4Float DelayScale = VectorSetFloat1(DeltaTime * 30.f);
+	const VectorRegister4Float InvAirResistance = VectorSetFloat1(1.f / AirResistance);
+	const VectorRegister4Float Threshold = VectorLoad(&Thresholds[InputIndex]);
+
+	// The angle is in degrees but taken as radians, matching the original particle update
+	const VectorRegister4Float TotalAngle = VectorLoad(&TotalAngles[InputIndex]);
+	VectorRegister4Float GravityX;
+	VectorRegister4Float GravityY;
+	VectorSinCos(&GravityX, &GravityY, &TotalAngle);
+	NormalizeVectors(GravityX, GravityY);
+
+	VectorRegister4Float ParentX = VectorLoad(&RootX[InputIndex]);
+	VectorRegister4Float ParentY = VectorLoad(&RootY[InputIndex]);
+	const int32 RootIndex = Batch.FirstSlot * LaneCount;
+	VectorStore(VectorSelect(IsAwake, ParentX, VectorLoad(&PositionX[RootIndex])), &PositionX[RootIndex]);
+	VectorStore(VectorSelect(IsAwake, ParentY, VectorLoad(&PositionY[RootIndex])), &PositionY[RootIndex]);
+
+	for (int32 Depth = 1; Depth < Batch.Depth; Depth++)
+	{
+		const int32 Index = (Batch.FirstSlot + Depth) * LaneCount;
+		const VectorRegister4Float IsActive = VectorBitwiseAnd(VectorCompareGT(VectorLoad(&Active[Index]), Zero), IsAwake);
+		const VectorRegister4Float LastX = VectorLoad(&PositionX[Index]);
+		const VectorRegister4Float LastY = VectorLoad(&PositionY[Index]);
+		const VectorRegister4Float OldVelocityX = VectorLoad(&VelocityX[Index]);
+		const VectorRegister4Float OldVelocityY = VectorLoad(&VelocityY[Index]);
+		const VectorRegister4Float LastGravX = VectorLoad(&LastGravityX[Index]);
+		const VectorRegister4Float LastGravY = VectorLoad(&LastGravityY[Index]);
+		const VectorRegister4Float ParticleAcceleration = VectorLoad(&Acceleration[Index]);
+		const VectorRegister4Float ParticleRadius = VectorLoad(&Radius[Index]);
+		const VectorRegister4Float ParticleDelay = VectorMultiply(VectorLoad(&Delay[Index]), DelayScale);
+
+		const VectorRegister4Float ForceX = VectorMultiplyAdd(GravityX, ParticleAcceleration, WindX);
+		const VectorRegister4Float ForceY = VectorMultiplyAdd(GravityY, ParticleAcceleration, WindY);
+
+		// Angle between the last and the current gravity
+		const VectorRegister4Float Dot = VectorMultiplyAdd(LastGravX, GravityX, VectorMultiply(LastGravY, GravityY));
+		const VectorRegister4Float InvLastLength = VectorReciprocalSqrtAccurate(VectorMultiplyAdd(LastGravX, LastGravX, VectorMultiply(LastGravY, LastGravY)));
+		const VectorRegister4Float InvLength = VectorReciprocalSqrtAccurate(VectorMultiplyAdd(GravityX, GravityX, VectorMultiply(GravityY, GravityY)));
+		const VectorRegister4Float Cosine = VectorMax(VectorMin(VectorMultiply(Dot, VectorMultiply(InvLastLength, InvLength)), GlobalVectorConstants::FloatOne), GlobalVectorConstants::FloatMinusOne);
+		const VectorRegister4Float Radian = VectorMultiply(VectorACos(Cosine), InvAirResistance);
+		VectorRegister4Float Sin;
+		VectorRegister4Float Cos;
+		VectorSinCos(&Sin, &Cos, &Radian);
+
+		// Y is rotated with the already rotated X, matching the original particle update
+		VectorRegister4Float DirectionX = VectorSubtract(LastX, ParentX);
+		VectorRegister4Float DirectionY = VectorSubtract(LastY, ParentY);
+		DirectionX = VectorSubtract(VectorMultiply(Cos, DirectionX), VectorMultiply(DirectionY, Sin));
+		DirectionY = VectorMultiplyAdd(Sin, DirectionX, VectorMultiply(DirectionY, Cos));
+
+		const VectorRegister4Float DelaySquared = VectorMultiply(ParticleDelay, ParticleDelay);
+		VectorRegister4Float NewX = VectorAdd(VectorAdd(ParentX, DirectionX), VectorMultiplyAdd(OldVelocityX, ParticleDelay, VectorMultiply(ForceX, DelaySquared)));
+		VectorRegister4Float NewY = VectorAdd(VectorAdd(ParentY, DirectionY), VectorMultiplyAdd(OldVelocityY, ParticleDelay, VectorMultiply(ForceY, DelaySquared)));
+
+		VectorRegister4Float NewDirectionX = VectorSubtract(NewX, ParentX);
+		VectorRegister4Float NewDirectionY = VectorSubtract(NewY, ParentY);
+		NormalizeVectors(NewDirectionX, NewDirectionY);
+		NewX = VectorMultiplyAdd(NewDirectionX, ParticleRadius, ParentX);
+		NewY = VectorMultiplyAdd(NewDirectionY, ParticleRadius, ParentY);
+		NewX = VectorSelect(VectorCompareLT(VectorAbs(NewX), Threshold), Zero, NewX);
+
+		const VectorRegister4Float HasDelay = VectorCompareNE(ParticleDelay, Zero);
+		const VectorRegister4Float VelocityScale = VectorDivide(VectorLoad(&Mobility[Index]), VectorSelect(HasDelay, ParticleDelay, GlobalVectorConstants::FloatOne));
+		const VectorRegister4Float NewVelocityX = VectorSelect(HasDelay, VectorMultiply(VectorSubtract(NewX, LastX), VelocityScale), OldVelocityX);
+		const VectorRegister4Float NewVelocityY = VectorSelect(HasDelay, VectorMultiply(VectorSubtract(NewY, LastY), VelocityScale), OldVelocityY);
+
+		// Padding lanes of shorter strands and sleeping strands keep their state
+		VectorStore(VectorSelect(IsActive, LastX, VectorLoad(&LastPositionX[Index])), &LastPositionX[Index]);
+		VectorStore(VectorSelect(IsActive, LastY, VectorLoad(&LastPositionY[Index])), &LastPositionY[Index]);
+		VectorStore(VectorSelect(IsActive, NewX, LastX), &PositionX[Index]);
+		VectorStore(VectorSelect(IsActive, NewY, LastY), &PositionY[Index]);
+		VectorStore(VectorSelect(IsActive, NewVelocityX, OldVelocityX), &VelocityX[Index]);
+		VectorStore(VectorSelect(IsActive, NewVelocityY, OldVelocityY), &VelocityY[Index]);
+		VectorStore(VectorSelect(IsActive, GravityX, LastGravX), &LastGravityX[Index]);
+		VectorStore(VectorSelect(IsActive, GravityY, LastGravY), &LastGravityY[Index]);
+
+		ParentX = NewX;
+		ParentY = NewY;
+	}
+}
+
+float FLive2DModelPhysicsSolver::GetMaxSpeedSquared(const int32 RigIndex, const int32 ParticleCount) const
+{
+	float MaxSpeedSquared = 0.f;
+	for (int32 ParticleIndex = 1; ParticleIndex < ParticleCount; ParticleIndex++)
+	{
+		const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+		MaxSpeedSquared = FMath::Max(MaxSpeedSquared, VelocityX[Index] * VelocityX[Index] + VelocityY[Index] * VelocityY[Index]);
+	}
+	return MaxSpeedSquared;
+}
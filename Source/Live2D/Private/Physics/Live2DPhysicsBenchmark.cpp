@@ -0,0 +1,320 @@
+﻿#include "Live2DPhysicsBenchmark.h"
+
+#if !UE_BUILD_SHIPPING
+
+#include "JsonObjectConverter.h"
+#include "Live2DLogCategory.h"
+#include "Live2DMocModel.h"
+#include "Live2DModelPhysics.h"
+#include "HAL/IConsoleManager.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace Live2DPhysicsBenchmark
+{
+	/** Delta times every benchmark runs at, one physics step per frame each */
+	const float DeltaTimes[] = { 1.f / 30.f, 1.f / 60.f, 1.f / 144.f };
+
+	/** Rigs that each read one parameter of the model and swing four particles into the next one */
+	FPhysics3FileData CreateSyntheticPhysics3FileData(const ULive2DMocModel* Model, const int32 RigCount)
+	{
+		FPhysics3FileData Physics3FileData;
+		Physics3FileData.Meta.PhysicsSettingCount = RigCount;
+		Physics3FileData.Meta.EffectiveForces.Gravity = FVector2D(0.f, -1.f);
+		Physics3FileData.Meta.EffectiveForces.Wind = FVector2D::ZeroVector;
+
+		const int32 ParameterCount = Model->GetParameterCount();
+		TArray<FString> ParameterIds;
+		ParameterIds.Reserve(ParameterCount);
+		for (int32 ParameterIndex = 0; ParameterIndex < ParameterCount; ParameterIndex++)
+		{
+			ParameterIds.Add(Model->GetParameterId(ParameterIndex));
+		}
+
+		for (int32 RigIndex = 0; RigIndex < RigCount && ParameterCount > 1; RigIndex++)
+		{
+			FPhysics3PhysicsSettingsData& Settings = Physics3FileData.PhysicsSettings.AddDefaulted_GetRef();
+			Settings.Id = FString::Printf(TEXT("PhysicsSetting%d"), RigIndex + 1);
+			Settings.Normalization.Position = { -10.f, 0.f, 10.f };
+			Settings.Normalization.Angle = { -10.f, 0.f, 10.f };
+
+			FPhysics3PhysicsInputData& Input = Settings.Input.AddDefaulted_GetRef();
+			Input.Source.Target = TEXT("Parameter");
+			Input.Source.Id = ParameterIds[RigIndex % ParameterCount];
+			Input.Weight = 100;
+			Input.Type = RigIndex % 2 == 0 ? EPhysics3SourceType::X : EPhysics3SourceType::Angle;
+			Input.bReflect = false;
+
+			FPhysics3PhysicsOutputData& Output = Settings.Output.AddDefaulted_GetRef();
+			Output.Destination.Target = TEXT("Parameter");
+			Output.Destination.Id = ParameterIds[(RigIndex + 1) % ParameterCount];
+			Output.VertexIndex = 1;
+			Output.Scale = 1.f;
+			Output.Weight = 100;
+			Output.Type = EPhysics3SourceType::Angle;
+			Output.bReflect = false;
+
+			for (int32 VertexIndex = 0; VertexIndex < 4; VertexIndex++)
+			{
+				FPhysics3PhysicsVertexData& Vertex = Settings.Vertices.AddDefaulted_GetRef();
+				Vertex.Position = FVector2D(0.f, VertexIndex * 3.f);
+				Vertex.Mobility = 0.95f;
+				Vertex.Delay = 0.9f;
+				Vertex.Acceleration = 1.5f;
+				Vertex.Radius = VertexIndex > 0 ? 3.f : 0.f;
+			}
+		}
+		return Physics3FileData;
+	}
+
+	/** Moves every parameter along its own sine wave, so the rigs keep swinging and the trace only depends on the frame */
+	void DriveParameters(ULive2DMocModel* Model, const float Time)
+	{
+		float* ParameterValues = Model->GetParameterValueData();
+		const float* ParameterMinimumValues = Model->GetParameterMinimumValueData();
+		const float* ParameterMaximumValues = Model->GetParameterMaximumValueData();
+		for (int32 ParameterIndex = 0; ParameterIndex < Model->GetParameterCount(); ParameterIndex++)
+		{
+			const float Alpha = 0.5f + 0.5f * FMath::Sin(Time * PI + ParameterIndex);
+			ParameterValues[ParameterIndex] = FMath::Lerp(ParameterMinimumValues[ParameterIndex], ParameterMaximumValues[ParameterIndex], Alpha);
+		}
+	}
+
+	int32 CompareTraces(const TArray<FString>& Trace, const TArray<FString>& GoldenTrace, const float Tolerance, FString& OutFirstMismatch)
+	{
+		if (Trace.Num() != GoldenTrace.Num())
+		{
+			OutFirstMismatch = FString::Printf(TEXT("%d lines instead of %d"), Trace.Num(), GoldenTrace.Num());
+			return FMath::Abs(Trace.Num() - GoldenTrace.Num());
+		}
+
+		int32 MismatchCount = 0;
+		TArray<FString> Values;
+		TArray<FString> GoldenValues;
+		for (int32 LineIndex = 1; LineIndex < Trace.Num(); LineIndex++)
+		{
+			Trace[LineIndex].ParseIntoArray(Values, TEXT(","));
+			GoldenTrace[LineIndex].ParseIntoArray(GoldenValues, TEXT(","));
+			for (int32 ValueIndex = 0; ValueIndex < FMath::Max(Values.Num(), GoldenValues.Num()); ValueIndex++)
+			{
+				const bool bIsMissing = !Values.IsValidIndex(ValueIndex) || !GoldenValues.IsValidIndex(ValueIndex);
+				if (bIsMissing || FMath::Abs(FCString::Atof(*Values[ValueIndex]) - FCString::Atof(*GoldenValues[ValueIndex])) > Tolerance)
+				{
+					if (MismatchCount == 0)
+					{
+						OutFirstMismatch = FString::Printf(TEXT("line %d, column %d"), LineIndex + 1, ValueIndex + 1);
+					}
+					MismatchCount++;
+				}
+			}
+		}
+		return MismatchCount;
+	}
+
+	FString GetTestDataDir()
+	{
+		return IPluginManager::Get().FindPlugin(TEXT("UELive2D"))->GetBaseDir() / TEXT("Resources") / TEXT("Tests") / TEXT("Physics");
+	}
+
+	FString GetGoldenFileName(const FString& RunName)
+	{
+		return GetTestDataDir() / RunName + TEXT("_Golden.csv");
+	}
+
+	bool Run(ULive2DMocModel* Model, const FString& ModelName, const FString& Physics3FileName, const int32 SyntheticRigCount, const int32 FrameCount, FRun& OutRun)
+	{
+		ULive2DModelPhysics* Physics = Model->GetPhysicsSystem();
+		OutRun.Name = ModelName;
+		if (!Physics3FileName.IsEmpty())
+		{
+			FString JsonString;
+			FPhysics3FileData Physics3FileData;
+			if (!FFileHelper::LoadFileToString(JsonString, *Physics3FileName) || !FJsonObjectConverter::JsonObjectStringToUStruct<FPhysics3FileData>(JsonString, &Physics3FileData, 0, 0))
+			{
+				UE_LOG(LogLive2D, Error, TEXT("Live2DPhysicsBenchmark::Run: Physics %s couldn't be loaded!"), *Physics3FileName);
+				return false;
+			}
+			Physics = NewObject<ULive2DModelPhysics>(Model);
+			Physics->Init(Physics3FileData);
+			OutRun.Name += TEXT("_") + FPaths::GetBaseFilename(FPaths::GetBaseFilename(Physics3FileName));
+		}
+		else if (SyntheticRigCount > 0)
+		{
+			Physics = NewObject<ULive2DModelPhysics>(Model);
+			Physics->Init(CreateSyntheticPhysics3FileData(Model, SyntheticRigCount));
+			OutRun.Name += FString::Printf(TEXT("_Synthetic%d"), SyntheticRigCount);
+		}
+
+		if (!Physics)
+		{
+			UE_LOG(LogLive2D, Error, TEXT("Live2DPhysicsBenchmark::Run: Model %s has no physics!"), *ModelName);
+			return false;
+		}
+		Physics->SetModel(Model);
+
+		const int32 RigCount = Physics->GetRigCount();
+		if (RigCount == 0)
+		{
+			UE_LOG(LogLive2D, Error, TEXT("Live2DPhysicsBenchmark::Run: Model %s has no physics rigs!"), *ModelName);
+			return false;
+		}
+
+		// One step per frame with every rig awake, so the timings are per step and the trace doesn't depend on the sleep thresholds
+		FLive2DModelPhysicsEvaluationOptions EvaluationOptions;
+		EvaluationOptions.bFixedStep = false;
+		EvaluationOptions.bSleep = false;
+		EvaluationOptions.bLOD = false;
+		Physics->SetEvaluationOptions(EvaluationOptions);
+
+		Model->ResetParametersToDefault();
+		FLive2DModelPhysicsSnapshot InitialSnapshot;
+		Physics->SaveSnapshot(InitialSnapshot);
+
+		const int32 ParameterCount = Model->GetParameterCount();
+		OutRun.Trace.Reset();
+		OutRun.Results.Reset();
+		FString Header = TEXT("DeltaTime,Frame");
+		for (int32 ParameterIndex = 0; ParameterIndex < ParameterCount; ParameterIndex++)
+		{
+			Header += TEXT(",") + Model->GetParameterId(ParameterIndex);
+		}
+		OutRun.Trace.Add(Header);
+
+		for (const float DeltaTime: DeltaTimes)
+		{
+			Model->ResetParametersToDefault();
+			Physics->RestoreSnapshot(InitialSnapshot);
+
+			uint64 EvaluateCycles = 0;
+			for (int32 Frame = 0; Frame < FrameCount; Frame++)
+			{
+				DriveParameters(Model, Frame * DeltaTime);
+
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+				Physics->Evaluate(DeltaTime);
+				EvaluateCycles += FPlatformTime::Cycles64() - StartCycles;
+
+				FString Line = FString::Printf(TEXT("%.6f,%d"), DeltaTime, Frame);
+				const float* ParameterValues = Model->GetParameterValueData();
+				for (int32 ParameterIndex = 0; ParameterIndex < ParameterCount; ParameterIndex++)
+				{
+					Line += FString::Printf(TEXT(",%.6f"), ParameterValues[ParameterIndex]);
+				}
+				OutRun.Trace.Add(MoveTemp(Line));
+			}
+
+			FResult& Result = OutRun.Results.AddDefaulted_GetRef();
+			Result.DeltaTime = DeltaTime;
+			Result.FrameCount = FrameCount;
+			Result.RigCount = RigCount;
+			Result.TotalMilliseconds = FPlatformTime::ToMilliseconds64(EvaluateCycles);
+			Result.NanosecondsPerRigStep = Result.TotalMilliseconds * 1000000.0 / (static_cast<double>(FrameCount) * RigCount);
+		}
+		return true;
+	}
+
+	bool CompareWithGolden(const FRun& Run, const float Tolerance, FString& OutError)
+	{
+		const FString GoldenFileName = GetGoldenFileName(Run.Name);
+		TArray<FString> GoldenTrace;
+		if (!FFileHelper::LoadFileToStringArray(GoldenTrace, *GoldenFileName))
+		{
+			OutError = FString::Printf(TEXT("%s has no golden trace %s, record it with Live2D.Physics.Benchmark WriteGolden and commit it"), *Run.Name, *GoldenFileName);
+			return false;
+		}
+
+		FString FirstMismatch;
+		const int32 MismatchCount = CompareTraces(Run.Trace, GoldenTrace, Tolerance, FirstMismatch);
+		if (MismatchCount > 0)
+		{
+			OutError = FString::Printf(TEXT("%s differs from its golden trace in %d values, first at %s"), *Run.Name, MismatchCount, *FirstMismatch);
+			return false;
+		}
+		return true;
+	}
+
+	void RunCommand(const TArray<FString>& Args)
+	{
+		if (Args.Num() == 0)
+		{
+			UE_LOG(LogLive2D, Error, TEXT("Live2DPhysicsBenchmark::RunCommand: Usage: Live2D.Physics.Benchmark <ModelPath or moc3 file> [Frames=600] [Synthetic=<RigCount>] [Physics=<physics3.json>] [Tolerance=0.0001] [WriteGolden]"));
+			return;
+		}
+
+		const FString Options = FString::Join(Args, TEXT(" "));
+		int32 FrameCount = 600;
+		int32 SyntheticRigCount = 0;
+		float Tolerance = 0.0001f;
+		FString Physics3FileName;
+		FParse::Value(*Options, TEXT("Frames="), FrameCount);
+		FParse::Value(*Options, TEXT("Synthetic="), SyntheticRigCount);
+		FParse::Value(*Options, TEXT("Tolerance="), Tolerance);
+		FParse::Value(*Options, TEXT("Physics="), Physics3FileName);
+		const bool bWriteGolden = FParse::Param(*Options, TEXT("WriteGolden"));
+		FrameCount = FMath::Max(1, FrameCount);
+
+		// Runs on a copy, so the asset keeps its physics and parameters. A moc3 file, such as the test model, is loaded without physics
+		ULive2DMocModel* Model = nullptr;
+		FString ModelName;
+		if (FPaths::GetExtension(Args[0]) == TEXT("moc3"))
+		{
+			Model = NewObject<ULive2DMocModel>(GetTransientPackage());
+			Model = Model->Init(Args[0]) ? Model : nullptr;
+			ModelName = FPaths::GetBaseFilename(Args[0]);
+		}
+		else if (const ULive2DMocModel* SourceModel = LoadObject<ULive2DMocModel>(nullptr, *Args[0]))
+		{
+			Model = DuplicateObject<ULive2DMocModel>(SourceModel, GetTransientPackage());
+			ModelName = SourceModel->GetName();
+		}
+		if (!Model)
+		{
+			UE_LOG(LogLive2D, Error, TEXT("Live2DPhysicsBenchmark::RunCommand: Model %s couldn't be loaded!"), *Args[0]);
+			return;
+		}
+
+		FRun BenchmarkRun;
+		if (!Run(Model, ModelName, Physics3FileName, SyntheticRigCount, FrameCount, BenchmarkRun))
+		{
+			return;
+		}
+
+		TArray<FString> Results;
+		Results.Add(TEXT("Model,DeltaTime,Frames,Rigs,TotalMs,NsPerRigStep"));
+		for (const FResult& Result: BenchmarkRun.Results)
+		{
+			Results.Add(FString::Printf(TEXT("%s,%.6f,%d,%d,%.3f,%.1f"), *BenchmarkRun.Name, Result.DeltaTime, Result.FrameCount, Result.RigCount, Result.TotalMilliseconds, Result.NanosecondsPerRigStep));
+			UE_LOG(LogLive2D, Display, TEXT("Live2DPhysicsBenchmark::RunCommand: %s at %.4fs: %.1f ns per rig per step"), *BenchmarkRun.Name, Result.DeltaTime, Result.NanosecondsPerRigStep);
+		}
+
+		const FString Directory = FPaths::ProjectSavedDir() / TEXT("Live2D") / TEXT("PhysicsBenchmark");
+		FFileHelper::SaveStringArrayToFile(BenchmarkRun.Trace, *(Directory / BenchmarkRun.Name + TEXT("_Trace.csv")));
+		FFileHelper::SaveStringArrayToFile(Results, *(Directory / BenchmarkRun.Name + TEXT("_Results.csv")));
+
+		if (bWriteGolden)
+		{
+			const FString GoldenFileName = GetGoldenFileName(BenchmarkRun.Name);
+			FFileHelper::SaveStringArrayToFile(BenchmarkRun.Trace, *GoldenFileName);
+			UE_LOG(LogLive2D, Display, TEXT("Live2DPhysicsBenchmark::RunCommand: Wrote golden trace %s"), *GoldenFileName);
+			return;
+		}
+
+		FString Error;
+		if (!CompareWithGolden(BenchmarkRun, Tolerance, Error))
+		{
+			UE_LOG(LogLive2D, Error, TEXT("Live2DPhysicsBenchmark::RunCommand: %s!"), *Error);
+		}
+		else
+		{
+			UE_LOG(LogLive2D, Display, TEXT("Live2DPhysicsBenchmark::RunCommand: %s matches its golden trace"), *BenchmarkRun.Name);
+		}
+	}
+}
+
+static FAutoConsoleCommand Live2DPhysicsBenchmarkCommand(
+	TEXT("Live2D.Physics.Benchmark"),
+	TEXT("Evaluates the physics of a model for a number of frames at several delta times, writes ns per rig per step and the parameter trace to Saved/Live2D/PhysicsBenchmark and compares the trace with the golden trace in Resources/Tests/Physics of the plugin."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&Live2DPhysicsBenchmark::RunCommand));
+
+#endif
@@ -0,0 +1,50 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if !UE_BUILD_SHIPPING
+
+class ULive2DMocModel;
+
+/** Physics benchmark and determinism check, shared by the Live2D.Physics.Benchmark command and the Live2D.Physics.Determinism automation test */
+namespace Live2DPhysicsBenchmark
+{
+	/** Timing of one delta time of a run */
+	struct FResult
+	{
+		float DeltaTime = 0.f;
+		int32 FrameCount = 0;
+		int32 RigCount = 0;
+		double TotalMilliseconds = 0.0;
+		double NanosecondsPerRigStep = 0.0;
+	};
+
+	struct FRun
+	{
+		/** Model name and physics source, names the trace and its golden trace */
+		FString Name;
+		/** Parameter values of every frame as csv, after a header line */
+		TArray<FString> Trace;
+		TArray<FResult> Results;
+	};
+
+	/** Directory of the test data, the committed sample physics3 files and, where added, a test model and its golden traces */
+	FString GetTestDataDir();
+	FString GetGoldenFileName(const FString& RunName);
+
+	/**
+	 * Evaluates physics on the model for a number of frames at every benchmark delta time, one step per frame with sleep and LOD off, whatever the console sets.
+	 * Runs the physics3 file if given, else synthetic rigs if a count is given, else the physics of the model. The model parameters are overwritten
+	 */
+	bool Run(ULive2DMocModel* Model, const FString& ModelName, const FString& Physics3FileName, const int32 SyntheticRigCount, const int32 FrameCount, FRun& OutRun);
+
+	/** Compares two traces value by value, returns the number of values further apart than the tolerance */
+	int32 CompareTraces(const TArray<FString>& Trace, const TArray<FString>& GoldenTrace, const float Tolerance, FString& OutFirstMismatch);
+
+	/** Compares the trace of a run with its golden trace, fails when they differ or there is no golden trace */
+	bool CompareWithGolden(const FRun& Run, const float Tolerance, FString& OutError);
+}
+
+#endif
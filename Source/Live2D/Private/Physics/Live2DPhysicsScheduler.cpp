@@ -0,0 +1,107 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Live2DPhysicsScheduler.h"
+
+#include "Live2D.h"
+#include "Live2DMocModel.h"
+#include "Live2DModelPhysics.h"
+#include "Async/ParallelFor.h"
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsScheduler(
+	TEXT("Live2D.Physics.Scheduler"),
+	1,
+	TEXT("Evaluates the physics of all ticking models together on the task graph once per frame, instead of each model in its own tick."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLive2DPhysicsSchedulerMinModels(
+	TEXT("Live2D.Physics.Scheduler.MinModels"),
+	2,
+	TEXT("Minimum number of models with physics in a frame for them to be simulated in parallel."),
+	ECVF_Default);
+
+bool ULive2DPhysicsScheduler::Schedule(ULive2DMocModel* Model, const float DeltaTime)
+{
+	if (!Model || CVarLive2DPhysicsScheduler.GetValueOnGameThread() == 0)
+	{
+		return false;
+	}
+
+	// A timer firing more than once in a frame accumulates its time into one evaluation
+	for (FScheduledModel& ScheduledModel: ScheduledModels)
+	{
+		if (ScheduledModel.Model == Model)
+		{
+			ScheduledModel.DeltaTime += DeltaTime;
+			return true;
+		}
+	}
+
+	FScheduledModel& ScheduledModel = ScheduledModels.AddDefaulted_GetRef();
+	ScheduledModel.Model = Model;
+	ScheduledModel.DeltaTime = DeltaTime;
+	return true;
+}
+
+void ULive2DPhysicsScheduler::Flush()
+{
+	FlushModels.Reset();
+	FlushPhysics.Reset();
+	FlushDeltaTimes.Reset();
+	for (const FScheduledModel& ScheduledModel: ScheduledModels)
+	{
+		ULive2DMocModel* Model = ScheduledModel.Model.Get();
+		ULive2DModelPhysics* Physics = Model ? Model->GetPhysicsSystem() : nullptr;
+		if (Physics)
+		{
+			FlushModels.Add(Model);
+			FlushPhysics.Add(Physics);
+			FlushDeltaTimes.Add(ScheduledModel.DeltaTime);
+		}
+	}
+	ScheduledModels.Reset();
+
+	for (ULive2DModelPhysics* Physics: FlushPhysics)
+	{
+		Physics->BeginEvaluate();
+	}
+
+	const bool bIsParallel = FlushPhysics.Num() >= FMath::Max(1, CVarLive2DPhysicsSchedulerMinModels.GetValueOnGameThread());
+	ParallelFor(FlushPhysics.Num(), [this](const int32 Index)
+	{
+		FlushPhysics[Index]->Simulate(FlushDeltaTimes[Index]);
+	}, bIsParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+
+	// Outputs are merged into the models before the model core updates the drawables
+	for (int32 Index = 0; Index < FlushModels.Num(); Index++)
+	{
+		FlushPhysics[Index]->EndEvaluate();
+		FlushModels[Index]->FinishTick();
+	}
+}
+
+void ULive2DPhysicsScheduler::Deinitialize()
+{
+	ScheduledModels.Empty();
+	Super::Deinitialize();
+}
+
+void ULive2DPhysicsScheduler::Tick(float DeltaTime)
+{
+	Flush();
+}
+
+ETickableTickType ULive2DPhysicsScheduler::GetTickableTickType() const
+{
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool ULive2DPhysicsScheduler::IsTickable() const
+{
+	return ScheduledModels.Num() > 0;
+}
+
+TStatId ULive2DPhysicsScheduler::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULive2DPhysicsScheduler, STATGROUP_Live2D);
+}
@@ -1,50 +1,37 @@
 ﻿#include "Live2DBatchedElements.h"
 #include "GlobalShader.h"
 #include "Live2DLogCategory.h"
+#include "PipelineStateCache.h"
+#include "RenderUtils.h"
 #include "ShaderParameterStruct.h"
 #include "ShaderParameterMacros.h"
+#include "ShaderPermutation.h"
 #include "SimpleElementShaders.h"
 #include "Engine/TextureRenderTarget2D.h"
 
-namespace
-{
-	float GAlphaRefVal = 128.f;
-}
-
-class FLive2DNormalShader : public FGlobalShader
+class FLive2DShader : public FGlobalShader
 {
 public:
-	DECLARE_EXPORTED_SHADER_TYPE(FLive2DNormalShader, Global, LIVE2D_API);
-	SHADER_USE_PARAMETER_STRUCT(FLive2DNormalShader, FGlobalShader);
+	DECLARE_EXPORTED_SHADER_TYPE(FLive2DShader, Global, LIVE2D_API);
+	SHADER_USE_PARAMETER_STRUCT(FLive2DShader, FGlobalShader);
+
+	class FDrawPassDim : SHADER_PERMUTATION_ENUM_CLASS("LIVE_2D_DRAW_PASS", ELive2DDrawPass);
+	class FInvertedMaskDim : SHADER_PERMUTATION_BOOL("LIVE_2D_INVERTED_MASK");
+	class FPremultipliedAlphaDim : SHADER_PERMUTATION_BOOL("LIVE_2D_PREMULTIPLIED_ALPHA");
+
+	using FPermutationDomain = TShaderPermutationDomain<FDrawPassDim, FInvertedMaskDim, FPremultipliedAlphaDim>;
 
 	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		return true;
+		const FPermutationDomain PermutationVector(Parameters.PermutationId);
+		return IsValidPermutation(PermutationVector);
 	}
 
-	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	static bool IsValidPermutation(const FPermutationDomain& PermutationVector)
 	{
-		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
-	}
-
-	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-		SHADER_PARAMETER_TEXTURE(Texture2D, InMainTexture)
-		SHADER_PARAMETER_SAMPLER(SamplerState, InMainTextureSampler)
-		SHADER_PARAMETER(float, InGamma)
-		SHADER_PARAMETER(float, InClipRef)
-		SHADER_PARAMETER(float, RenderOpacity)
-	END_SHADER_PARAMETER_STRUCT()
-};
-
-class FLive2DMaskedShader : public FGlobalShader
-{
-public:
-	DECLARE_EXPORTED_SHADER_TYPE(FLive2DMaskedShader, Global, LIVE2D_API);
-	SHADER_USE_PARAMETER_STRUCT(FLive2DMaskedShader, FGlobalShader);
-
-	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
-	{
-		return true;
+		// Inverting only applies to masks, and masks are written without premultiplying
+		const bool bIsMaskPass = PermutationVector.Get<FDrawPassDim>() == ELive2DDrawPass::Mask;
+		return bIsMaskPass ? !PermutationVector.Get<FPremultipliedAlphaDim>() : !PermutationVector.Get<FInvertedMaskDim>();
 	}
 
 	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
@@ -58,164 +45,204 @@ public:
 		SHADER_PARAMETER_TEXTURE(Texture2D, InMaskTexture)
 		SHADER_PARAMETER_SAMPLER(SamplerState, InMaskTextureSampler)
 		SHADER_PARAMETER(float, InGamma)
-		SHADER_PARAMETER(FVector2D, InMaskSize)
+		SHADER_PARAMETER(FVector2f, InMaskOffset)
+		SHADER_PARAMETER(FVector2f, InMaskSize)
 		SHADER_PARAMETER(float, InClipRef)
-		SHADER_PARAMETER(float, RenderOpacity)
 	END_SHADER_PARAMETER_STRUCT()
 };
 
-template<bool InvertedMask>
-class FLive2DMaskShader : public FGlobalShader
+IMPLEMENT_GLOBAL_SHADER(FLive2DShader, "/Plugin/UELive2D/Private/Live2DBatchedElements.usf", "MainPS", SF_Pixel);
+
+namespace
 {
-public:
-	DECLARE_EXPORTED_SHADER_TYPE(FLive2DMaskShader, Global, LIVE2D_API);
-	SHADER_USE_PARAMETER_STRUCT(FLive2DMaskShader, FGlobalShader);
+	float GAlphaRefVal = 128.f;
 
-	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	FLive2DShader::FPermutationDomain GetPermutationVector(ELive2DDrawPass DrawPass, const bool bInvertedMask, const bool bPremultipliedAlpha)
 	{
-		return true;
+		FLive2DShader::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FLive2DShader::FDrawPassDim>(DrawPass);
+		PermutationVector.Set<FLive2DShader::FInvertedMaskDim>(bInvertedMask);
+		PermutationVector.Set<FLive2DShader::FPremultipliedAlphaDim>(bPremultipliedAlpha);
+		return PermutationVector;
 	}
 
-	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	FRHIBlendState* GetBlendState(ELive2DDrawPass DrawPass, ESimpleElementBlendMode BlendMode, const bool bPremultipliedAlpha)
 	{
-		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
-		OutEnvironment.SetDefine(TEXT("LIVE_2D_INVERTED_MASK"), InvertedMask);
+		if (DrawPass == ELive2DDrawPass::Mask)
+		{
+			return TStaticBlendState<>::GetRHI();
+		}
+
+		if (bPremultipliedAlpha)
+		{
+			switch (BlendMode)
+			{
+			case SE_BLEND_Additive:
+				return TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_One, BO_Add, BF_Zero, BF_One>::GetRHI();
+			case SE_BLEND_Modulate:
+				return TStaticBlendState<CW_RGBA, BO_Add, BF_DestColor, BF_InverseSourceAlpha, BO_Add, BF_Zero, BF_One>::GetRHI();
+			case SE_BLEND_Masked:
+			default:
+				return TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_InverseSourceAlpha, BO_Add, BF_One, BF_InverseSourceAlpha>::GetRHI();
+			}
+		}
+
+		switch (BlendMode)
+		{
+		case SE_BLEND_Additive:
+			return TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_One, BO_Add, BF_One, BF_One>::GetRHI();
+		case SE_BLEND_Modulate:
+			if (DrawPass == ELive2DDrawPass::Masked)
+			{
+				return TStaticBlendState<CW_RGBA, BO_Add, BF_DestColor, BF_Zero, BO_Add, BF_DestAlpha, BF_Zero>::GetRHI();
+			}
+			return TStaticBlendState<CW_RGBA, BO_Add, BF_DestColor, BF_InverseDestColor, BO_Add, BF_DestAlpha, BF_InverseDestAlpha>::GetRHI();
+		case SE_BLEND_Masked:
+		default:
+			return TStaticBlendState<CW_RGBA, BO_Add, BF_SourceAlpha, BF_InverseSourceAlpha, BO_Add, BF_SourceAlpha, BF_InverseSourceAlpha>::GetRHI();
+		}
 	}
 
-	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-		SHADER_PARAMETER_TEXTURE(Texture2D, InMaskTexture)
-		SHADER_PARAMETER_SAMPLER(SamplerState, InMaskTextureSampler)
-		SHADER_PARAMETER(float, InGamma)
-		SHADER_PARAMETER(float, InClipRef)
-		SHADER_PARAMETER(float, RenderOpacity)
-	END_SHADER_PARAMETER_STRUCT()
-};
+	void SetupPipelineState(FGraphicsPipelineStateInitializer& GraphicsPSOInit, const TShaderMapRef<FSimpleElementVS>& VertexShader, const TShaderMapRef<FLive2DShader>& PixelShader,
+		ELive2DDrawPass DrawPass, ESimpleElementBlendMode BlendMode, const bool bPremultipliedAlpha)
+	{
+		GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GSimpleElementVertexDeclaration.VertexDeclarationRHI;
+		GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+		GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+		GraphicsPSOInit.PrimitiveType = PT_TriangleList;
+		GraphicsPSOInit.BlendState = GetBlendState(DrawPass, BlendMode, bPremultipliedAlpha);
+	}
+
+	void BindLive2DShaders(FRHICommandList& RHICmdList, FGraphicsPipelineStateInitializer& GraphicsPSOInit, ERHIFeatureLevel::Type InFeatureLevel, const FMatrix& InTransform,
+		ELive2DDrawPass DrawPass, ESimpleElementBlendMode BlendMode, const bool bInvertedMask, const bool bPremultipliedAlpha, const FLive2DShader::FParameters& PassParameters)
+	{
+		TShaderMapRef<FSimpleElementVS> VertexShader(GetGlobalShaderMap(InFeatureLevel));
+		TShaderMapRef<FLive2DShader> PixelShader(GetGlobalShaderMap(InFeatureLevel), GetPermutationVector(DrawPass, bInvertedMask, bPremultipliedAlpha));
 
+		SetupPipelineState(GraphicsPSOInit, VertexShader, PixelShader, DrawPass, BlendMode, bPremultipliedAlpha);
 
-IMPLEMENT_GLOBAL_SHADER(FLive2DNormalShader, "/Plugin/UELive2D/Private/Live2DNormalBatchedElements.usf", "MainPS", SF_Pixel);
-IMPLEMENT_GLOBAL_SHADER(FLive2DMaskedShader, "/Plugin/UELive2D/Private/Live2DMaskedBatchedElements.usf", "MainPS", SF_Pixel);
-IMPLEMENT_GLOBAL_SHADER(FLive2DMaskShader<true>, "/Plugin/UELive2D/Private/Live2DMaskBatchedElements.usf", "MainPS", SF_Pixel);
-IMPLEMENT_GLOBAL_SHADER(FLive2DMaskShader<false>, "/Plugin/UELive2D/Private/Live2DMaskBatchedElements.usf", "MainPS", SF_Pixel);
+		SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, EApplyRendertargetOption::CheckApply);
 
-void FLive2DNormalBatchedElements::BindShaders(FRHICommandList& RHICmdList, FGraphicsPipelineStateInitializer& GraphicsPSOInit, ERHIFeatureLevel::Type InFeatureLevel, const FMatrix& InTransform, const float InGamma, const FMatrix& ColorWeights, const FTexture* Texture)
-{	
-	TShaderMapRef<FSimpleElementVS> VertexShader(GetGlobalShaderMap(InFeatureLevel));
-	TShaderMapRef<FLive2DNormalShader> PixelShader(GetGlobalShaderMap(InFeatureLevel));
-	
-	GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GSimpleElementVertexDeclaration.VertexDeclarationRHI;
-	GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
-	GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
-	GraphicsPSOInit.PrimitiveType = PT_TriangleList;
-	switch (BlendMode)
+		VertexShader->SetParameters(RHICmdList, InTransform);
+		SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PassParameters);
+	}
+}
+
+void FLive2DPipelineStatePrecache::Precache(ERHIFeatureLevel::Type FeatureLevel, EPixelFormat RenderTargetFormat)
+{
+	// Every feature level and render target format pair only needs to be compiled once
+	static FCriticalSection PrecachedKeysCriticalSection;
+	static TSet<uint32> PrecachedKeys;
 	{
-	case SE_BLEND_Additive:
-		GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_One, BO_Add, BF_One, BF_One>::GetRHI();
-		break;
-	case SE_BLEND_Modulate:
-		GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_DestColor, BF_InverseDestColor, BO_Add, BF_DestAlpha, BF_InverseDestAlpha>::GetRHI();
-		break;
-	case SE_BLEND_Masked:
-	default:
-		GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_SourceAlpha, BF_InverseSourceAlpha, BO_Add, BF_SourceAlpha, BF_InverseSourceAlpha>::GetRHI();
-		break;
+		FScopeLock Lock(&PrecachedKeysCriticalSection);
+		bool bIsAlreadyPrecached = false;
+		PrecachedKeys.Add(((uint32)FeatureLevel << 16) | (uint32)RenderTargetFormat, &bIsAlreadyPrecached);
+		if (bIsAlreadyPrecached)
+		{
+			return;
+		}
 	}
-	
-	SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, EApplyRendertargetOption::ForceApply);
-	
-	VertexShader->SetParameters(RHICmdList, InTransform);
-	
-	FLive2DNormalShader::FParameters PassParameters;
+
+	ENQUEUE_RENDER_COMMAND(Live2DPrecachePipelineStates)([FeatureLevel, RenderTargetFormat](FRHICommandListImmediate& RHICmdList)
+	{
+		const ESimpleElementBlendMode BlendModes[] = { SE_BLEND_Masked, SE_BLEND_Additive, SE_BLEND_Modulate };
+		int32 PrecachedCount = 0;
+
+		for (int32 PermutationId = 0; PermutationId < FLive2DShader::FPermutationDomain::PermutationCount; PermutationId++)
+		{
+			const FLive2DShader::FPermutationDomain PermutationVector(PermutationId);
+			if (!FLive2DShader::IsValidPermutation(PermutationVector))
+			{
+				continue;
+			}
+
+			TShaderMapRef<FSimpleElementVS> VertexShader(GetGlobalShaderMap(FeatureLevel));
+			TShaderMapRef<FLive2DShader> PixelShader(GetGlobalShaderMap(FeatureLevel), PermutationVector);
+			const ELive2DDrawPass DrawPass = PermutationVector.Get<FLive2DShader::FDrawPassDim>();
+			const bool bPremultipliedAlpha = PermutationVector.Get<FLive2DShader::FPremultipliedAlphaDim>();
+
+			for (const ESimpleElementBlendMode BlendMode: BlendModes)
+			{
+				FGraphicsPipelineStateInitializer GraphicsPSOInit;
+				GraphicsPSOInit.RenderTargetsEnabled = 1;
+				GraphicsPSOInit.RenderTargetFormats[0] = RenderTargetFormat;
+				GraphicsPSOInit.NumSamples = 1;
+				GraphicsPSOInit.DepthStencilTargetFormat = PF_Unknown;
+				GraphicsPSOInit.RasterizerState = TStaticRasterizerState<FM_Solid, CM_None>::GetRHI();
+				GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+				SetupPipelineState(GraphicsPSOInit, VertexShader, PixelShader, DrawPass, BlendMode, bPremultipliedAlpha);
+
+				PipelineStateCache::GetAndOrCreateGraphicsPipelineState(RHICmdList, GraphicsPSOInit, EApplyRendertargetOption::DoNothing);
+				PrecachedCount++;
+
+				if (DrawPass == ELive2DDrawPass::Mask)
+				{
+					// Masks always use the same blend state
+					break;
+				}
+			}
+		}
+
+		UE_LOG(LogLive2D, Verbose, TEXT("Precached %d Live2D pipeline states"), PrecachedCount);
+	});
+}
+
+void FLive2DNormalBatchedElements::BindShaders(FRHICommandList& RHICmdList, FGraphicsPipelineStateInitializer& GraphicsPSOInit, ERHIFeatureLevel::Type InFeatureLevel, const FMatrix& InTransform, const float InGamma, const FMatrix& ColorWeights, const FTexture* Texture)
+{
+	FLive2DShader::FParameters PassParameters;
 	PassParameters.InMainTexture = Texture2D->GetResource()->TextureRHI;
 	PassParameters.InMainTextureSampler = Texture2D->GetResource()->SamplerStateRHI;
+	PassParameters.InMaskTexture = GBlackTexture->TextureRHI;
+	PassParameters.InMaskTextureSampler = GBlackTexture->SamplerStateRHI;
 	PassParameters.InGamma = InGamma;
+	PassParameters.InMaskOffset = FVector2f::ZeroVector;
+	PassParameters.InMaskSize = FVector2f::UnitVector;
 	PassParameters.InClipRef = GAlphaRefVal / 255.0f;
-	PassParameters.RenderOpacity = RenderOpacity;
-	SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PassParameters);
+
+	BindLive2DShaders(RHICmdList, GraphicsPSOInit, InFeatureLevel, InTransform, ELive2DDrawPass::Normal, BlendMode, false, bPremultipliedAlpha, PassParameters);
 }
 
 void FLive2DMaskedBatchedElements::BindShaders(FRHICommandList& RHICmdList, FGraphicsPipelineStateInitializer& GraphicsPSOInit, ERHIFeatureLevel::Type InFeatureLevel, const FMatrix& InTransform, const float InGamma, const FMatrix& ColorWeights, const FTexture* Texture)
-{	
-	TShaderMapRef<FSimpleElementVS> VertexShader(GetGlobalShaderMap(InFeatureLevel));
-	TShaderMapRef<FLive2DMaskedShader> PixelShader(GetGlobalShaderMap(InFeatureLevel));
-	
-	GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GSimpleElementVertexDeclaration.VertexDeclarationRHI;
-	GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
-	GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
-	GraphicsPSOInit.PrimitiveType = PT_TriangleList;
-	switch (BlendMode)
-	{
-	case SE_BLEND_Additive:
-		GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_One, BO_Add, BF_One, BF_One>::GetRHI();
-		break;
-	case SE_BLEND_Modulate:
-		GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_DestColor, BF_Zero, BO_Add, BF_DestAlpha, BF_Zero>::GetRHI();
-		break;
-	case SE_BLEND_Masked:
-	default:
-		GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_SourceAlpha, BF_InverseSourceAlpha, BO_Add, BF_SourceAlpha, BF_InverseSourceAlpha>::GetRHI();
-		break;
-	}
-	
-	SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, EApplyRendertargetOption::ForceApply);
-	
-	VertexShader->SetParameters(RHICmdList, InTransform);
-	
-	FLive2DMaskedShader::FParameters PassParameters;
+{
+	FLive2DShader::FParameters PassParameters;
 	PassParameters.InMainTexture = Texture2D->GetResource()->TextureRHI;
 	PassParameters.InMainTextureSampler = Texture2D->GetResource()->SamplerStateRHI;
 	PassParameters.InMaskTexture = MaskRenderTarget->GetResource()->TextureRHI;
 	PassParameters.InMaskTextureSampler = MaskRenderTarget->GetResource()->SamplerStateRHI;
-	PassParameters.InMaskSize = FVector2D(MaskRenderTarget->SizeX, MaskRenderTarget->SizeY);
+	PassParameters.InMaskOffset = FVector2f(MaskViewport.Min);
+	PassParameters.InMaskSize = FVector2f(MaskViewport.GetSize());
 	PassParameters.InGamma = InGamma;
 	PassParameters.InClipRef = GAlphaRefVal / 255.0f;
-	PassParameters.RenderOpacity = RenderOpacity;
-	SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PassParameters);
+
+	BindLive2DShaders(RHICmdList, GraphicsPSOInit, InFeatureLevel, InTransform, ELive2DDrawPass::Masked, BlendMode, false, bPremultipliedAlpha, PassParameters);
 }
 
 void FLive2DMaskBatchedElements::BindShaders(FRHICommandList& RHICmdList, FGraphicsPipelineStateInitializer& GraphicsPSOInit, ERHIFeatureLevel::Type InFeatureLevel, const FMatrix& InTransform, const float InGamma, const FMatrix& ColorWeights, const FTexture* Texture)
 {
-	TShaderMapRef<FSimpleElementVS> VertexShader(GetGlobalShaderMap(InFeatureLevel));
-	TShaderMapRef<FLive2DMaskShader<false>> PixelShader(GetGlobalShaderMap(InFeatureLevel));
-	
-	GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GSimpleElementVertexDeclaration.VertexDeclarationRHI;
-	GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
-	GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
-	GraphicsPSOInit.PrimitiveType = PT_TriangleList;
-	GraphicsPSOInit.BlendState = TStaticBlendState<>::GetRHI();
-	
-	SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, EApplyRendertargetOption::ForceApply);
-	
-	VertexShader->SetParameters(RHICmdList, InTransform);
-	
-	FLive2DMaskShader<false>::FParameters PassParameters;
+	FLive2DShader::FParameters PassParameters;
+	PassParameters.InMainTexture = GBlackTexture->TextureRHI;
+	PassParameters.InMainTextureSampler = GBlackTexture->SamplerStateRHI;
 	PassParameters.InMaskTexture = Texture2D->GetResource()->TextureRHI;
 	PassParameters.InMaskTextureSampler = Texture2D->GetResource()->SamplerStateRHI;
 	PassParameters.InGamma = InGamma;
+	PassParameters.InMaskOffset = FVector2f::ZeroVector;
+	PassParameters.InMaskSize = FVector2f::UnitVector;
 	PassParameters.InClipRef = GAlphaRefVal / 255.0f;
-	PassParameters.RenderOpacity = RenderOpacity;
-	SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PassParameters);
+
+	BindLive2DShaders(RHICmdList, GraphicsPSOInit, InFeatureLevel, InTransform, ELive2DDrawPass::Mask, SE_BLEND_Opaque, false, false, PassParameters);
 }
 
 void FLive2DInvertedMaskBatchedElements::BindShaders(FRHICommandList& RHICmdList, FGraphicsPipelineStateInitializer& GraphicsPSOInit, ERHIFeatureLevel::Type InFeatureLevel, const FMatrix& InTransform, const float InGamma, const FMatrix& ColorWeights, const FTexture* Texture)
-{	
-	TShaderMapRef<FSimpleElementVS> VertexShader(GetGlobalShaderMap(InFeatureLevel));
-	TShaderMapRef<FLive2DMaskShader<true>> PixelShader(GetGlobalShaderMap(InFeatureLevel));
-	
-	GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GSimpleElementVertexDeclaration.VertexDeclarationRHI;
-	GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
-	GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
-	GraphicsPSOInit.PrimitiveType = PT_TriangleList;
-	GraphicsPSOInit.BlendState = TStaticBlendState<>::GetRHI();
-	
-	SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, EApplyRendertargetOption::ForceApply);
-	
-	VertexShader->SetParameters(RHICmdList, InTransform);
-	
-	FLive2DMaskShader<true>::FParameters PassParameters;
+{
+	FLive2DShader::FParameters PassParameters;
+	PassParameters.InMainTexture = GBlackTexture->TextureRHI;
+	PassParameters.InMainTextureSampler = GBlackTexture->SamplerStateRHI;
 	PassParameters.InMaskTexture = Texture2D->GetResource()->TextureRHI;
 	PassParameters.InMaskTextureSampler = Texture2D->GetResource()->SamplerStateRHI;
 	PassParameters.InGamma = InGamma;
+	PassParameters.InMaskOffset = FVector2f::ZeroVector;
+	PassParameters.InMaskSize = FVector2f::UnitVector;
 	PassParameters.InClipRef = GAlphaRefVal / 255.0f;
-	PassParameters.RenderOpacity = RenderOpacity;
-	SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PassParameters);
+
+	BindLive2DShaders(RHICmdList, GraphicsPSOInit, InFeatureLevel, InTransform, ELive2DDrawPass::Mask, SE_BLEND_Opaque, true, false, PassParameters);
 }
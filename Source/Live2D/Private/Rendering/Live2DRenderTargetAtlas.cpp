@@ -0,0 +1,360 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Live2DRenderTargetAtlas.h"
+
+#include "CanvasItem.h"
+#include "Live2D.h"
+#include "Live2DBatchedElements.h"
+#include "Live2DMocModel.h"
+#include "Engine/Canvas.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Kismet/KismetRenderingLibrary.h"
+
+static TAutoConsoleVariable<int32> CVarLive2DAtlasPageSize(
+	TEXT("Live2D.Atlas.PageSize"),
+	2048,
+	TEXT("Width and height of the render target pages of the Live2D render target atlas."),
+	ECVF_Default);
+
+namespace
+{
+	/** Free texels between regions, keeps bilinear sampling of a brush from bleeding into its neighbours */
+	constexpr int32 GAtlasPadding = 2;
+}
+
+void ULive2DRenderTargetAtlas::AddModel(ULive2DMocModel* Model, const FVector2D& DisplaySize)
+{
+	if (!Model)
+	{
+		return;
+	}
+
+	// The model applies the render target scale and resize hysteresis, so regions only change when its render targets would
+	Model->SetDisplaySize(DisplaySize);
+	const FIntPoint Size = GetRegionSize(Model);
+
+	if (FAtlasEntry* ExistingEntry = FindEntry(Model))
+	{
+		if (ExistingEntry->Size != Size)
+		{
+			ExistingEntry->Size = Size;
+			bNeedsRepack = true;
+		}
+		return;
+	}
+
+	FAtlasEntry& Entry = Entries.AddDefaulted_GetRef();
+	Entry.Model = Model;
+	Entry.Size = Size;
+	Entry.DrawablesUpdatedHandle = Model->OnDrawablesUpdated.AddUObject(this, &ULive2DRenderTargetAtlas::OnModelDrawablesUpdated, Model);
+
+	if (bNeedsRepack || !Allocate(Entry))
+	{
+		bNeedsRepack = true;
+	}
+	else
+	{
+		UpdateBrush(Entry, false);
+	}
+}
+
+void ULive2DRenderTargetAtlas::RemoveModel(ULive2DMocModel* Model)
+{
+	const int32 EntryIndex = Entries.IndexOfByPredicate([Model](const FAtlasEntry& Entry)
+	{
+		return Entry.Model == Model;
+	});
+
+	if (EntryIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (Model)
+	{
+		Model->OnDrawablesUpdated.Remove(Entries[EntryIndex].DrawablesUpdatedHandle);
+	}
+
+	Entries.RemoveAtSwap(EntryIndex);
+	bNeedsRepack = true;
+}
+
+bool ULive2DRenderTargetAtlas::ContainsModel(const ULive2DMocModel* Model) const
+{
+	return Entries.ContainsByPredicate([Model](const FAtlasEntry& Entry)
+	{
+		return Entry.Model == Model;
+	});
+}
+
+void ULive2DRenderTargetAtlas::Deinitialize()
+{
+	for (FAtlasEntry& Entry: Entries)
+	{
+		if (ULive2DMocModel* Model = Entry.Model.Get())
+		{
+			Model->OnDrawablesUpdated.Remove(Entry.DrawablesUpdatedHandle);
+		}
+	}
+
+	Entries.Reset();
+	Pages.Reset();
+	PageAllocators.Reset();
+
+	Super::Deinitialize();
+}
+
+void ULive2DRenderTargetAtlas::Tick(float DeltaTime)
+{
+	// Destroyed models give their regions back
+	const int32 RemovedCount = Entries.RemoveAllSwap([](const FAtlasEntry& Entry)
+	{
+		return !Entry.Model.IsValid();
+	});
+	bNeedsRepack |= RemovedCount > 0;
+
+	if (bNeedsRepack)
+	{
+		Repack();
+	}
+
+	for (int32 PageIndex = 0; PageIndex < Pages.Num(); PageIndex++)
+	{
+		DrawPage(PageIndex);
+	}
+}
+
+ETickableTickType ULive2DRenderTargetAtlas::GetTickableTickType() const
+{
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool ULive2DRenderTargetAtlas::IsTickable() const
+{
+	return Entries.Num() > 0 || bNeedsRepack;
+}
+
+TStatId ULive2DRenderTargetAtlas::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULive2DRenderTargetAtlas, STATGROUP_Live2D);
+}
+
+FIntPoint ULive2DRenderTargetAtlas::GetRegionSize(const ULive2DMocModel* Model) const
+{
+	const int32 PageSize = CVarLive2DAtlasPageSize.GetValueOnGameThread();
+	const FVector2D RegionSize(Model->GetRenderTargetSize());
+
+	const float FitScale = FMath::Min(1.f, (PageSize - GAtlasPadding) / FMath::Max(RegionSize.X, RegionSize.Y));
+	return FIntPoint(FMath::Max(1, FMath::CeilToInt(RegionSize.X * FitScale)), FMath::Max(1, FMath::CeilToInt(RegionSize.Y * FitScale)));
+}
+
+bool ULive2DRenderTargetAtlas::Allocate(FAtlasEntry& Entry)
+{
+	FIntPoint Position;
+
+	for (int32 PageIndex = 0; PageIndex < PageAllocators.Num(); PageIndex++)
+	{
+		if (AllocateInPage(PageAllocators[PageIndex], Entry.Size, Position))
+		{
+			Entry.PageIndex = PageIndex;
+			Entry.Region = FIntRect(Position, Position + Entry.Size);
+			Entry.bIsDirty = true;
+			return true;
+		}
+	}
+
+	const int32 PageIndex = AddPage();
+	if (!AllocateInPage(PageAllocators[PageIndex], Entry.Size, Position))
+	{
+		return false;
+	}
+
+	Entry.PageIndex = PageIndex;
+	Entry.Region = FIntRect(Position, Position + Entry.Size);
+	Entry.bIsDirty = true;
+	return true;
+}
+
+bool ULive2DRenderTargetAtlas::AllocateInPage(FAtlasPage& Page, const FIntPoint& Size, FIntPoint& OutPosition) const
+{
+	const int32 PageSize = CVarLive2DAtlasPageSize.GetValueOnGameThread();
+	const FIntPoint PaddedSize = Size + FIntPoint(GAtlasPadding);
+
+	// Best fitting shelf, so small regions don't waste the height of tall shelves
+	FAtlasShelf* BestShelf = nullptr;
+	for (FAtlasShelf& Shelf: Page.Shelves)
+	{
+		if (Shelf.Height >= PaddedSize.Y && Shelf.CursorX + PaddedSize.X <= PageSize && (!BestShelf || Shelf.Height < BestShelf->Height))
+		{
+			BestShelf = &Shelf;
+		}
+	}
+
+	if (!BestShelf)
+	{
+		if (Page.NextShelfY + PaddedSize.Y > PageSize || PaddedSize.X > PageSize)
+		{
+			return false;
+		}
+
+		BestShelf = &Page.Shelves.AddDefaulted_GetRef();
+		BestShelf->Y = Page.NextShelfY;
+		BestShelf->Height = PaddedSize.Y;
+		Page.NextShelfY += PaddedSize.Y;
+	}
+
+	OutPosition = FIntPoint(BestShelf->CursorX, BestShelf->Y);
+	BestShelf->CursorX += PaddedSize.X;
+	return true;
+}
+
+int32 ULive2DRenderTargetAtlas::AddPage()
+{
+	const int32 PageSize = CVarLive2DAtlasPageSize.GetValueOnGameThread();
+
+	auto* RenderTarget = NewObject<UTextureRenderTarget2D>(this);
+	check(RenderTarget);
+	RenderTarget->TargetGamma = 1.f;
+	RenderTarget->RenderTargetFormat = RTF_RGBA8;
+	RenderTarget->ClearColor = FLinearColor::Transparent;
+	RenderTarget->bAutoGenerateMips = false;
+	RenderTarget->InitAutoFormat(PageSize, PageSize);
+	RenderTarget->UpdateResourceImmediate(true);
+
+	FLive2DPipelineStatePrecache::Precache(GMaxRHIFeatureLevel, RenderTarget->GetFormat());
+
+	Pages.Add(RenderTarget);
+	return PageAllocators.AddDefaulted();
+}
+
+void ULive2DRenderTargetAtlas::Repack()
+{
+	bNeedsRepack = false;
+
+	for (FAtlasPage& Page: PageAllocators)
+	{
+		Page.Shelves.Reset();
+		Page.NextShelfY = 0;
+	}
+
+	// Tallest first gives the shelf packer its best fill rate
+	Entries.Sort([](const FAtlasEntry& l, const FAtlasEntry& r)
+	{
+		return l.Size.Y > r.Size.Y;
+	});
+
+	for (FAtlasEntry& Entry: Entries)
+	{
+		const int32 PreviousPageIndex = Entry.PageIndex;
+		const FIntRect PreviousRegion = Entry.Region;
+
+		if (!Allocate(Entry))
+		{
+			Entry.PageIndex = INDEX_NONE;
+			continue;
+		}
+
+		// The region content is lost with the move, the brush follows
+		UpdateBrush(Entry, Entry.PageIndex != PreviousPageIndex || Entry.Region != PreviousRegion);
+	}
+
+	// Pages left empty by the repack are released
+	int32 UsedPageCount = 0;
+	for (const FAtlasEntry& Entry: Entries)
+	{
+		UsedPageCount = FMath::Max(UsedPageCount, Entry.PageIndex + 1);
+	}
+	Pages.SetNum(UsedPageCount);
+	PageAllocators.SetNum(UsedPageCount);
+
+	for (int32 PageIndex = 0; PageIndex < Pages.Num(); PageIndex++)
+	{
+		UKismetRenderingLibrary::ClearRenderTarget2D(GWorld, Pages[PageIndex], FLinearColor::Transparent);
+	}
+	for (FAtlasEntry& Entry: Entries)
+	{
+		Entry.bIsDirty = true;
+	}
+}
+
+void ULive2DRenderTargetAtlas::UpdateBrush(FAtlasEntry& Entry, const bool bBroadcast)
+{
+	ULive2DMocModel* Model = Entry.Model.Get();
+	if (!Model || !Pages.IsValidIndex(Entry.PageIndex))
+	{
+		return;
+	}
+
+	const FVector2D PageSize(Pages[Entry.PageIndex]->SizeX, Pages[Entry.PageIndex]->SizeY);
+
+	Model->AtlasBrush.SetResourceObject(Pages[Entry.PageIndex]);
+	Model->AtlasBrush.SetUVRegion(FBox2D(FVector2D(Entry.Region.Min) / PageSize, FVector2D(Entry.Region.Max) / PageSize));
+	Model->AtlasBrush.ImageSize = Model->GetDisplaySize();
+	Model->AtlasBrush.DrawAs = ESlateBrushDrawType::Image;
+	Model->AtlasBrush.TintColor = FLinearColor::White;
+
+	if (bBroadcast)
+	{
+		Model->OnAtlasBrushChanged.Broadcast();
+	}
+}
+
+void ULive2DRenderTargetAtlas::DrawPage(const int32 PageIndex)
+{
+	TArray<FAtlasEntry*, TInlineAllocator<16>> DirtyEntries;
+	for (FAtlasEntry& Entry: Entries)
+	{
+		if (Entry.bIsDirty && Entry.PageIndex == PageIndex)
+		{
+			DirtyEntries.Add(&Entry);
+		}
+	}
+
+	if (DirtyEntries.Num() == 0)
+	{
+		return;
+	}
+
+	// Masks and static layers first, after them the page is drawn without leaving its render pass
+	for (FAtlasEntry* Entry: DirtyEntries)
+	{
+		Entry->Model->PrepareDrawToCanvas();
+	}
+
+	UWorld* World = GWorld;
+	UCanvas* Canvas;
+	FVector2D Size;
+	FDrawToRenderTargetContext Context;
+	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(World, Pages[PageIndex], Canvas, Size, Context);
+
+	for (FAtlasEntry* Entry: DirtyEntries)
+	{
+		const FBox2D Region(FVector2D(Entry->Region.Min), FVector2D(Entry->Region.Max));
+
+		FCanvasTileItem ClearItem(Region.Min, Region.GetSize(), FLinearColor::Transparent);
+		ClearItem.BlendMode = SE_BLEND_Opaque;
+		Canvas->DrawItem(ClearItem);
+
+		Entry->Model->DrawToCanvas(Canvas, Region);
+		Entry->bIsDirty = false;
+	}
+
+	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(World, Context);
+}
+
+void ULive2DRenderTargetAtlas::OnModelDrawablesUpdated(ULive2DMocModel* Model)
+{
+	if (FAtlasEntry* Entry = FindEntry(Model))
+	{
+		Entry->bIsDirty = true;
+	}
+}
+
+ULive2DRenderTargetAtlas::FAtlasEntry* ULive2DRenderTargetAtlas::FindEntry(const ULive2DMocModel* Model)
+{
+	return Entries.FindByPredicate([Model](const FAtlasEntry& Entry)
+	{
+		return Entry.Model == Model;
+	});
+}
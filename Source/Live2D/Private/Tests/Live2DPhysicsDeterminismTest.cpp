@@ -0,0 +1,217 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Async/ParallelFor.h"
+#include "JsonObjectConverter.h"
+#include "Live2DMocModel.h"
+#include "Live2DModelPhysics.h"
+#include "Live2DModelPhysicsSolver.h"
+#include "Live2DPhysicsBenchmark.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLive2DPhysicsDeterminismTest, "Live2D.Physics.Determinism",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+namespace
+{
+	constexpr float AirResistance = 5.0f;
+	constexpr float MovementThreshold = 0.001f;
+
+	/** Rigs of the physics settings of a physics3 file, repeated and spread over two waves so that batches are partly filled */
+	void CreateRigs(const FPhysics3FileData& Physics3FileData, const int32 CopyCount, TArray<FLive2DModelPhysicsRig>& OutRigs, TArray<int32>& OutRigWaves)
+	{
+		for (int32 CopyIndex = 0; CopyIndex < CopyCount; CopyIndex++)
+		{
+			for (const FPhysics3PhysicsSettingsData& Settings: Physics3FileData.PhysicsSettings)
+			{
+				FLive2DModelPhysicsRig PhysicsRig;
+				PhysicsRig.Normalization = Settings.Normalization;
+
+				// Strands start hanging straight down, like ULive2DModelPhysics::InitializeParticles places them
+				FVector2D InitialPosition = FVector2D::ZeroVector;
+				for (int32 VertexIndex = 0; VertexIndex < Settings.Vertices.Num(); VertexIndex++)
+				{
+					const FPhysics3PhysicsVertexData& Vertex = Settings.Vertices[VertexIndex];
+					if (VertexIndex > 0)
+					{
+						InitialPosition.Y += Vertex.Radius;
+					}
+
+					FLive2dModelPhysicsParticle Particle;
+					Particle.InitialPosition = InitialPosition;
+					Particle.Position = InitialPosition;
+					Particle.LastPosition = InitialPosition;
+					Particle.LastGravity = FVector2D(0.0f, 1.0f);
+					Particle.Force = FVector2D::ZeroVector;
+					Particle.Velocity = FVector2D::ZeroVector;
+					Particle.Mobility = Vertex.Mobility;
+					Particle.Delay = Vertex.Delay;
+					Particle.Acceleration = Vertex.Acceleration;
+					Particle.Radius = Vertex.Radius;
+					PhysicsRig.Particles.Add(Particle);
+				}
+				OutRigs.Add(PhysicsRig);
+				OutRigWaves.Add(OutRigs.Num() % 2);
+			}
+		}
+	}
+
+	/**
+	 * Particle positions of every step of the rigs at a delta time, with the roots swaying by time.
+	 * Batches of a wave are solved in parallel or in order, and the state is saved and loaded into a rebuilt solver at RestoreFrame
+	 */
+	TArray<float> RunSolver(const TArray<FLive2DModelPhysicsRig>& Rigs, const TArray<int32>& RigWaves, const FVector2D& Wind, const float DeltaTime, const int32 FrameCount,
+		const bool bIsParallel, const int32 RestoreFrame = INDEX_NONE)
+	{
+		FLive2DModelPhysicsSolver Solver;
+		Solver.Build(Rigs, RigWaves);
+
+		TArray<float> Trace;
+		for (int32 Frame = 0; Frame < FrameCount; Frame++)
+		{
+			if (Frame == RestoreFrame)
+			{
+				TArray<uint8> State;
+				FMemoryWriter Writer(State);
+				Solver.SerializeState(Writer);
+
+				Solver = FLive2DModelPhysicsSolver();
+				Solver.Build(Rigs, RigWaves);
+				FMemoryReader Reader(State);
+				Solver.SerializeState(Reader);
+			}
+
+			const float Time = Frame * DeltaTime;
+			for (int32 WaveIndex = 0; WaveIndex < Solver.GetWaveCount(); WaveIndex++)
+			{
+				const int32 FirstBatch = Solver.GetWaveFirstBatch(WaveIndex);
+				const int32 BatchCount = Solver.GetWaveLastBatch(WaveIndex) - FirstBatch + 1;
+				ParallelFor(BatchCount, [&Solver, &Rigs, &Wind, FirstBatch, DeltaTime, Time](const int32 BatchOffset)
+				{
+					const int32 BatchIndex = FirstBatch + BatchOffset;
+					for (const int32 RigIndex: Solver.GetBatch(BatchIndex).RigIndices)
+					{
+						if (RigIndex == INDEX_NONE)
+						{
+							continue;
+						}
+
+						const FPhysics3PhysicsNormalizationData& Normalization = Rigs[RigIndex].Normalization;
+						const FVector2D RootPosition(0.5f * Normalization.Position.Maximum * FMath::Sin(4.4f * Time + RigIndex), 0.f);
+						const float TotalAngle = 0.5f * Normalization.Angle.Maximum * FMath::Sin(2.5f * Time + 0.5f * RigIndex);
+						Solver.SetRigInput(RigIndex, RootPosition, TotalAngle, MovementThreshold * Normalization.Position.Maximum);
+					}
+					Solver.Solve(BatchIndex, Wind, DeltaTime, AirResistance);
+				}, bIsParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+			}
+
+			for (int32 RigIndex = 0; RigIndex < Rigs.Num(); RigIndex++)
+			{
+				for (int32 ParticleIndex = 0; ParticleIndex < Rigs[RigIndex].Particles.Num(); ParticleIndex++)
+				{
+					const FVector2D Position = Solver.GetParticlePosition(RigIndex, ParticleIndex);
+					Trace.Add(Position.X);
+					Trace.Add(Position.Y);
+				}
+			}
+		}
+		return Trace;
+	}
+}
+
+/**
+ * Solves the rigs of the committed sample physics at several delta times and fails when running again, in parallel or from a saved state
+ * doesn't reproduce the trace exactly. With a test model in Resources/Tests/Physics, also runs the physics benchmark on it twice,
+ * compares the traces with their golden traces where those are committed and reports ns per rig per step of every run
+ */
+bool FLive2DPhysicsDeterminismTest::RunTest(const FString& Parameters)
+{
+	constexpr int32 FrameCount = 600;
+	constexpr int32 RigCopyCount = 5;
+	constexpr int32 SyntheticRigCount = 64;
+	constexpr float Tolerance = 0.0001f;
+
+	const FString TestDataDir = Live2DPhysicsBenchmark::GetTestDataDir();
+	const FString Physics3FileName = TestDataDir / TEXT("Sample.physics3.json");
+	FString JsonString;
+	FPhysics3FileData Physics3FileData;
+	if (!FFileHelper::LoadFileToString(JsonString, *Physics3FileName) || !FJsonObjectConverter::JsonObjectStringToUStruct<FPhysics3FileData>(JsonString, &Physics3FileData, 0, 0))
+	{
+		AddError(FString::Printf(TEXT("Sample physics %s couldn't be loaded"), *Physics3FileName));
+		return false;
+	}
+
+	TArray<FLive2DModelPhysicsRig> Rigs;
+	TArray<int32> RigWaves;
+	CreateRigs(Physics3FileData, RigCopyCount, Rigs, RigWaves);
+	const FVector2D Wind = Physics3FileData.Meta.EffectiveForces.Wind;
+	for (const float DeltaTime: { 1.f / 30.f, 1.f / 60.f, 1.f / 144.f })
+	{
+		const TArray<float> Trace = RunSolver(Rigs, RigWaves, Wind, DeltaTime, FrameCount, false);
+		TestTrue(FString::Printf(TEXT("Solver trace at %.4fs repeats"), DeltaTime), RunSolver(Rigs, RigWaves, Wind, DeltaTime, FrameCount, false) == Trace);
+		TestTrue(FString::Printf(TEXT("Solver trace at %.4fs repeats in parallel"), DeltaTime), RunSolver(Rigs, RigWaves, Wind, DeltaTime, FrameCount, true) == Trace);
+		TestTrue(FString::Printf(TEXT("Solver trace at %.4fs repeats from a saved state"), DeltaTime), RunSolver(Rigs, RigWaves, Wind, DeltaTime, FrameCount, true, FrameCount / 2) == Trace);
+	}
+
+	// The model runs need a moc3, which is only there when it was added to the test data with its golden traces
+	const FString MocFileName = TestDataDir / TEXT("TestModel.moc3");
+	if (!FPaths::FileExists(MocFileName))
+	{
+		AddInfo(FString::Printf(TEXT("No test model %s, skipped the model runs"), *MocFileName));
+		return !HasAnyErrors();
+	}
+
+	ULive2DMocModel* Model = NewObject<ULive2DMocModel>(GetTransientPackage());
+	if (!TestTrue(TEXT("Test model loads"), Model->Init(MocFileName)))
+	{
+		return false;
+	}
+
+	const TPair<FString, int32> Cases[] = {
+		{ Physics3FileName, 0 },
+		{ FString(), SyntheticRigCount },
+	};
+	for (const TPair<FString, int32>& Case: Cases)
+	{
+		Live2DPhysicsBenchmark::FRun Run;
+		Live2DPhysicsBenchmark::FRun RepeatedRun;
+		if (!Live2DPhysicsBenchmark::Run(Model, TEXT("TestModel"), Case.Key, Case.Value, FrameCount, Run)
+			|| !Live2DPhysicsBenchmark::Run(Model, TEXT("TestModel"), Case.Key, Case.Value, FrameCount, RepeatedRun))
+		{
+			AddError(FString::Printf(TEXT("Physics %s couldn't be run"), Case.Key.IsEmpty() ? TEXT("with synthetic rigs") : *Case.Key));
+			continue;
+		}
+
+		for (const Live2DPhysicsBenchmark::FResult& Result: Run.Results)
+		{
+			AddInfo(FString::Printf(TEXT("%s at %.4fs: %.1f ns per rig per step, %d rigs"), *Run.Name, Result.DeltaTime, Result.NanosecondsPerRigStep, Result.RigCount));
+		}
+
+		FString FirstMismatch;
+		const int32 MismatchCount = Live2DPhysicsBenchmark::CompareTraces(RepeatedRun.Trace, Run.Trace, 0.f, FirstMismatch);
+		if (MismatchCount > 0)
+		{
+			AddError(FString::Printf(TEXT("%s differs when run again in %d values, first at %s"), *Run.Name, MismatchCount, *FirstMismatch));
+		}
+
+		if (!FPaths::FileExists(Live2DPhysicsBenchmark::GetGoldenFileName(Run.Name)))
+		{
+			AddInfo(FString::Printf(TEXT("%s has no golden trace, skipped the comparison"), *Run.Name));
+			continue;
+		}
+
+		FString Error;
+		if (!Live2DPhysicsBenchmark::CompareWithGolden(Run, Tolerance, Error))
+		{
+			AddError(Error);
+		}
+	}
+	return !HasAnyErrors();
+}
+
+#endif
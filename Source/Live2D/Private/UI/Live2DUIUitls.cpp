@@ -3,14 +3,35 @@
 
 #include "Live2DUIUitls.h"
 
+#include "Live2DRenderTargetAtlas.h"
 #include "Components/Image.h"
 #include "Engine/AssetManager.h"
+#include "Engine/Engine.h"
 
 void ULive2DUIUitls::SetBrushFromLive2DModelMotion(UImage* Image, ULive2DModelMotion* ModelMotion)
 {
 	Image->SetBrush(ModelMotion->GetModel()->GetImageBrush());
 }
 
+void ULive2DUIUitls::SetLive2DModelMotionDisplaySize(ULive2DModelMotion* ModelMotion, const FVector2D DisplaySize)
+{
+	ModelMotion->GetModel()->SetDisplaySize(DisplaySize);
+}
+
+void ULive2DUIUitls::SetBrushFromLive2DModelMotionAtlas(UImage* Image, ULive2DModelMotion* ModelMotion, const FVector2D DisplaySize)
+{
+	ULive2DMocModel* Model = ModelMotion->GetModel();
+	GEngine->GetEngineSubsystem<ULive2DRenderTargetAtlas>()->AddModel(Model, DisplaySize);
+	Image->SetBrush(Model->AtlasBrush);
+
+	// The brush is copied into the image, so it has to be set again whenever the atlas moves the model
+	Model->OnAtlasBrushChanged.RemoveAll(Image);
+	Model->OnAtlasBrushChanged.AddWeakLambda(Image, [Image, Model]()
+	{
+		Image->SetBrush(Model->AtlasBrush);
+	});
+}
+
 void ULive2DUIUitls::SetBrushFromSoftLive2DModelMotion(UImage* Image, TSoftObjectPtr<ULive2DModelMotion> ModelMotion)
 {
 	if (ULive2DModelMotion* StrongModelMotion = ModelMotion.Get())
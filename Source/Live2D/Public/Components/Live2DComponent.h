@@ -0,0 +1,132 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/MeshComponent.h"
+#include "Live2DStructs.h"
+#include "Live2DComponent.generated.h"
+
+class ULive2DMocModel;
+class UMaterialInstanceDynamic;
+class UTextureRenderTarget2D;
+struct FLive2DModelDrawable;
+struct FLive2DComponentDynamicData;
+class FLive2DComponentDynamicDataPool;
+
+/**
+ * Renders a Live2D model directly in the world as a dynamic mesh, without an intermediate render target.
+ * The model lies in the component's YZ plane and faces +X; drawables are layered along +X in render order.
+ *
+ * The material is expected to be translucent, to sample TextureParameterName with UV0 and to multiply its opacity by the vertex color alpha.
+ * The masked material additionally samples MaskParameterName with UV1 and multiplies the opacity by its alpha.
+ * Drawables with additive or multiplicative blending use the additive and multiply materials, which are expected to use the Additive and Modulate blend modes.
+ * Masks are not resolved in the mesh pass, each masked drawable's masks are still drawn into its masking render target on the model whenever the model updates.
+ */
+UCLASS(ClassGroup=(Rendering), meta=(BlueprintSpawnableComponent))
+class LIVE2D_API ULive2DComponent : public UMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	ULive2DComponent();
+
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	void SetModel(ULive2DMocModel* InModel);
+	
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	ULive2DMocModel* GetModel() const { return Model; }
+
+	//~ Begin UPrimitiveComponent Interface
+	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
+	virtual int32 GetNumMaterials() const override;
+	virtual UMaterialInterface* GetMaterial(int32 ElementIndex) const override;
+	//~ End UPrimitiveComponent Interface
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	UMaterialInterface* Material;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	UMaterialInterface* MaskedMaterial;
+
+	/** Material of drawables with additive blending, Material is used when unset */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	UMaterialInterface* AdditiveMaterial;
+
+	/** Material of drawables with multiplicative blending, Material is used when unset */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	UMaterialInterface* MultiplyMaterial;
+
+	/** Material of masked drawables with additive blending, MaskedMaterial is used when unset */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	UMaterialInterface* MaskedAdditiveMaterial;
+
+	/** Material of masked drawables with multiplicative blending, MaskedMaterial is used when unset */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	UMaterialInterface* MaskedMultiplyMaterial;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	FName TextureParameterName = TEXT("Live2DTexture");
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	FName MaskParameterName = TEXT("Live2DMask");
+
+	/** World units per model canvas pixel */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D", meta=(ClampMin="0.0"))
+	float UnitsPerPixel = 1.f;
+
+	/** Distance between two consecutive drawables along the facing axis, keeps depth tested materials in render order */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D", meta=(ClampMin="0.0"))
+	float LayerSeparation = 0.01f;
+
+protected:
+	//~ Begin UActorComponent Interface
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+	virtual void CreateRenderState_Concurrent(FRegisterComponentContext* Context) override;
+	virtual void SendRenderDynamicData_Concurrent() override;
+	//~ End UActorComponent Interface
+
+	virtual void BindToModel();
+	virtual void UnbindFromModel();
+	virtual void CreateMaterialInstances();
+	virtual void UpdateLocalBounds();
+	/** Fills recycled dynamic data with the models that changed, or with every model for a new scene proxy */
+	virtual void FillDynamicData(FLive2DComponentDynamicData& DynamicData, const bool bIsFullUpdate);
+	void SendDynamicData(const bool bIsFullUpdate);
+	void OnDrawablesUpdated();
+	void CreateTextureMaterialInstances();
+	UMaterialInstanceDynamic* CreateMaskedMaterialInstance(const FLive2DModelDrawable& Drawable, UTextureRenderTarget2D* MaskRenderTarget);
+
+	/** World units per model unit */
+	float GetVertexScale() const;
+	FVector3f GetLocalVertexPosition(const FVector2f& ModelVertex, const int32 Layer, const float Scale) const;
+	UMaterialInterface* GetDrawableMaterial(const FLive2DModelDrawable& Drawable) const;
+	/** Material instance of an unmasked drawable, for its texture and blend mode */
+	UMaterialInterface* GetTextureMaterialInstance(const FLive2DModelDrawable& Drawable) const;
+	UMaterialInterface* GetBaseMaterial(const ELive2dModelBlendMode BlendMode, const bool bIsMasked) const;
+	static int32 GetTextureMaterialKey(const FLive2DModelDrawable& Drawable);
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	ULive2DMocModel* Model;
+
+	/** One material instance per model texture and blend mode of the unmasked drawables, by GetTextureMaterialKey */
+	UPROPERTY(Transient)
+	TMap<int32, UMaterialInstanceDynamic*> TextureMaterialInstances;
+
+	/** One material instance per masked drawable, bound to the drawable's masking render target */
+	UPROPERTY(Transient)
+	TMap<int32, UMaterialInstanceDynamic*> MaskedMaterialInstances;
+
+	FBox LocalBounds;
+	FDelegateHandle DrawablesUpdatedHandle;
+
+	/** Shared with the scene proxy, which returns the dynamic data it replaced */
+	TSharedPtr<FLive2DComponentDynamicDataPool, ESPMode::ThreadSafe> DynamicDataPool;
+};
@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Live2DComponent.h"
+#include "Live2DInstancedComponent.generated.h"
+
+struct FLive2DComponentModelData;
+struct FLive2DModelCanvasInfo;
+
+USTRUCT(BlueprintType)
+struct FLive2DModelInstance
+{
+	GENERATED_BODY()
+
+	/** Model holding the pose of this instance, must be created from the same moc as the component model */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	ULive2DMocModel* Model = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	FTransform Transform;
+};
+
+/**
+ * Renders many posed copies of one Live2D model as a single primitive.
+ * The component model provides the textures, UVs and indices that are shared by every instance.
+ *
+ * This is not GPU instancing, each instance is assembled on the CPU in component space, and only the instances that were posed or moved are rebuilt.
+ * The same drawable of all instances is drawn in one batch, with the instances back to front inside it, so the draw calls don't grow with the instance count.
+ * Masked drawables sample the masks of their own instance and stay one batch per instance.
+ * Drawables are layered in render order across all instances, so where instances overlap a front layer of the back instance can cover a back layer of the front one.
+ */
+UCLASS(ClassGroup=(Rendering), meta=(BlueprintSpawnableComponent))
+class LIVE2D_API ULive2DInstancedComponent : public ULive2DComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Adds an instance and returns its index, or INDEX_NONE if the model doesn't match the component model */
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	int32 AddInstance(ULive2DMocModel* InstanceModel, const FTransform& InstanceTransform);
+
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	bool RemoveInstance(const int32 InstanceIndex);
+
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	bool UpdateInstanceTransform(const int32 InstanceIndex, const FTransform& InstanceTransform);
+
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	void ClearInstances();
+
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	int32 GetInstanceCount() const { return Instances.Num(); }
+
+	//~ Begin UPrimitiveComponent Interface
+	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
+	virtual int32 GetNumMaterials() const override;
+	virtual UMaterialInterface* GetMaterial(int32 ElementIndex) const override;
+	//~ End UPrimitiveComponent Interface
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+protected:
+	//~ Begin ULive2DComponent Interface
+	virtual void BindToModel() override;
+	virtual void UnbindFromModel() override;
+	virtual void CreateMaterialInstances() override;
+	virtual void UpdateLocalBounds() override;
+	virtual void FillDynamicData(FLive2DComponentDynamicData& DynamicData, const bool bIsFullUpdate) override;
+	//~ End ULive2DComponent Interface
+
+	void FillInstanceModelData(const int32 InstanceIndex, FLive2DComponentModelData& ModelData, const FLive2DModelCanvasInfo& CanvasInfo, const float Scale) const;
+	void MarkInstanceNeedsUpdate(const int32 InstanceIndex);
+	bool IsCompatibleModel(const ULive2DMocModel* InstanceModel) const;
+	void BindInstance(const int32 InstanceIndex);
+	void UnbindInstance(const int32 InstanceIndex);
+	void OnInstanceDrawablesUpdated(ULive2DMocModel* InstanceModel);
+	void CreateInstanceMaterialInstances(const FLive2DModelInstance& Instance);
+	FBox CalcInstanceLocalBounds(const FLive2DModelInstance& Instance, const float Scale) const;
+	void CacheSharedVertexData();
+	UMaterialInterface* GetInstanceDrawableMaterial(const FLive2DModelInstance& Instance, const FLive2DModelDrawable& Drawable) const;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Live 2D")
+	TArray<FLive2DModelInstance> Instances;
+
+	/** Masked material instances per instance masking render target */
+	UPROPERTY(Transient)
+	TMap<UTextureRenderTarget2D*, UMaterialInstanceDynamic*> InstanceMaskedMaterialInstances;
+
+	/** Delegate handles parallel to Instances */
+	TArray<FDelegateHandle> InstanceDrawablesUpdatedHandles;
+
+	/** Local bounds parallel to Instances */
+	TArray<FBox> InstanceLocalBounds;
+
+	/** Instances whose pose or transform changed since the dynamic data was last sent, parallel to Instances */
+	TArray<bool> InstanceNeedsUpdate;
+
+	/** UV0 per unsorted drawable, shared by all instances */
+	TArray<TArray<FVector2f>> SharedVertexUVs;
+};
@@ -8,6 +8,8 @@
 #include "UObject/Object.h"
 #include "Engine/Texture2D.h"
 #include "Kismet/KismetRenderingLibrary.h"
+#include "BatchedElements.h"
+#include "CanvasItem.h"
 #include "Live2DMocModel.generated.h"
 
 class ULive2DModelPhysics;
@@ -29,22 +31,73 @@ public:
 
 	virtual void Serialize(FArchive& Ar) override;
 
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
 	float GetModelWidth() const;
 	float GetModelHeight() const;
 	FVector2D GetModelSize() const;
+	FLive2DModelCanvasInfo GetModelCanvasInfo() const;
+
+	/** Sets the size the model is displayed at, its render targets are sized from it. Zero displays the model at its canvas size */
+	void SetDisplaySize(const FVector2D& InDisplaySize);
+	FVector2D GetDisplaySize() const;
+
+	/** Render target resolution relative to the display size, from RenderTargetScale or Live2D.RenderTargetScale */
+	float GetRenderTargetScale() const;
+	FIntPoint GetRenderTargetSize() const { return RenderTargetSize; }
 
 	ULive2DModelPhysics* GetPhysicsSystem();;
 
 	void UpdateDrawables();
 
+	/** Runs the model core on the current parameters and part opacities without updating the drawables */
+	void EvaluateDrawableOutputs(FLive2DModelDrawableOutputs& OutOutputs);
+
+	/** Updates the drawables from outputs evaluated earlier instead of the model core. Called from OnModelTick it replaces the core update of that tick */
+	void SetDrawableOutputs(const FLive2DModelDrawableOutputs& Outputs);
+
+	/** Redraws the masking render targets of all visible masked drawables, for renderers that don't go through the model render target */
+	void UpdateMaskingRenderTargets();
+	UTextureRenderTarget2D* GetMaskingRenderTarget(const FLive2DModelDrawable& Drawable) const;
+
+	/** Updates the masking render targets and bakes the static layers, has to be called before DrawToCanvas outside of a canvas pass */
+	void PrepareDrawToCanvas();
+
+	/** Draws the visible drawables scaled into Rect of a canvas that is being drawn. With a valid clip rect only the part inside it is drawn */
+	void DrawToCanvas(UCanvas* Canvas, const FBox2D& Rect, const FBox2D& ClipRect = FBox2D(ForceInit));
+
 	float GetParameterValue(const FString& ParameterName);
 	float GetMinimumParameterValue(const FString& ParameterName);
 	float GetMaximumParameterValue(const FString& ParameterName);
 	float GetDefaultParameterValue(const FString& ParameterName);
 	void SetParameterValue(const FString& ParameterName, const float Value, const bool bUpdateDrawables = false);
 
+	int32 GetParameterCount() const;
+	/** Index of a parameter in the parameter arrays of the model core, or INDEX_NONE */
+	int32 GetParameterIndex(const FString& ParameterId) const;
+	FString GetParameterId(const int32 ParameterIndex) const;
+	/** Indices of the parameters SetParameterValue writes for a parameter or parameter group name */
+	TArray<int32> FindParameterIndices(const FString& ParameterName) const;
+
+	/** Parameter arrays of the model core by parameter index, for callers that resolved their indices up front. Writes bypass ParameterValues */
+	float* GetParameterValueData() const;
+	const float* GetParameterMinimumValueData() const;
+	const float* GetParameterMaximumValueData() const;
+	const float* GetParameterDefaultValueData() const;
+
 	void ResetParametersToDefault();
 
+	/**
+	 * How much of the model parameters move, as the vertex displacement of the visible drawables weighted by their opacity
+	 * when the parameters go from their minimum to their maximum. Runs the model core twice, the parameter values are kept
+	 */
+	float CalcParameterInfluence(TConstArrayView<int32> ParameterIndices);
+
+	/** Hash of the moc data, equal for all copies of a model */
+	uint32 GetMocHash() const { return MocHash; }
+
 	float GetPartOpacityValue(const FString& ParameterName);
 	void SetPartOpacityValue(const FString& ParameterName, const float Value, const bool bUpdateDrawables = false);
 
@@ -54,6 +107,9 @@ public:
 	void StartTicking(const float TickRate);
 	void StopTicking();
 
+	/** Updates the drawables of a tick whose physics was evaluated by the physics scheduler */
+	void FinishTick();
+
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnModelTick, const float, DeltaTime);
 
 	UPROPERTY(BlueprintAssignable)
@@ -70,6 +126,18 @@ public:
 
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	TArray<UTexture2D*> Textures;
+
+	/** Writes premultiplied color into the render target, so its alpha channel holds the correct coverage of the model */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool bUsePremultipliedAlpha = false;
+
+	/** Caches the drawable outputs of recently seen poses, so looping motions skip the core update on repeated poses and the redraw on unchanged ones */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool bUsePoseCache = false;
+
+	/** Overrides Live2D.RenderTargetScale for this model when above zero */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, meta=(ClampMin="0.0"))
+	float RenderTargetScale = 0.f;
 	
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<FModel3GroupData> Groups;
@@ -77,6 +145,7 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient)
 	TMap<FString, float> PartOpacities;
 	
+	/** Values set through SetParameterValue, GetParameterValue reads the model core instead */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient)
 	TMap<FString, float> ParameterValues;
 
@@ -93,15 +162,56 @@ public:
 	UTextureRenderTarget2D* RenderTarget2D = nullptr;
 
 	UPROPERTY(Transient)
-	TMap<FString, UTextureRenderTarget2D*> MaskingRenderTargets;
+	TMap<FName, UTextureRenderTarget2D*> MaskingRenderTargets;
 
 	UPROPERTY(Transient)
 	FSlateBrush RenderTargetBrush;
 
+	/** Render targets of the static layers, including a spare one */
+	UPROPERTY(Transient)
+	TArray<UTextureRenderTarget2D*> StaticLayerRenderTargets;
+
+	/** Brush showing the region of this model in a shared render target atlas, maintained by ULive2DRenderTargetAtlas */
+	UPROPERTY(Transient)
+	FSlateBrush AtlasBrush;
+
+	DECLARE_MULTICAST_DELEGATE(FOnAtlasBrushChanged);
+
+	/** Broadcast when the atlas moved this model to another region */
+	FOnAtlasBrushChanged OnAtlasBrushChanged;
+
 protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	ULive2DModelPhysics* Physics;
 private:
+	/** Range of drawables in render order that stopped changing, drawn once into a render target and composited from it */
+	struct FStaticLayer
+	{
+		int32 FirstRenderIndex = 0;
+		int32 DrawableCount = 0;
+		const FLive2DModelDrawable* FirstDrawable = nullptr;
+		UTextureRenderTarget2D* RenderTarget = nullptr;
+		bool bIsBaked = false;
+	};
+
+	/** Drawable of a draw, or a baked static layer composited in its place when Drawable is null */
+	struct FDrawQueueEntry
+	{
+		const FLive2DModelDrawable* Drawable = nullptr;
+		int32 StaticLayerIndex = INDEX_NONE;
+	};
+
+	/** Drawable outputs of the model core for one quantized pose, linked into the recently used list */
+	struct FPoseCacheEntry
+	{
+		uint32 PoseKey = 0;
+		TArray<int32> QuantizedPose;
+		FLive2DModelDrawableOutputs Outputs;
+		int32 LessRecent = INDEX_NONE;
+		int32 MoreRecent = INDEX_NONE;
+
+		SIZE_T GetAllocatedSize() const { return QuantizedPose.GetAllocatedSize() + Outputs.GetAllocatedSize(); }
+	};
 
 	void OnTick(const float DeltaTime);
 
@@ -109,14 +219,45 @@ private:
 	FTimerHandle TickHandle;
 
 	FLive2DModelCanvasInfo GetModelCanvasInfoInternal() const;
-	bool GetAffectedParameterIdsByGroupName(const FString& GroupName, const FString& TargetName, TArray<FString>& AffectedIds);
+	const TArray<FString>* FindAffectedParameterIds(const FString& GroupName, const TCHAR* TargetName) const;
 	void SetParameterValueInternal(const FString& ParameterName, const float Value, const bool bUpdateDrawables = false);
 	void SetPartOpacityValueInternal(const FString& ParameterName, const float Value, const bool bUpdateDrawables = false);
+	void FinishUpdateDrawables();
+	FCanvasTriangleItem& GetScratchTriangleItem(const FTexture* Texture);
+	/** Raises the scratch high water mark of this model and adds its growth to the scratch memory of the frame */
+	void UpdateScratchHighWater();
+	uint32 CalcPoseKey(TArray<int32>& OutQuantizedPose) const;
+	void ApplyDrawableOutputs(const FLive2DModelDrawableOutputs& Outputs);
+	/** Culls the drawables that can't be seen and marks the drawables whose vertices the update has to copy */
+	void CullDrawables(const float* Opacities, TFunctionRef<bool(int32)> IsVisible);
+	void AddPoseCacheEntry(const uint32 PoseKey, const TArray<int32>& QuantizedPose);
+	void LinkPoseCacheEntry(const int32 EntryIndex);
+	void UnlinkPoseCacheEntry(const int32 EntryIndex);
+	void ResetPoseCache();
 	void SetupRenderTarget();
+	FIntPoint CalcDesiredRenderTargetSize() const;
+	/** Returns whether the render targets were resized, which also redraws them */
+	bool UpdateRenderTargetSize();
 	void UpdateRenderTarget();
-	void ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas*& Canvas, const FLive2DModelCanvasInfo& CanvasInfo, FDrawToRenderTargetContext& Context);
-	void ProcessNonMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas* Canvas, const FLive2DModelCanvasInfo& CanvasInfo);
-	FVector2D ProcessVertex(FVector2D Vertex, const FLive2DModelCanvasInfo& CanvasInfo);
+	FBox2D CalcDirtyRect(const FBox2D& FullRect);
+	bool IsStaticLayerCandidate(const FLive2DModelDrawable& Drawable, const int32 SettleUpdates) const;
+	void UpdateStaticLayers();
+	UTextureRenderTarget2D* CreateStaticLayerRenderTarget();
+	void BakeStaticLayer(FStaticLayer& StaticLayer, const FLive2DModelCanvasInfo& CanvasInfo);
+	void InvalidateStaticLayers();
+	void DrawQueue(UCanvas* Canvas, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport, const FBox2D& ClipRect, const bool bIntoStaticLayer);
+	void ProcessMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas* Canvas, TArray<FCanvasUVTri>& Triangles, const bool bIntoStaticLayer = false);
+	void DrawMaskingRenderTarget(const FLive2DModelDrawable* Drawable, UTextureRenderTarget2D* RenderTarget, const FLive2DModelCanvasInfo& CanvasInfo);
+	void ProcessNonMaskedDrawable(const FLive2DModelDrawable* Drawable, UCanvas* Canvas, TArray<FCanvasUVTri>& Triangles, const bool bIntoStaticLayer = false);
+	/** Appends the triangles of a drawable in the viewport, safe to call from worker threads */
+	void AddDrawableTriangles(const FLive2DModelDrawable& Drawable, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport, const FBox2D& ClipRect, TArray<FCanvasUVTri>& OutTriangles) const;
+	/** Transforms all vertices of a drawable into the viewport at once */
+	void TransformDrawableVertices(const FLive2DModelDrawable& Drawable, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport, FVector2f* OutPositions) const;
+	FVector2D ProcessVertex(const FVector2f& Vertex, const FLive2DModelCanvasInfo& CanvasInfo);
+	FVector2D ProcessVertex(const FVector2f& Vertex, const FLive2DModelCanvasInfo& CanvasInfo, const FBox2D& Viewport);
+	FBatchedElementParameters* GetDrawableBatchedElementParameters(const FLive2DModelDrawable* Drawable, ESimpleElementBlendMode BlendMode, const bool bIntoStaticLayer = false);
+	FBatchedElementParameters* GetMaskBatchedElementParameters(const FLive2DModelDrawable& MaskDrawable, const bool bIsInvertedMask);
+	void ResetBatchedElementParameters();
 	bool InitializeMoc(uint8* Source);
 	bool InitializeModel();
 	void InitializeParameterList();
@@ -126,7 +267,79 @@ private:
 	UPROPERTY()
 	int32 MocSourceSize;
 
+	/** Vertex positions of all drawables in model drawable order, the drawables view into it */
+	TArray<FVector2f> VertexPositionArena;
+
+	/** Vertex UVs of all drawables with Y flipped for canvas drawing, in model drawable order */
+	TArray<FVector2f> CanvasUVArena;
+
+	/** Drawables of the running update whose vertices are drawn, directly or as a mask, in model drawable order */
+	TArray<bool> ScratchVerticesNeeded;
+
+	/** Drawables and static layers of the running draw in render order, with one triangle slot each */
+	TArray<FDrawQueueEntry> ScratchDrawQueue;
+	TArray<TArray<FCanvasUVTri>> ScratchTriangleSlots;
+
+	/** Largest scratch memory this model held, and how much of it the scratch stat of frame ScratchStatFrame already counts */
+	SIZE_T ScratchHighWater = 0;
+	SIZE_T CountedScratchHighWater = 0;
+	uint64 ScratchStatFrame = 0;
+
+	/** Batched element parameters per drawable, created on first draw and reused every frame */
+	TArray<TRefCountPtr<FBatchedElementParameters>> DrawableBatchedElementParameters;
+
+	/** Mask batched element parameters per texture, normal and inverted */
+	TArray<TRefCountPtr<FBatchedElementParameters>> MaskBatchedElementParameters;
+
+	FVector2D DisplaySize = FVector2D::ZeroVector;
+
+	/** Size of the render target and the masking render targets */
+	FIntPoint RenderTargetSize = FIntPoint::ZeroValue;
+
+	/** Render target scale RenderTargetSize was last checked against */
+	float AppliedRenderTargetScale = 0.f;
+
+	/** Premultiplied batched element parameters per drawable for drawing into static layers */
+	TArray<TRefCountPtr<FBatchedElementParameters>> StaticLayerBatchedElementParameters;
+
+	/** Static layers sorted by render order */
+	TArray<FStaticLayer> StaticLayers;
+
+	/** Cached drawable outputs, least recently used entries are refilled with new poses above Live2D.PoseCache.MaxMemoryKB */
+	TArray<FPoseCacheEntry> PoseCacheEntries;
+	TMap<uint32, int32> PoseCacheEntryIndices;
+	TArray<int32> FreePoseCacheEntries;
+	int32 MostRecentPoseCacheEntry = INDEX_NONE;
+	int32 LeastRecentPoseCacheEntry = INDEX_NONE;
+	SIZE_T PoseCacheSize = 0;
+
+	/** Quantized pose the drawables currently hold */
+	TArray<int32> CurrentPose;
+
+	/** Quantized pose of the running update, swapped with CurrentPose so neither is reallocated */
+	TArray<int32> ScratchPose;
+
+	/** Triangle item reused by every drawable and mask draw, its triangle list keeps its capacity between frames */
+	TUniquePtr<FCanvasTriangleItem> ScratchTriangleItem;
+
+	/** Index of each parameter and part in the arrays of the model core */
+	TMap<FString, int32> ParameterIndices;
+	TMap<FString, int32> PartIndices;
+
+	/** Set while the drawables hold outputs that didn't come from the last core update, the dynamic flags of the core then don't describe the change to the next pose */
+	bool bDrawablesDivergedFromCore = false;
+
+	/** Set when a tick listener provided the drawable outputs of the current tick */
+	bool bDrawableOutputsSet = false;
+
+	/** Set when the whole render target has to be redrawn instead of only the dirty rect */
+	bool bRenderTargetNeedsFullRedraw = true;
+
+	/** Rect the cached batched element parameters were created for */
+	FBox2D BatchedElementViewport = FBox2D(ForceInit);
+
 	uint8* MocSource;
+	uint32 MocHash = 0;
 	csmMoc* Moc;
 	csmModel* Model;
 };
@@ -45,17 +45,18 @@ struct FLive2DModelDrawable
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	bool bIsInvertedMask;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	TArray<FVector2D> VertexPositions;
+	/** Positions in the vertex arena of the model, updated by every model update */
+	TArrayView<FVector2f> VertexPositions;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	TArray<FVector2D> VertexUVs;
+	/** Constant data of the model core, valid as long as the model lives */
+	TConstArrayView<FVector2f> VertexUVs;
+	TConstArrayView<uint16> VertexIndices;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	TArray<int32> VertexIndices;
+	/** UVs with Y flipped for canvas drawing, in the canvas UV arena of the model */
+	TConstArrayView<FVector2f> CanvasVertexUVs;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	FString ID;
+	FName ID;
 	int32 DrawOrder;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
@@ -67,8 +68,38 @@ struct FLive2DModelDrawable
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	int32 DynamicFlag;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
-	TArray<int32> Masks;
+	/** Indices of the drawables masking this one, constant data of the model core */
+	TConstArrayView<int32> Masks;
+
+	/** Consecutive updates in which neither the vertices, the opacity, the visibility nor the order changed */
+	int32 StaticUpdateCount = 0;
+
+	/** Not drawn because it is invisible or too transparent to show, its vertices are only kept current while it masks a drawn drawable */
+	bool bIsCulled = false;
+
+	/** Masks at least one other drawable of the model */
+	bool bIsMask = false;
+
+	/** Drawn from a baked static layer of the model instead of on its own */
+	bool bIsInStaticLayer = false;
+
+	/** Canvas pixel bounds the drawable covered when the model render target was last drawn, invalid while hidden */
+	FBox2D CanvasBounds = FBox2D(ForceInit);
+
+#if WITH_EDITORONLY_DATA
+	/** Copies of the drawable data for inspecting the model in the editor, the positions follow every model update */
+	UPROPERTY(VisibleAnywhere, Transient)
+	TArray<FVector2D> EditorVertexPositions;
+
+	UPROPERTY(VisibleAnywhere, Transient)
+	TArray<FVector2D> EditorVertexUVs;
+
+	UPROPERTY(VisibleAnywhere, Transient)
+	TArray<int32> EditorVertexIndices;
+
+	UPROPERTY(VisibleAnywhere, Transient)
+	TArray<int32> EditorMasks;
+#endif
 
 	bool IsVisible() const
 	{
@@ -82,6 +113,22 @@ struct FLive2DModelDrawable
 	
 };
 
+/** Outputs of the model core for all drawables in one pose, in model drawable order */
+struct FLive2DModelDrawableOutputs
+{
+	TArray<FVector2f> VertexPositions;
+	TArray<float> Opacities;
+	TArray<int32> DrawOrders;
+	TArray<int32> RenderOrders;
+	TArray<bool> Visibilities;
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return VertexPositions.GetAllocatedSize() + Opacities.GetAllocatedSize() + DrawOrders.GetAllocatedSize()
+			+ RenderOrders.GetAllocatedSize() + Visibilities.GetAllocatedSize();
+	}
+};
+
 USTRUCT()
 struct FLive2DModelPart
 {
@@ -275,6 +322,10 @@ struct FPhysics3MetaData
 	UPROPERTY()
 	int32 VertexCount;
 
+	/** Rate the physics is designed for, only written by Cubism Editor 4.2 and later */
+	UPROPERTY()
+	float Fps = 0.f;
+
 	UPROPERTY()
 	FPhysics3EffectiveForcesData EffectiveForces;
 };
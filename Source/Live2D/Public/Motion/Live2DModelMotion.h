@@ -6,6 +6,26 @@
 
 #include "Live2DModelMotion.generated.h"
 
+/** Drawable outputs of a motion sampled once per motion frame, with the vertex positions quantized to 16 bits within their bounds */
+struct FLive2DBakedVertexStream
+{
+	int32 FrameCount = 0;
+	int32 VertexCount = 0;
+	int32 DrawableCount = 0;
+	FVector2D PositionMin = FVector2D::ZeroVector;
+	FVector2D PositionScale = FVector2D::ZeroVector;
+
+	/** X and Y per vertex per frame */
+	TArray<uint16> Positions;
+
+	/** Per drawable per frame */
+	TArray<float> Opacities;
+	TArray<int32> DrawOrders;
+	TArray<int32> RenderOrders;
+	TArray<bool> Visibilities;
+
+	bool IsValid() const { return FrameCount > 0; }
+};
 
 /**
  * 
@@ -20,7 +40,7 @@ public:
 	bool Init(const FMotion3FileData& Motion3Data);
 	void RebindDelegates();
 	
-	void SetModel(ULive2DMocModel* InModel) { Model = InModel;}
+	void SetModel(ULive2DMocModel* InModel) { Model = InModel; BakedVertexStream = FLive2DBakedVertexStream(); }
 	ULive2DMocModel* GetModel() const { return Model; }
 
 	UFUNCTION(CallInEditor)
@@ -37,9 +57,21 @@ public:
 	UPROPERTY(BlueprintAssignable)
 	FOnMotionEvent OnMotionEvent;
 
+	/** Samples a looping motion of a model without physics once when it starts, and plays it back from the sampled drawables instead of the model core */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Live2D Motion")
+	bool bBakeVertexStream = false;
+
+	/** Places the physics of the model at rest for the pose the motion starts at, instead of letting it settle from its initial particles */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Live2D Motion")
+	bool bStabilizePhysicsOnStart = true;
+
 protected:
 
 	void ToggleTimer();
+	void EvaluateCurves(const float Time);
+	bool CanBakeVertexStream() const;
+	void BakeVertexStream();
+	void ApplyBakedVertexStream(const float Time);
 
 	UFUNCTION()
 	void Tick(const float InDeltaTime);
@@ -72,4 +104,9 @@ protected:
 
 	bool bIsAnimating = false;
 	FTimerHandle Timer;
+
+	FLive2DBakedVertexStream BakedVertexStream;
+
+	/** Drawable outputs interpolated from the baked vertex stream, reused every tick */
+	FLive2DModelDrawableOutputs BakedFrameOutputs;
 };
@@ -4,11 +4,40 @@
 
 #include "CoreMinimal.h"
 #include "Live2DStructs.h"
+#include "Live2DModelPhysicsSolver.h"
 #include "UObject/Object.h"
 #include "Live2DModelPhysics.generated.h"
 
 
 class ULive2DMocModel;
+
+/** Parameter of the model core that a physics input reads or an output writes, with its range */
+struct FLive2DModelPhysicsParameterBinding
+{
+	int32 ParameterIndex = INDEX_NONE;
+	float Minimum = 0.f;
+	float Maximum = 0.f;
+	float Default = 0.f;
+};
+
+/**
+ * Physics input compiled to a piecewise linear map of its parameter value, with the weight and reflection folded in.
+ * The value is clamped to the parameter range, and each side of the middle of the range has its own slope
+ */
+struct FLive2DModelPhysicsInputMap
+{
+	int32 ParameterIndex = INDEX_NONE;
+	float Minimum = 0.f;
+	float Maximum = 0.f;
+	float Middle = 0.f;
+	float LowSlope = 0.f;
+	float HighSlope = 0.f;
+	/** Contribution at the middle of the range */
+	float Offset = 0.f;
+	/** Total the input adds to, 0 and 1 for the translation, 2 for the angle */
+	int32 Target = 0;
+};
+
 USTRUCT(BlueprintType)
 struct FLive2dModelPhysicsOutput
 {
@@ -38,7 +67,15 @@ struct FLive2dModelPhysicsOutput
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	float ValueExceededMaximum;
 
-	
+	/** Output of the last two physics steps, the written value is interpolated between them */
+	float PreviousValue = 0.f;
+	float CurrentValue = 0.f;
+
+	/** Value last written to the first destination, a sleeping rig doesn't write it again while it is unchanged */
+	float WrittenValue = 0.f;
+
+	/** Parameters written for the destination, more than one when it names a parameter group */
+	TArray<FLive2DModelPhysicsParameterBinding, TInlineAllocator<1>> DestinationBindings;
 };
 USTRUCT(BlueprintType)
 struct FLive2dModelPhysicsParticle
@@ -87,11 +124,83 @@ struct FLive2DModelPhysicsRig
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<FPhysics3PhysicsInputData> Input;
 
+	/** Source parameter of each input, in input order */
+	TArray<FLive2DModelPhysicsParameterBinding> InputBindings;
+	TArray<FLive2DModelPhysicsInputMap> InputMaps;
+
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<FLive2dModelPhysicsOutput> Output;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<FLive2dModelPhysicsParticle> Particles;
+
+	/** A sleeping rig has converged, it isn't integrated and holds its outputs until its inputs change */
+	bool bIsSleeping = false;
+
+	/** Consecutive awake steps with calm inputs, the rig falls asleep after Live2D.Physics.Sleep.Steps of them */
+	int32 CalmStepCount = 0;
+
+	/** Inputs of the last step while awake, the inputs a sleeping rig fell asleep with */
+	FVector2D LastTotalTranslation = FVector2D::ZeroVector;
+	float LastTotalAngle = 0.f;
+
+	/** The rig just fell asleep or was frozen, the output it holds hasn't been written yet */
+	bool bNeedsHeldOutputWrite = false;
+
+	/** The rig is idle and its written outputs were overwritten since, e.g. by a motion, so it blends them in again */
+	bool bWereOutputsOverwritten = false;
+
+	/** The rig blended its outputs over the parameter snapshot, EndEvaluate copies them back to the model */
+	bool bHasPendingWriteback = false;
+
+	/** A frozen rig is left out by the physics level of detail, it holds its outputs like a sleeping rig until the level changes */
+	bool bIsFrozen = false;
+};
+
+/** Physics level of detail, applied while the model is displayed no larger than MaxDisplaySize */
+USTRUCT(BlueprintType)
+struct FLive2DModelPhysicsLOD
+{
+	GENERATED_BODY()
+
+	/** Largest display size, the larger of width and height, the level applies up to */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0"))
+	float MaxDisplaySize = 0.f;
+
+	/** Fraction of the physics rate the rigs are integrated at, zero freezes all rigs */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", ClampMax="1.0"))
+	float RateScale = 1.f;
+
+	/** Rigs moving less of the model than this fraction of the rig moving the most are frozen */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", ClampMax="1.0"))
+	float MinRigInfluence = 0.f;
+};
+
+/** Settings of one physics that take precedence over the Live2D.Physics console variables, e.g. so benchmarks and tests run the same whatever the console sets */
+struct FLive2DModelPhysicsEvaluationOptions
+{
+	TOptional<bool> bFixedStep;
+	TOptional<bool> bSleep;
+	TOptional<bool> bLOD;
+};
+
+/** Runtime state of a physics in binary, restorable into the physics of any copy of the same asset. Can be stored in a save game */
+USTRUCT(BlueprintType)
+struct FLive2DModelPhysicsSnapshot
+{
+	GENERATED_BODY()
+
+	UPROPERTY(SaveGame)
+	int32 Version = 0;
+
+	/** Setup hash of the physics the snapshot was taken from */
+	UPROPERTY(SaveGame)
+	uint32 SetupHash = 0;
+
+	UPROPERTY(SaveGame)
+	TArray<uint8> Data;
+
+	bool IsValid() const { return Data.Num() > 0; }
 };
 
 /**
@@ -105,53 +214,125 @@ class LIVE2D_API ULive2DModelPhysics : public UObject
 public:
 	virtual UWorld* GetWorld() const override;
 	bool Init(const FPhysics3FileData& Physics3FileData);
-	void SetModel(ULive2DMocModel* InModel) { Model = InModel; }
+	void SetModel(ULive2DMocModel* InModel);
 
 	void Evaluate(const float DeltaTime);
 
+	/**
+	 * Evaluate in stages for the physics scheduler. BeginEvaluate snapshots the parameters and EndEvaluate writes the outputs back, both on the game thread.
+	 * Simulate only touches this physics, so the physics of different models can be simulated in parallel.
+	 */
+	void BeginEvaluate();
+	void Simulate(const float DeltaTime);
+	void EndEvaluate();
+
+	void SetEvaluationOptions(const FLive2DModelPhysicsEvaluationOptions& InEvaluationOptions) { EvaluationOptions = InEvaluationOptions; }
+
+	bool HasRigs() const { return PhysicsRigs.Num() > 0; }
+	int32 GetRigCount() const { return PhysicsRigs.Num(); }
+
+	/**
+	 * Places the particles of all rigs at rest for the current parameters and writes their outputs, so a spawned or reset model doesn't visibly settle.
+	 * Rest poses are cached by rig setup and quantized input pose, and shared between all models of the same physics asset
+	 */
+	void Stabilize();
+
+	/** Copies the particle state and the runtime state of the rigs into a snapshot */
+	void SaveSnapshot(FLive2DModelPhysicsSnapshot& OutSnapshot);
+	/** Restores a snapshot and writes its outputs to the model, fails when it was taken from physics of another asset or with another snapshot version */
+	bool RestoreSnapshot(const FLive2DModelPhysicsSnapshot& Snapshot);
+
+	/** Increased whenever the layout of snapshots changes */
+	static constexpr int32 SnapshotVersion = 2;
+
+	/** Rate in Hz physics is stepped at, independent of the tick rate. At zero it integrates once per evaluation with the tick delta */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, meta=(ClampMin="0.0"))
+	float Fps = 0.f;
+
+	/** Levels of detail by display size of the model. The level with the smallest MaxDisplaySize the model fits in applies, larger models run at full detail */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TArray<FLive2DModelPhysicsLOD> LODs;
+
 protected:
 	void InitializeParticles();
-	void GetInputTranslationXFromNormalizedParameterValue(FVector2D& TargetTranslation, float& TargetAngle, float Value,
-		float ParameterMinimumValue, float ParameterMaximumValue, float ParameterDefaultValue,
-		const FPhysics3PhysicsRangeData& NormalizationPosition, const FPhysics3PhysicsRangeData& NormalizationAngle,
-		bool bIsInverted, float Weight);
-	void GetInputTranslationYFromNormalizedParameterValue(FVector2D& TargetTranslation, float& TargetAngle, float Value,
-		float ParameterMinimumValue, float ParameterMaximumValue, float ParameterDefaultValue,
-		const FPhysics3PhysicsRangeData& NormalizationPosition, const FPhysics3PhysicsRangeData& NormalizationAngle,
-		bool bIsInverted, float Weight);
-	void GetInputAngleFromNormalizedParameterValue(FVector2D& TargetTranslation, float& TargetAngle, float Value,
-		float ParameterMinimumValue, float ParameterMaximumValue, float ParameterDefaultValue,
-		const FPhysics3PhysicsRangeData& NormalizationPosition, const FPhysics3PhysicsRangeData& NormalizationAngle,
-		bool bIsInverted, float Weight);
-	
-	float NormalizeParameterValue(float Value,
-		float ParameterMinimum,	float ParameterMaximum,	float ParameterDefault,
-		float NormalizedMinimum, float NormalizedMaximum, float NormalizedDefault,
-		bool bIsInverted);
+	/** Resolves the parameter ids of all inputs and outputs to parameter indices of the model core */
+	void BindParameters();
+	FLive2DModelPhysicsParameterBinding BindParameter(const int32 ParameterIndex) const;
+	static bool ReadsOutputsOf(const FLive2DModelPhysicsRig& PhysicsRig, const FLive2DModelPhysicsRig& OtherPhysicsRig);
+	/** Hash of everything the rest pose depends on besides the parameters, equal for all copies of a physics asset */
+	uint32 CalcSetupHash() const;
+	int32 CalcSnapshotSize() const;
+	bool IsFixedStepEnabled() const;
+	bool IsSleepEnabled() const;
+	bool IsLODEnabled() const;
+	/** Saves or loads the snapshot data, with fixed width values only so snapshots move between platforms */
+	void SerializeSnapshotData(FArchive& Ar);
+	/** Picks the level of detail from the display size of the model and freezes the rigs it leaves out, on the game thread */
+	void UpdateLOD();
+	/** Sleeping and frozen rigs aren't integrated, and only write their held outputs when something else overwrote them */
+	static bool IsRigIdle(const FLive2DModelPhysicsRig& PhysicsRig) { return PhysicsRig.bIsSleeping || PhysicsRig.bIsFrozen; }
+	/** Integrates all rigs by one step on the parameter cache, and writes their outputs into the cache for the rigs that follow */
+	void StepRigs(const float DeltaTime);
+	void GatherRigInputs(const FLive2DModelPhysicsRig& PhysicsRig, FVector2D& TotalTranslation, float& TotalAngle);
+	void UpdateRigOutputs(FLive2DModelPhysicsRig& PhysicsRig, const int32 RigIndex);
+	/** Wakes the rig when its inputs moved since it fell asleep, or counts the steps it stays calm while awake */
+	void UpdateRigSleep(FLive2DModelPhysicsRig& PhysicsRig, const FVector2D& TotalTranslation, const float TotalAngle) const;
+	/** Whether the parameters a sleeping rig writes still hold the values it wrote last */
+	static bool HasWrittenOutputs(const FLive2DModelPhysicsRig& PhysicsRig, const float* ParameterValues);
+	/** Writes the outputs of a rig into the model core, interpolated between its last two steps */
+	void WriteRigOutputs(FLive2DModelPhysicsRig& PhysicsRig, float* ParameterValues, const float Alpha);
+	/** Compiles the normalization of an input into a map, none of it changes once the parameters are bound */
+	static FLive2DModelPhysicsInputMap CompileInputMap(const FPhysics3PhysicsInputData& Input, const FLive2DModelPhysicsParameterBinding& Source,
+		const FPhysics3PhysicsNormalizationData& Normalization);
 
-	float GetOutputTranslationX(const FVector2D& Translation, const TArray<FLive2dModelPhysicsParticle>& Particles, int32 ParticleIndex,
+	float GetOutputTranslationX(const FVector2D& Translation, int32 RigIndex, int32 ParticleIndex,
 	bool bIsInverted, FVector2D ParentGravity);
 
-	float GetOutputTranslationY(const FVector2D& Translation, const TArray<FLive2dModelPhysicsParticle>& Particles, int32 ParticleIndex,
+	float GetOutputTranslationY(const FVector2D& Translation, int32 RigIndex, int32 ParticleIndex,
 	bool bIsInverted, FVector2D ParentGravity);
 
-	float GetOutputAngle(const FVector2D& Translation, const TArray<FLive2dModelPhysicsParticle>& Particles, int32 ParticleIndex,
+	float GetOutputAngle(const FVector2D& Translation, int32 RigIndex, int32 ParticleIndex,
 	bool bIsInverted, FVector2D ParentGravity);
 
-	void UpdateParticles(TArray<FLive2dModelPhysicsParticle>& Strand, int32 StrandCount, FVector2D TotalTranslation, float TotalAngle,
-	FVector2D WindDirection, float ThresholdValue, float DeltaTimeSeconds, float InAirResistance);
-
 	void UpdateOutputParameterValue(float& ParameterValue, float ParameterValueMinimum, float ParameterValueMaximum,
 	float Translation, FLive2dModelPhysicsOutput& Output);
 
 	float DirectionToRadian(const FVector2D& A, const FVector2D& B);
 	
+	/** Setup of the rigs. Their particles hold the initial state, and in the editor the state of the last evaluation for display */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<FLive2DModelPhysicsRig> PhysicsRigs;
 
+	/** Particle state the rigs are simulated with */
+	FLive2DModelPhysicsSolver Solver;
+
 	UPROPERTY()
 	ULive2DMocModel* Model;
 
 	UPROPERTY()
 	FPhysics3EffectiveForcesData EffectiveForces;
+
+	/** The parameter indices are runtime data of the model core, so loaded physics binds on its first evaluation */
+	bool bAreParametersBound = false;
+	uint32 SetupHash = 0;
+
+	FLive2DModelPhysicsEvaluationOptions EvaluationOptions;
+
+	/** Time not yet consumed by a fixed step */
+	float RemainingTime = 0.f;
+
+	/** Level of detail of this evaluation, INDEX_NONE at full detail */
+	int32 CurrentLOD = INDEX_NONE;
+
+	/** Share of the model each rig moves relative to the rig moving the most, measured once per setup and moc when a level of detail needs it */
+	TArray<float> RigInfluences;
+
+	/** Outputs are only written once a step produced them */
+	bool bHasStepped = false;
+
+	/** Parameter values the steps of one evaluation read and write, so chained rigs see each other's outputs */
+	TArray<float> ParameterCache;
+
+	/** Parameter values at the start of the evaluation, which the outputs are blended into until they are written back */
+	TArray<float> ParameterSnapshot;
 };
@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+struct FLive2DModelPhysicsRig;
+
+/**
+ * Runtime particle state of all physics rigs of a model in flat float arrays.
+ * Rigs are packed four to a batch, one per vector lane, and a batch updates its strands together particle by particle.
+ */
+struct LIVE2D_API FLive2DModelPhysicsSolver
+{
+	static constexpr int32 LaneCount = 4;
+
+	/** Up to four rigs whose particles are interleaved, Depth is the particle count of the longest of them */
+	struct FBatch
+	{
+		int32 RigIndices[LaneCount];
+		int32 FirstSlot = 0;
+		int32 Depth = 0;
+	};
+
+	/** Rebuilds the state from the particles of the rigs. Rigs of a wave only read parameters written by rigs of earlier waves */
+	void Build(const TArray<FLive2DModelPhysicsRig>& Rigs, const TArray<int32>& RigWaves);
+
+	/** Copies the state back into the particles of the rigs, for displaying them in the editor */
+	void CopyToRigs(TArray<FLive2DModelPhysicsRig>& Rigs) const;
+
+	/** Sets the root position and angle, in degrees, of the strand of a rig for the next solve. The strand of a sleeping rig isn't updated */
+	void SetRigInput(const int32 RigIndex, const FVector2D& RootPosition, const float TotalAngle, const float Threshold, const bool bIsAwake = true);
+
+	/** Places the strand of a rig at rest for its root position and angle, the pose Solve keeps it in while the inputs hold */
+	void Stabilize(const int32 RigIndex, const int32 ParticleCount, const FVector2D& RootPosition, const float TotalAngle, const float Threshold, const FVector2D& Wind);
+
+	/** State of the strand of a rig as StateFloatsPerParticle floats per particle, for caching a stabilized strand */
+	static constexpr int32 StateFloatsPerParticle = 8;
+	void GetRigState(const int32 RigIndex, const int32 ParticleCount, float* OutState) const;
+	void SetRigState(const int32 RigIndex, const int32 ParticleCount, const float* State);
+
+	/** Size in bytes of the state of all strands, which SerializeState saves or loads as a whole */
+	int32 GetStateSize() const { return PositionX.Num() * StateFloatsPerParticle * sizeof(float); }
+	void SerializeState(FArchive& Ar);
+
+	/** Updates all strands of a batch by one step */
+	void Solve(const int32 BatchIndex, const FVector2D& Wind, const float DeltaTime, const float AirResistance);
+
+	FVector2D GetParticlePosition(const int32 RigIndex, const int32 ParticleIndex) const
+	{
+		const int32 Index = RigOffsets[RigIndex] + ParticleIndex * LaneCount;
+		return FVector2D(PositionX[Index], PositionY[Index]);
+	}
+
+	/** Largest squared particle velocity of the strand of a rig */
+	float GetMaxSpeedSquared(const int32 RigIndex, const int32 ParticleCount) const;
+
+	int32 GetWaveCount() const { return FMath::Max(0, WaveFirstBatches.Num() - 1); }
+	int32 GetWaveFirstBatch(const int32 WaveIndex) const { return WaveFirstBatches[WaveIndex]; }
+	int32 GetWaveLastBatch(const int32 WaveIndex) const { return WaveFirstBatches[WaveIndex + 1] - 1; }
+	const FBatch& GetBatch(const int32 BatchIndex) const { return Batches[BatchIndex]; }
+
+private:
+	TArray<FBatch> Batches;
+
+	/** First batch of every wave, followed by the batch count */
+	TArray<int32> WaveFirstBatches;
+
+	/** Index of the first particle of every rig in the particle arrays, particle N follows at N * LaneCount */
+	TArray<int32> RigOffsets;
+
+	/** Index of the inputs of every rig in the input arrays */
+	TArray<int32> RigInputIndices;
+
+	/** Particle state, LaneCount floats per slot */
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> LastPositionX;
+	TArray<float> LastPositionY;
+	TArray<float> VelocityX;
+	TArray<float> VelocityY;
+	TArray<float> LastGravityX;
+	TArray<float> LastGravityY;
+	TArray<float> Mobility;
+	TArray<float> Delay;
+	TArray<float> Acceleration;
+	TArray<float> Radius;
+
+	/** One for particles of a rig, zero for the padding of shorter strands */
+	TArray<float> Active;
+
+	/** Inputs of the next solve, LaneCount floats per batch */
+	TArray<float> RootX;
+	TArray<float> RootY;
+	TArray<float> TotalAngles;
+	TArray<float> Thresholds;
+	TArray<float> Awake;
+};
@@ -0,0 +1,55 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "Live2DPhysicsScheduler.generated.h"
+
+class ULive2DMocModel;
+class ULive2DModelPhysics;
+
+/**
+ * Evaluates the physics of all models that ticked in a frame together, spread over the task graph.
+ * Each model simulates on a snapshot of its parameters, the outputs are written back and the drawables updated on the game thread afterwards.
+ */
+UCLASS()
+class LIVE2D_API ULive2DPhysicsScheduler : public UEngineSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	/** Queues the physics of a model tick, returns false when models evaluate their physics in their own tick */
+	bool Schedule(ULive2DMocModel* Model, const float DeltaTime);
+
+	/** Evaluates the physics of all queued models and updates their drawables */
+	void Flush();
+
+	//~ Begin USubsystem Interface
+	virtual void Deinitialize() override;
+	//~ End USubsystem Interface
+
+	//~ Begin FTickableGameObject Interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableInEditor() const override { return true; }
+	virtual bool IsTickableWhenPaused() const override { return true; }
+	virtual TStatId GetStatId() const override;
+	//~ End FTickableGameObject Interface
+
+private:
+	struct FScheduledModel
+	{
+		TWeakObjectPtr<ULive2DMocModel> Model;
+		float DeltaTime = 0.f;
+	};
+
+	TArray<FScheduledModel> ScheduledModels;
+
+	/** Models and physics of the running flush, kept to avoid allocating every frame */
+	TArray<ULive2DMocModel*> FlushModels;
+	TArray<ULive2DModelPhysics*> FlushPhysics;
+	TArray<float> FlushDeltaTimes;
+};
@@ -3,15 +3,34 @@
 #include "BatchedElements.h"
 #include "CanvasItem.h"
 
+// The drawable opacity is passed through the vertex color alpha, so these parameters stay immutable
+// and can be cached per drawable and shared with the render thread across frames.
+
+/** Draw pass selecting the permutation of the Live2D pixel shader */
+enum class ELive2DDrawPass : uint8
+{
+	Normal,
+	Masked,
+	Mask,
+	MAX
+};
+
+class LIVE2D_API FLive2DPipelineStatePrecache
+{
+public:
+	/** Compiles the pipeline states for every Live2D shader permutation and blend mode ahead of the first draw. Only the first call per feature level and format does any work. */
+	static void Precache(ERHIFeatureLevel::Type FeatureLevel, EPixelFormat RenderTargetFormat);
+};
+
 class FLive2DNormalBatchedElements : public FBatchedElementParameters
 {
 public:
 	typedef TFunction<void(FRHITexture*&, FRHISamplerState*&)> FGetTextureAndSamplerDelegate;
 
-	FLive2DNormalBatchedElements(UTexture2D* InTexture2D, ESimpleElementBlendMode InBlendMode, const float InRenderOpacity)
+	FLive2DNormalBatchedElements(UTexture2D* InTexture2D, ESimpleElementBlendMode InBlendMode, const bool bInPremultipliedAlpha = false)
 		: Texture2D(InTexture2D)
 		, BlendMode(InBlendMode)
-		, RenderOpacity(InRenderOpacity)
+		, bPremultipliedAlpha(bInPremultipliedAlpha)
 	{}
 
 	/** Binds vertex and pixel shaders for this element */
@@ -20,7 +39,7 @@ public:
 private:
 	UTexture2D* Texture2D = nullptr;
 	ESimpleElementBlendMode BlendMode = SE_BLEND_Masked;
-	float RenderOpacity = 1.f;
+	bool bPremultipliedAlpha = false;
 };
 
 class FLive2DMaskedBatchedElements : public FBatchedElementParameters
@@ -28,11 +47,13 @@ class FLive2DMaskedBatchedElements : public FBatchedElementParameters
 public:
 	typedef TFunction<void(FRHITexture*&, FRHISamplerState*&)> FGetTextureAndSamplerDelegate;
 
-	FLive2DMaskedBatchedElements(UTextureRenderTarget2D* InMaskRenderTarget, UTexture2D* InTexture2D, ESimpleElementBlendMode InBlendMode, const float InRenderOpacity)
+	/** The mask viewport is the rect of the render target the model is drawn into, the mask covers the whole of it */
+	FLive2DMaskedBatchedElements(UTextureRenderTarget2D* InMaskRenderTarget, UTexture2D* InTexture2D, ESimpleElementBlendMode InBlendMode, const FBox2D& InMaskViewport, const bool bInPremultipliedAlpha = false)
 		: MaskRenderTarget(InMaskRenderTarget)
 		, Texture2D(InTexture2D)
 		, BlendMode(InBlendMode)
-		, RenderOpacity(InRenderOpacity)
+		, MaskViewport(InMaskViewport)
+		, bPremultipliedAlpha(bInPremultipliedAlpha)
 	{}
 
 	/** Binds vertex and pixel shaders for this element */
@@ -42,7 +63,8 @@ private:
 	UTextureRenderTarget2D* MaskRenderTarget = nullptr;
 	UTexture2D* Texture2D = nullptr;
 	ESimpleElementBlendMode BlendMode = SE_BLEND_Masked;
-	float RenderOpacity = 1.f;
+	FBox2D MaskViewport;
+	bool bPremultipliedAlpha = false;
 };
 
 class FLive2DMaskBatchedElements : public FBatchedElementParameters
@@ -50,9 +72,8 @@ class FLive2DMaskBatchedElements : public FBatchedElementParameters
 public:
 	typedef TFunction<void(FRHITexture*&, FRHISamplerState*&)> FGetTextureAndSamplerDelegate;
 
-	FLive2DMaskBatchedElements(UTexture2D* InTexture2D, const float InRenderOpacity)
+	FLive2DMaskBatchedElements(UTexture2D* InTexture2D)
 		: Texture2D(InTexture2D)
-		, RenderOpacity(InRenderOpacity)
 	{}
 
 	/** Binds vertex and pixel shaders for this element */
@@ -60,7 +81,6 @@ public:
 
 private:
 	UTexture2D* Texture2D = nullptr;
-	float RenderOpacity = 1.f;
 };
 
 class FLive2DInvertedMaskBatchedElements : public FBatchedElementParameters
@@ -68,9 +88,8 @@ class FLive2DInvertedMaskBatchedElements : public FBatchedElementParameters
 public:
 	typedef TFunction<void(FRHITexture*&, FRHISamplerState*&)> FGetTextureAndSamplerDelegate;
 
-	FLive2DInvertedMaskBatchedElements(UTexture2D* InTexture2D, const float InRenderOpacity)
+	FLive2DInvertedMaskBatchedElements(UTexture2D* InTexture2D)
 		: Texture2D(InTexture2D)
-		, RenderOpacity(InRenderOpacity)
 	{}
 
 	/** Binds vertex and pixel shaders for this element */
@@ -78,5 +97,4 @@ public:
 
 private:
 	UTexture2D* Texture2D = nullptr;
-	float RenderOpacity = 1.f;
-};
\ No newline at end of file
+};
@@ -0,0 +1,83 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "Live2DRenderTargetAtlas.generated.h"
+
+class ULive2DMocModel;
+class UTextureRenderTarget2D;
+
+/**
+ * Packs the renders of many models into regions of a few shared render target pages.
+ * All dirty models of a page are drawn in one canvas pass after their masks, and each model gets a brush with the UV region of its page.
+ */
+UCLASS()
+class LIVE2D_API ULive2DRenderTargetAtlas : public UEngineSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	/** Places the model into the atlas at the given display size, or resizes its region if it is already placed */
+	void AddModel(ULive2DMocModel* Model, const FVector2D& DisplaySize);
+	void RemoveModel(ULive2DMocModel* Model);
+	bool ContainsModel(const ULive2DMocModel* Model) const;
+
+	int32 GetPageCount() const { return Pages.Num(); }
+
+	//~ Begin USubsystem Interface
+	virtual void Deinitialize() override;
+	//~ End USubsystem Interface
+
+	//~ Begin FTickableGameObject Interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableInEditor() const override { return true; }
+	virtual TStatId GetStatId() const override;
+	//~ End FTickableGameObject Interface
+
+private:
+	struct FAtlasEntry
+	{
+		TWeakObjectPtr<ULive2DMocModel> Model;
+		FIntPoint Size = FIntPoint::ZeroValue;
+		int32 PageIndex = INDEX_NONE;
+		FIntRect Region;
+		FDelegateHandle DrawablesUpdatedHandle;
+		bool bIsDirty = true;
+	};
+
+	/** Shelf packer state of a page, regions are only freed by repacking the whole atlas */
+	struct FAtlasShelf
+	{
+		int32 Y = 0;
+		int32 Height = 0;
+		int32 CursorX = 0;
+	};
+
+	struct FAtlasPage
+	{
+		TArray<FAtlasShelf> Shelves;
+		int32 NextShelfY = 0;
+	};
+
+	FIntPoint GetRegionSize(const ULive2DMocModel* Model) const;
+	bool Allocate(FAtlasEntry& Entry);
+	bool AllocateInPage(FAtlasPage& Page, const FIntPoint& Size, FIntPoint& OutPosition) const;
+	int32 AddPage();
+	void Repack();
+	void UpdateBrush(FAtlasEntry& Entry, const bool bBroadcast);
+	void DrawPage(const int32 PageIndex);
+	void OnModelDrawablesUpdated(ULive2DMocModel* Model);
+	FAtlasEntry* FindEntry(const ULive2DMocModel* Model);
+
+	UPROPERTY(Transient)
+	TArray<UTextureRenderTarget2D*> Pages;
+
+	TArray<FAtlasPage> PageAllocators;
+	TArray<FAtlasEntry> Entries;
+	bool bNeedsRepack = false;
+};
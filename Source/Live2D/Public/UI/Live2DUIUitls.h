@@ -22,4 +22,12 @@ public:
 	
 	UFUNCTION(BlueprintCallable, Category="Live 2D")
 	static void SetBrushFromSoftLive2DModelMotion(UImage* Image, TSoftObjectPtr<ULive2DModelMotion> ModelMotion);
+
+	/** Sizes the render targets of the model for the size its image is displayed at */
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	static void SetLive2DModelMotionDisplaySize(ULive2DModelMotion* ModelMotion, const FVector2D DisplaySize);
+
+	/** Displays the model from a region of the shared render target atlas, calling it again with another display size resizes the region */
+	UFUNCTION(BlueprintCallable, Category="Live 2D")
+	static void SetBrushFromLive2DModelMotionAtlas(UImage* Image, ULive2DModelMotion* ModelMotion, const FVector2D DisplaySize);
 };